@@ -0,0 +1,99 @@
+/**
+ ************************************************************************
+ * @file inc/batch.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the uplink batching stage
+ *
+ * Samples wait in the sample ring; this only decides when a batch is due
+ * and packs it, so one PUBLISH carries many samples.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include "batch.h"
+#include "sample_ring.h"
+
+static atomic_t cycleEnd = ATOMIC_INIT(0);
+static struct batch_stats stats;
+
+
+void batch_cycle_end(void) {
+
+    atomic_set(&cycleEnd, 1);
+}
+
+bool batch_ready(void) {
+
+    struct sensor_sample oldest;
+    size_t count = sample_ring_count();
+
+    if (count == 0) {
+        atomic_set(&cycleEnd, 0);
+        return false;
+    }
+
+    if (atomic_get(&cycleEnd) ||
+        count >= BATCH_MAX_SAMPLES ||
+        count * BATCH_SAMPLE_MAX_BYTES >= BATCH_MAX_BYTES) {
+        return true;
+    }
+
+    sample_ring_peek(&oldest, 1);
+
+    return k_uptime_get() - oldest.timestamp >= BATCH_MAX_AGE_MS;
+}
+
+int64_t batch_deadline(void) {
+
+    struct sensor_sample oldest;
+
+    if (sample_ring_peek(&oldest, 1) == 0) {
+        return INT64_MAX;
+    }
+
+    return oldest.timestamp + BATCH_MAX_AGE_MS;
+}
+
+int batch_encode_samples(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                         size_t n, size_t *count) {
+
+    size_t pos = 0;
+    int ret;
+
+#if BATCH_ENCODING == BATCH_ENCODING_CBOR
+    ret = encode_samples_cbor(buf, len, samples, n, count);
+    pos = MAX(ret, 0);
+#else
+    *count = 0;
+    for (size_t i = 0; i < n; i++) {
+        ret = encode_sample_text(buf + pos, len - pos, &samples[i]);
+        if (ret < 0) {
+            break;
+        }
+        pos += ret;
+        (*count)++;
+    }
+#endif
+
+    return (*count == 0 && n > 0) ? -ENOMEM : (int)pos;
+}
+
+void batch_sent(size_t count, size_t len) {
+
+    sample_ring_consume(count);
+
+    stats.flushes++;
+    stats.samples += count;
+    stats.bytes += len;
+
+    if (sample_ring_count() == 0) {
+        atomic_set(&cycleEnd, 0);
+    }
+}
+
+void batch_get_stats(struct batch_stats *out) {
+
+    *out = stats;
+}
@@ -0,0 +1,61 @@
+/**
+ ************************************************************************
+ * @file inc/batch.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the uplink batching stage
+ **********************************************************************
+ * */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <zephyr/kernel.h>
+#include "encode.h"
+
+// flush policy - whichever limit is reached first
+#define BATCH_MAX_SAMPLES       12
+#define BATCH_MAX_AGE_MS        60000
+#define BATCH_MAX_BYTES         512
+
+// sensor/ payload encoding
+#define BATCH_ENCODING_TEXT     0   // "seq@utc:co2,temperature,humidity," per sample
+#define BATCH_ENCODING_CBOR     1   // encode_samples_cbor(), on BATCH_CBOR_TOPIC
+#define BATCH_ENCODING          BATCH_ENCODING_TEXT
+
+#define BATCH_CBOR_TOPIC        "sensor/cbor/"
+
+// worst case encoded size of one sample
+#if BATCH_ENCODING == BATCH_ENCODING_CBOR
+#define BATCH_SAMPLE_MAX_BYTES  ENCODE_CBOR_SAMPLE_MAX
+#else
+#define BATCH_SAMPLE_MAX_BYTES  68
+#endif
+
+struct batch_stats {
+    uint32_t flushes;       // payloads handed to the uplink
+    uint32_t samples;
+    uint32_t bytes;
+};
+
+// chamber state machine: cycle finished, flush whatever is queued
+void batch_cycle_end(void);
+
+// a flush is due: size, age or cycle end
+bool batch_ready(void);
+
+// uptime (ms) at which the queued samples are due by age, INT64_MAX if none
+int64_t batch_deadline(void);
+
+/*
+    Encode as many of the samples as fit into one BATCH_ENCODING payload.
+    Returns the payload length and the number of samples in *count; ring
+    samples stay queued until batch_sent().
+*/
+int batch_encode_samples(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                         size_t n, size_t *count);
+void batch_sent(size_t count, size_t len);
+
+void batch_get_stats(struct batch_stats *stats);
+
+#endif
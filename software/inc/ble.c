@@ -107,7 +107,7 @@ void ble_thread_entry(void) {
 
 		//LOG_INF("Uptime %d secs", uptime_secs);
 		k_sleep(K_MSEC(1000));
-        if (!wifiConnected && state != INIT) {
+        if (!wifi_is_ready() && state != INIT) {
             LOG_ERR("Device not connected to Wi-Fi network - requires a restart");
         }
 	}
@@ -0,0 +1,310 @@
+/**
+ ************************************************************************
+ * @file inc/dns_cache.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the DNS cache
+ *
+ * Background refreshes run on their own work queue since getaddrinfo()
+ * blocks for seconds when the resolver is away. Records are only written
+ * to settings when an address changes.
+ **********************************************************************
+ * */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/logging/log.h>
+#include "dns_cache.h"
+#include "wifi.h"
+
+LOG_MODULE_REGISTER(dns_cache);
+
+// persisted as "dns/cache", an empty host marks a free slot
+struct dns_cache_record {
+    char host[DNS_CACHE_HOST_LEN];
+    struct in_addr addr;
+};
+
+struct dns_cache_slot {
+    int64_t resolvedAt;     // 0 = not resolved since boot
+    int64_t refreshAt;
+    bool suspect;           // a connect to it failed
+};
+
+static struct dns_cache_record records[DNS_CACHE_ENTRIES];
+static struct dns_cache_slot slots[DNS_CACHE_ENTRIES];
+static struct dns_cache_stats stats;
+static K_MUTEX_DEFINE(cacheLock);
+
+static K_THREAD_STACK_DEFINE(dnsStack, DNS_CACHE_STACK_SIZE);
+static struct k_work_q dnsQueue;
+
+static void dns_refresh_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(refreshWork, dns_refresh_handler);
+
+static int dns_settings_set(const char *name, size_t len,
+                            settings_read_cb read_cb, void *cb_arg) {
+
+    if (!settings_name_steq(name, "cache", NULL)) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(records) ||
+        read_cb(cb_arg, records, sizeof(records)) != sizeof(records)) {
+        memset(records, 0, sizeof(records));
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        records[i].host[DNS_CACHE_HOST_LEN - 1] = '\0';
+    }
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(dns, "dns", NULL, dns_settings_set, NULL, NULL);
+
+// slot holding host, -1 if none. Call with cacheLock held.
+static int dns_find(const char *host) {
+
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (records[i].host[0] != '\0' && !strcmp(records[i].host, host)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+    Ask the resolver, a few times. Blocks.
+*/
+static int dns_resolve(const char *host, struct in_addr *addr) {
+
+    struct zsock_addrinfo hints = {0};
+    struct zsock_addrinfo *result;
+    int64_t startedAt = k_uptime_get();
+    uint32_t took;
+    int rc = -EINVAL;
+
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    for (int attempt = 0; attempt < DNS_CACHE_RESOLVE_ATTEMPTS; attempt++) {
+        rc = zsock_getaddrinfo(host, NULL, &hints, &result);
+        if (rc == 0) {
+            net_ipaddr_copy(addr, &net_sin(result->ai_addr)->sin_addr);
+            zsock_freeaddrinfo(result);
+            break;
+        }
+    }
+
+    took = k_uptime_get() - startedAt;
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    stats.lastResolveMs = took;
+    stats.maxResolveMs = MAX(stats.maxResolveMs, took);
+    if (rc != 0) {
+        stats.failures++;
+    }
+    k_mutex_unlock(&cacheLock);
+
+    if (rc != 0) {
+        LOG_WRN("DNS not resolved for %s (%d)", host, rc);
+    }
+
+    return rc;
+}
+
+/*
+    Keep a fresh answer, in host's slot, a free one or the oldest
+*/
+static void dns_store(const char *host, const struct in_addr *addr) {
+
+    int64_t now = k_uptime_get();
+    int i;
+    bool changed;
+
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    i = dns_find(host);
+    if (i < 0) {
+        i = 0;
+        for (int j = 0; j < DNS_CACHE_ENTRIES; j++) {
+            if (records[j].host[0] == '\0') {
+                i = j;
+                break;
+            }
+            if (slots[j].resolvedAt < slots[i].resolvedAt) {
+                i = j;
+            }
+        }
+        strncpy(records[i].host, host, DNS_CACHE_HOST_LEN - 1);
+        records[i].host[DNS_CACHE_HOST_LEN - 1] = '\0';
+        changed = true;
+    } else {
+        changed = !net_ipv4_addr_cmp(&records[i].addr, addr);
+    }
+
+    records[i].addr = *addr;
+    slots[i].resolvedAt = now;
+    slots[i].refreshAt = now + DNS_CACHE_REFRESH_MS;
+    slots[i].suspect = false;
+
+    if (changed) {
+        char text[NET_IPV4_ADDR_LEN];
+
+        LOG_INF("%s is %s", host, net_addr_ntop(AF_INET, addr, text, sizeof(text)));
+        if (settings_save_one("dns/cache", records, sizeof(records))) {
+            LOG_WRN("Could not save the DNS cache");
+        }
+    }
+    k_mutex_unlock(&cacheLock);
+
+    k_work_reschedule_for_queue(&dnsQueue, &refreshWork, K_MSEC(DNS_CACHE_REFRESH_MS));
+}
+
+/*
+    Refresh every entry that is due, then sleep until the next one is
+*/
+static void dns_refresh_handler(struct k_work *work) {
+
+    char host[DNS_CACHE_HOST_LEN];
+    struct in_addr addr;
+    int64_t now = k_uptime_get();
+    int64_t next = INT64_MAX;
+    bool due;
+
+    // the wifi listener kicks us again once the network is back
+    if (!wifi_is_ready()) {
+        return;
+    }
+
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        k_mutex_lock(&cacheLock, K_FOREVER);
+        due = records[i].host[0] != '\0' && now >= slots[i].refreshAt;
+        strcpy(host, records[i].host);
+        k_mutex_unlock(&cacheLock);
+
+        if (!due) {
+            continue;
+        }
+
+        if (dns_resolve(host, &addr) == 0) {
+            dns_store(host, &addr);
+            k_mutex_lock(&cacheLock, K_FOREVER);
+            stats.refreshes++;
+            k_mutex_unlock(&cacheLock);
+        } else {
+            k_mutex_lock(&cacheLock, K_FOREVER);
+            slots[i].refreshAt = k_uptime_get() + DNS_CACHE_RETRY_MS;
+            k_mutex_unlock(&cacheLock);
+        }
+    }
+
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (records[i].host[0] != '\0') {
+            next = MIN(next, slots[i].refreshAt);
+        }
+    }
+    k_mutex_unlock(&cacheLock);
+
+    if (next != INT64_MAX) {
+        k_work_reschedule_for_queue(&dnsQueue, &refreshWork,
+                                    K_MSEC(MAX(next - k_uptime_get(), 0)));
+    }
+}
+
+static void dns_wifi_changed(uint32_t events) {
+
+    if ((events & WIFI_EVT_READY) == WIFI_EVT_READY) {
+        k_work_reschedule_for_queue(&dnsQueue, &refreshWork, K_NO_WAIT);
+    }
+}
+
+static struct wifi_listener wifiListener = {
+    .handler = dns_wifi_changed,
+};
+
+int dns_cache_lookup(const char *host, uint16_t port, struct sockaddr_in *addr) {
+
+    struct in_addr found;
+    int64_t now = k_uptime_get();
+    bool fresh = false;
+    bool suspect = false;
+    int i;
+    int rc;
+
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    i = dns_find(host);
+    if (i >= 0) {
+        found = records[i].addr;
+        suspect = slots[i].suspect;
+        fresh = !suspect && slots[i].resolvedAt != 0 &&
+                now - slots[i].resolvedAt < DNS_CACHE_TTL_MS;
+        if (fresh) {
+            stats.hits++;
+        } else if (!suspect) {
+            stats.stale++;
+        } else {
+            stats.misses++;
+        }
+    } else {
+        stats.misses++;
+    }
+    k_mutex_unlock(&cacheLock);
+
+    if (i < 0 || suspect) {
+        rc = dns_resolve(host, &found);
+        if (rc == 0) {
+            dns_store(host, &found);
+        } else if (i < 0) {
+            return rc;
+        } else {
+            LOG_WRN("Falling back to the last address of %s", host);
+        }
+    } else if (!fresh) {
+        // use it now, have a new answer for next time
+        k_work_reschedule_for_queue(&dnsQueue, &refreshWork, K_NO_WAIT);
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr = found;
+
+    return 0;
+}
+
+void dns_cache_invalidate(const char *host) {
+
+    int i;
+
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    i = dns_find(host);
+    if (i >= 0) {
+        slots[i].suspect = true;
+    }
+    k_mutex_unlock(&cacheLock);
+}
+
+void dns_cache_get_stats(struct dns_cache_stats *out) {
+
+    k_mutex_lock(&cacheLock, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&cacheLock);
+}
+
+static int dns_cache_init(void) {
+
+    k_work_queue_start(&dnsQueue, dnsStack, K_THREAD_STACK_SIZEOF(dnsStack),
+                       DNS_CACHE_PRIORITY, NULL);
+    k_thread_name_set(&dnsQueue.thread, "dns_cache");
+    wifi_add_listener(&wifiListener);
+
+    return 0;
+}
+
+SYS_INIT(dns_cache_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,60 @@
+/**
+ ************************************************************************
+ * @file inc/dns_cache.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the DNS cache
+ *
+ * IPv4 host -> address cache in front of getaddrinfo(). Answers are kept for
+ * DNS_CACHE_TTL_MS and refreshed in the background before then. The last
+ * good address of every host is persisted, so a boot with the resolver
+ * unreachable still has somewhere to connect.
+ **********************************************************************
+ * */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_ip.h>
+
+#define DNS_CACHE_ENTRIES           4
+#define DNS_CACHE_HOST_LEN          32
+// getaddrinfo() doesn't pass the record TTL up, so one TTL for everything
+#define DNS_CACHE_TTL_MS            (60 * 60 * 1000)
+// background refresh this long after an answer, well inside the TTL
+#define DNS_CACHE_REFRESH_MS        (45 * 60 * 1000)
+// a failed background refresh tries again after this
+#define DNS_CACHE_RETRY_MS          30000
+#define DNS_CACHE_RESOLVE_ATTEMPTS  3
+#define DNS_CACHE_STACK_SIZE        2048
+#define DNS_CACHE_PRIORITY          5
+
+struct dns_cache_stats {
+    uint32_t hits;          // answered from a fresh entry
+    uint32_t stale;         // answered from an expired or persisted entry
+    uint32_t misses;        // nothing cached, resolved inline
+    uint32_t refreshes;     // background refreshes that got an answer
+    uint32_t failures;      // resolver calls with no answer
+    uint32_t lastResolveMs; // time spent in the resolver
+    uint32_t maxResolveMs;
+};
+
+/*
+    Address of host, port filled in. A fresh entry is returned at once; an
+    expired or persisted one too, with a refresh started behind it. Only a
+    host never seen before, or one marked with dns_cache_invalidate(),
+    waits for the resolver. Returns 0, or the getaddrinfo() error when
+    there is no address at all.
+*/
+int dns_cache_lookup(const char *host, uint16_t port, struct sockaddr_in *addr);
+
+/*
+    The cached address didn't work: resolve again on the next lookup,
+    still falling back to it if the resolver has no answer.
+*/
+void dns_cache_invalidate(const char *host);
+
+void dns_cache_get_stats(struct dns_cache_stats *stats);
+
+#endif
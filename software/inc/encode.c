@@ -0,0 +1,356 @@
+/**
+ ************************************************************************
+ * @file inc/encode.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the uplink payload encoders
+ **********************************************************************
+ * */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zcbor_encode.h>
+#include "encode.h"
+
+// enough for INT64_MIN with a decimal point
+#define ENCODE_MAX_DIGITS   21
+#define ENCODE_MS_PER_DAY   (24 * 60 * 60 * 1000LL)
+// "YYYY-MM-DDTHH:MM:SS.mmmZ"
+#define ENCODE_JSON_TIME_LEN    24
+
+
+int encode_fixed(uint8_t *buf, size_t len, int64_t value, uint8_t decimals) {
+
+    char digits[ENCODE_MAX_DIGITS];
+    uint64_t magnitude = (value < 0) ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+    size_t n = 0;
+    size_t out = 0;
+
+    // least significant digit first, at least one digit before the point
+    do {
+        digits[n++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while ((magnitude || n <= decimals) && n < sizeof(digits));
+
+    if (len < n + (value < 0) + (decimals > 0)) {
+        return -ENOMEM;
+    }
+
+    if (value < 0) {
+        buf[out++] = '-';
+    }
+    while (n) {
+        if (n == decimals) {
+            buf[out++] = '.';
+        }
+        buf[out++] = digits[--n];
+    }
+
+    return out;
+}
+
+/*
+    Append one fixed-point field and a comma
+*/
+static int encode_field(uint8_t *buf, size_t len, size_t *pos, int64_t value, uint8_t decimals) {
+
+    int ret = encode_fixed(buf + *pos, len - *pos, value, decimals);
+
+    if (ret < 0 || *pos + ret >= len) {
+        return -ENOMEM;
+    }
+
+    *pos += ret;
+    buf[(*pos)++] = ',';
+
+    return 0;
+}
+
+/*
+    The sample's time on the payload's time base
+*/
+static int64_t encode_sample_time(const struct sensor_sample *sample, bool utc) {
+
+    return utc ? sample->utc : sample->timestamp;
+}
+
+int encode_sample_text(uint8_t *buf, size_t len, const struct sensor_sample *sample) {
+
+    int ret = encode_fixed(buf, len, sample->seq, 0);
+    size_t pos;
+
+    if (ret < 0 || ret >= len) {
+        return -ENOMEM;
+    }
+    pos = ret;
+
+    if (sample->utc != 0) {
+        buf[pos++] = '@';
+        ret = encode_fixed(buf + pos, len - pos, sample->utc, ENCODE_UTC_DECIMALS);
+        if (ret < 0 || pos + ret >= len) {
+            return -ENOMEM;
+        }
+        pos += ret;
+    }
+    buf[pos++] = ':';
+
+    if (encode_field(buf, len, &pos, sample->co2, SAMPLE_CO2_DECIMALS) ||
+        encode_field(buf, len, &pos, sample->temperature, SAMPLE_TEMPERATURE_DECIMALS) ||
+        encode_field(buf, len, &pos, sample->humidity, SAMPLE_HUMIDITY_DECIMALS)) {
+        return -ENOMEM;
+    }
+
+    return pos;
+}
+
+int encode_samples_cbor(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                        size_t count, size_t *used) {
+
+    // outer list, sample list, one sample
+    ZCBOR_STATE_E(state, 3, buf, len, 1);
+    bool utc = count > 0 && samples[0].utc != 0;
+    int64_t previous;
+    uint32_t previousSeq;
+    bool ok;
+
+    *used = 0;
+    if (len < ENCODE_CBOR_HEADER_MAX + ENCODE_CBOR_SAMPLE_MAX) {
+        return -ENOMEM;
+    }
+    count = MIN(count, (len - ENCODE_CBOR_HEADER_MAX) / ENCODE_CBOR_SAMPLE_MAX);
+    // one time base per payload, stop where it changes
+    for (size_t i = 1; i < count; i++) {
+        if ((samples[i].utc != 0) != utc) {
+            count = i;
+            break;
+        }
+    }
+    previous = (count > 0) ? encode_sample_time(&samples[0], utc) : 0;
+    previousSeq = (count > 0) ? samples[0].seq : 0;
+
+    ok = zcbor_list_start_encode(state, 5) &&
+         zcbor_uint32_put(state, ENCODE_CBOR_VERSION) &&
+         zcbor_uint32_put(state, utc ? ENCODE_CBOR_TIME_UTC : ENCODE_CBOR_TIME_UPTIME) &&
+         zcbor_uint64_put(state, (uint64_t)previous) &&
+         zcbor_uint32_put(state, previousSeq) &&
+         zcbor_list_start_encode(state, count);
+
+    for (size_t i = 0; ok && i < count; i++) {
+        int64_t t = encode_sample_time(&samples[i], utc);
+
+        // signed, a resync may step UTC back between two samples
+        ok = zcbor_list_start_encode(state, 5) &&
+             zcbor_int32_put(state, (int32_t)(t - previous)) &&
+             zcbor_uint32_put(state, samples[i].seq - previousSeq) &&
+             zcbor_int32_put(state, samples[i].co2) &&
+             zcbor_int32_put(state, samples[i].temperature) &&
+             zcbor_int32_put(state, samples[i].humidity) &&
+             zcbor_list_end_encode(state, 5);
+        previous = t;
+        previousSeq = samples[i].seq;
+    }
+
+    ok = ok && zcbor_list_end_encode(state, count) &&
+         zcbor_list_end_encode(state, 5);
+    if (!ok) {
+        return -ENOMEM;
+    }
+
+    *used = count;
+
+    return state->payload - buf;
+}
+
+int encode_flux_text(uint8_t *buf, size_t len, const struct flux_record *record) {
+
+    int ret = encode_fixed(buf, len, record->seq, 0);
+    size_t pos;
+
+    if (ret < 0 || ret >= len) {
+        return -ENOMEM;
+    }
+    pos = ret;
+    buf[pos++] = ':';
+
+    if (encode_field(buf, len, &pos, record->slope, FLUX_SLOPE_DECIMALS) ||
+        encode_field(buf, len, &pos, record->intercept, SAMPLE_CO2_DECIMALS) ||
+        encode_field(buf, len, &pos, record->r2, FLUX_R2_DECIMALS) ||
+        encode_field(buf, len, &pos, record->n, 0) ||
+        encode_field(buf, len, &pos, record->meanTemperature, SAMPLE_TEMPERATURE_DECIMALS) ||
+        encode_field(buf, len, &pos, record->meanHumidity, SAMPLE_HUMIDITY_DECIMALS) ||
+        encode_field(buf, len, &pos, record->startUtc, ENCODE_UTC_DECIMALS)) {
+        return -ENOMEM;
+    }
+
+    return pos;
+}
+
+/*
+    Append a string, unquoted
+*/
+static int encode_str(uint8_t *buf, size_t len, size_t *pos, const char *str) {
+
+    size_t n = strlen(str);
+
+    if (*pos + n > len) {
+        return -ENOMEM;
+    }
+
+    memcpy(buf + *pos, str, n);
+    *pos += n;
+
+    return 0;
+}
+
+/*
+    Append ,"time":"YYYY-MM-DDTHH:MM:SS.mmmZ" for UTC ms since the epoch
+*/
+static int encode_json_time(uint8_t *buf, size_t len, size_t *pos, int64_t utc) {
+
+    char text[ENCODE_JSON_TIME_LEN + 1];
+    int64_t days = utc / ENCODE_MS_PER_DAY;
+    int64_t ms = utc % ENCODE_MS_PER_DAY;
+    int64_t era, doe, yoe, doy, mp, year, month, day;
+
+    if (ms < 0) {
+        ms += ENCODE_MS_PER_DAY;
+        days--;
+    }
+
+    // days since 1970-01-01 to the civil date, proleptic Gregorian
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = days - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = (mp < 10) ? mp + 3 : mp - 9;
+    year = yoe + era * 400 + (month <= 2);
+
+    snprintk(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+             (int)year, (int)month, (int)day, (int)(ms / 3600000),
+             (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+
+    if (encode_str(buf, len, pos, ",\"time\":\"") ||
+        encode_str(buf, len, pos, text)) {
+        return -ENOMEM;
+    }
+
+    return encode_str(buf, len, pos, "\"");
+}
+
+/*
+    Append {"variable":"name","value":value,"group":"group"} and a comma,
+    with a "time" if utc is known
+*/
+static int encode_json_variable(uint8_t *buf, size_t len, size_t *pos, const char *name,
+                                int64_t value, uint8_t decimals, int64_t group, int64_t utc) {
+
+    int ret;
+
+    if (encode_str(buf, len, pos, "{\"variable\":\"") ||
+        encode_str(buf, len, pos, name) ||
+        encode_str(buf, len, pos, "\",\"value\":")) {
+        return -ENOMEM;
+    }
+
+    ret = encode_fixed(buf + *pos, len - *pos, value, decimals);
+    if (ret < 0) {
+        return ret;
+    }
+    *pos += ret;
+
+    if (encode_str(buf, len, pos, ",\"group\":\"")) {
+        return -ENOMEM;
+    }
+
+    ret = encode_fixed(buf + *pos, len - *pos, group, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    *pos += ret;
+
+    if (encode_str(buf, len, pos, "\"")) {
+        return -ENOMEM;
+    }
+    if (utc != 0 && encode_json_time(buf, len, pos, utc)) {
+        return -ENOMEM;
+    }
+
+    return encode_str(buf, len, pos, "},");
+}
+
+/*
+    Close the array over the trailing comma, or open and close an empty one
+*/
+static int encode_json_close(uint8_t *buf, size_t pos) {
+
+    if (buf[pos - 1] == ',') {
+        pos--;
+    }
+    buf[pos++] = ']';
+
+    return pos;
+}
+
+int encode_samples_json(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                        size_t count, size_t *used) {
+
+    size_t pos = 0;
+    size_t start;
+
+    *used = 0;
+    if (len < 2) {
+        return -ENOMEM;
+    }
+    buf[pos++] = '[';
+
+    // one byte kept back for the closing bracket
+    for (size_t i = 0; i < count; i++) {
+        start = pos;
+        if (encode_json_variable(buf, len - 1, &pos, "co2", samples[i].co2,
+                                 SAMPLE_CO2_DECIMALS, samples[i].seq, samples[i].utc) ||
+            encode_json_variable(buf, len - 1, &pos, "temperature", samples[i].temperature,
+                                 SAMPLE_TEMPERATURE_DECIMALS, samples[i].seq, samples[i].utc) ||
+            encode_json_variable(buf, len - 1, &pos, "humidity", samples[i].humidity,
+                                 SAMPLE_HUMIDITY_DECIMALS, samples[i].seq, samples[i].utc)) {
+            pos = start;
+            break;
+        }
+        (*used)++;
+    }
+
+    if (*used == 0 && count > 0) {
+        return -ENOMEM;
+    }
+
+    return encode_json_close(buf, pos);
+}
+
+int encode_flux_json(uint8_t *buf, size_t len, const struct flux_record *record) {
+
+    size_t pos = 0;
+
+    if (len < 2) {
+        return -ENOMEM;
+    }
+    buf[pos++] = '[';
+
+    if (encode_json_variable(buf, len - 1, &pos, "flux_slope", record->slope,
+                             FLUX_SLOPE_DECIMALS, record->seq, record->startUtc) ||
+        encode_json_variable(buf, len - 1, &pos, "flux_intercept", record->intercept,
+                             SAMPLE_CO2_DECIMALS, record->seq, record->startUtc) ||
+        encode_json_variable(buf, len - 1, &pos, "flux_r2", record->r2,
+                             FLUX_R2_DECIMALS, record->seq, record->startUtc) ||
+        encode_json_variable(buf, len - 1, &pos, "flux_n", record->n, 0,
+                             record->seq, record->startUtc) ||
+        encode_json_variable(buf, len - 1, &pos, "flux_temperature", record->meanTemperature,
+                             SAMPLE_TEMPERATURE_DECIMALS, record->seq, record->startUtc) ||
+        encode_json_variable(buf, len - 1, &pos, "flux_humidity", record->meanHumidity,
+                             SAMPLE_HUMIDITY_DECIMALS, record->seq, record->startUtc)) {
+        return -ENOMEM;
+    }
+
+    return encode_json_close(buf, pos);
+}
@@ -0,0 +1,72 @@
+/**
+ ************************************************************************
+ * @file inc/encode.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the uplink payload encoders
+ **********************************************************************
+ * */
+
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <zephyr/kernel.h>
+#include "sample_ring.h"
+#include "flux.h"
+
+/*
+    All encoders write text without a terminating NUL and return the number
+    of bytes written, or -ENOMEM if buf is too small. Values are fixed-point
+    integers, no float formatting is involved.
+*/
+
+// value / 10^decimals, e.g. (41234, 2) -> "412.34"
+int encode_fixed(uint8_t *buf, size_t len, int64_t value, uint8_t decimals);
+
+// UTC fields, ms since the Unix epoch written as seconds
+#define ENCODE_UTC_DECIMALS         3
+
+/*
+    "seq:co2,temperature,humidity," - the sensor/ topic format, or
+    "seq@utc:co2,temperature,humidity," once the sample has a UTC time
+*/
+int encode_sample_text(uint8_t *buf, size_t len, const struct sensor_sample *sample);
+
+/*
+    Binary sensor/ payload, CBOR:
+    [version, base, t0, seq0, [[dt, dseq, co2, temperature, humidity], ...]]
+    base says whether times are UTC or uptime, t0 and seq0 are the first
+    sample's time (ms) and sequence number, dt (signed) and dseq the steps
+    from the previous sample, fields are the fixed-point integers of
+    struct sensor_sample. A payload holds one time base only.
+    Encodes as many of the samples as fit and returns that number in *used.
+*/
+#define ENCODE_CBOR_VERSION         3
+#define ENCODE_CBOR_TIME_UPTIME     0   // not synced when sampled, or before a reboot
+#define ENCODE_CBOR_TIME_UTC        1
+// CBOR bytes outside the sample entries, worst case
+#define ENCODE_CBOR_HEADER_MAX      22
+// one [dt, dseq, co2, temperature, humidity] entry, worst case
+#define ENCODE_CBOR_SAMPLE_MAX      28
+
+int encode_samples_cbor(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                        size_t count, size_t *used);
+
+// "seq:slope,intercept,r2,n,temperature,humidity,utc," - the flux/ topic format, utc 0.000 if unknown
+int encode_flux_text(uint8_t *buf, size_t len, const struct flux_record *record);
+
+/*
+    TagoIO JSON, for the HTTP uplink: an array with a
+    {"variable": ..., "value": ..., "group": ...} object per field, plus an
+    ISO 8601 "time" once the UTC time is known. Fields are grouped by the
+    sample's or flux record's sequence number.
+    encode_samples_json() packs as many samples as fit, the number in *used.
+*/
+// one sample's three objects, worst case
+#define ENCODE_JSON_SAMPLE_MAX      300
+
+int encode_samples_json(uint8_t *buf, size_t len, const struct sensor_sample *samples,
+                        size_t count, size_t *used);
+int encode_flux_json(uint8_t *buf, size_t len, const struct flux_record *record);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ ************************************************************************
+ * @file inc/flux.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the on-device CO2 flux estimator
+ *
+ * Only running sums are kept, so the cost per sample is fixed no matter how
+ * long the chamber stays closed. The sums are integer (ms, centi-ppm) and
+ * the fit itself is only solved once per cycle.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "flux.h"
+#include "sample_log.h"
+
+LOG_MODULE_REGISTER(soil_respiration_flux);
+
+K_MSGQ_DEFINE(fluxMsgq, sizeof(struct flux_record), FLUX_QUEUE_LEN, 4);
+
+static struct flux_window {
+    bool active;
+    uint32_t n;
+    int64_t start;
+    int64_t end;
+    int64_t startUtc;
+    int64_t sumX;       // ms since start
+    int64_t sumY;       // centi-ppm
+    int64_t sumXX;
+    int64_t sumXY;
+    int64_t sumYY;
+    int64_t sumTemperature;
+    int64_t sumHumidity;
+} window;
+
+static struct k_spinlock fluxLock;
+
+static int32_t flux_round(double value) {
+
+    return (int32_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+
+void flux_begin(void) {
+
+    k_spinlock_key_t key = k_spin_lock(&fluxLock);
+
+    memset(&window, 0, sizeof(window));
+    window.active = true;
+
+    k_spin_unlock(&fluxLock, key);
+}
+
+void flux_add(const struct sensor_sample *sample) {
+
+    k_spinlock_key_t key = k_spin_lock(&fluxLock);
+    int64_t x, y;
+
+    if (!window.active) {
+        k_spin_unlock(&fluxLock, key);
+        return;
+    }
+
+    if (window.n == 0) {
+        window.start = sample->timestamp;
+        window.startUtc = sample->utc;
+    }
+    window.end = sample->timestamp;
+
+    x = sample->timestamp - window.start;
+    y = sample->co2;
+
+    window.n++;
+    window.sumX += x;
+    window.sumY += y;
+    window.sumXX += x * x;
+    window.sumXY += x * y;
+    window.sumYY += y * y;
+    window.sumTemperature += sample->temperature;
+    window.sumHumidity += sample->humidity;
+
+    k_spin_unlock(&fluxLock, key);
+}
+
+void flux_finish(void) {
+
+    struct flux_window w;
+    struct flux_record record = {0};
+    double sxx, sxy, syy, slope;
+    k_spinlock_key_t key = k_spin_lock(&fluxLock);
+
+    w = window;
+    window.active = false;
+
+    k_spin_unlock(&fluxLock, key);
+
+    if (w.n < 2) {
+        LOG_WRN("Cycle closed with %u samples, no flux", w.n);
+        return;
+    }
+
+    sxx = (double)w.n * w.sumXX - (double)w.sumX * w.sumX;
+    sxy = (double)w.n * w.sumXY - (double)w.sumX * w.sumY;
+    syy = (double)w.n * w.sumYY - (double)w.sumY * w.sumY;
+
+    if (sxx <= 0.0) {
+        LOG_WRN("Cycle samples share one timestamp, no flux");
+        return;
+    }
+
+    // centi-ppm/ms
+    slope = sxy / sxx;
+
+    record.start = w.start;
+    record.end = w.end;
+    record.startUtc = w.startUtc;
+    record.n = w.n;
+    // centi-ppm/ms -> micro-ppm/s
+    record.slope = flux_round(slope * 10.0 * 1000000.0);
+    record.intercept = flux_round((w.sumY - slope * w.sumX) / w.n);
+    record.r2 = (syy > 0.0) ? flux_round((sxy * sxy) / (sxx * syy) * 1000000.0) : 1000000;
+    record.meanTemperature = flux_round((double)w.sumTemperature / w.n);
+    record.meanHumidity = flux_round((double)w.sumHumidity / w.n);
+
+    // taken last, so samples of the next cycle number after the record
+    record.seq = sample_log_next_seq();
+
+    LOG_INF("Cycle flux %u: %d micro-ppm/s, r2 %d/1000000 over %u samples",
+        record.seq, record.slope, record.r2, record.n);
+
+    if (k_msgq_put(&fluxMsgq, &record, K_NO_WAIT) != 0) {
+        // keep the newest cycles
+        struct flux_record oldest;
+
+        k_msgq_get(&fluxMsgq, &oldest, K_NO_WAIT);
+        k_msgq_put(&fluxMsgq, &record, K_NO_WAIT);
+        LOG_WRN("Flux queue full, oldest cycle dropped");
+    }
+}
+
+int flux_peek(struct flux_record *record) {
+
+    return k_msgq_peek(&fluxMsgq, record);
+}
+
+void flux_consume(void) {
+
+    struct flux_record record;
+
+    k_msgq_get(&fluxMsgq, &record, K_NO_WAIT);
+}
@@ -0,0 +1,51 @@
+/**
+ ************************************************************************
+ * @file inc/flux.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the on-device CO2 flux estimator
+ **********************************************************************
+ * */
+
+#ifndef FLUX_H
+#define FLUX_H
+
+#include <zephyr/kernel.h>
+#include "sample_ring.h"
+
+// chamber cycles queued for the uplink, it spools them to the sample log while down
+#define FLUX_QUEUE_LEN  8
+
+// fixed-point record fields, value = field / 10^decimals
+#define FLUX_SLOPE_DECIMALS     6
+#define FLUX_R2_DECIMALS        6
+
+/*
+    One chamber cycle: least-squares fit of CO2 against time since the
+    first sample of the SENSING window
+*/
+struct flux_record {
+    int64_t start;              // uptime of first sample, ms
+    int64_t end;                // uptime of last sample, ms
+    int64_t startUtc;           // UTC of first sample, ms, 0 until the clock is synced
+    uint32_t seq;               // sample_log_next_seq(), for deduplication
+    int32_t slope;              // micro-ppm/s
+    int32_t intercept;          // centi-ppm at start
+    int32_t r2;                 // millionths
+    uint32_t n;
+    int32_t meanTemperature;    // milli-degrees Celsius
+    int32_t meanHumidity;       // milli-%RH
+};
+
+// chamber state machine: open the window on entering SENSING
+void flux_begin(void);
+// sensor thread: O(1), constant memory
+void flux_add(const struct sensor_sample *sample);
+// chamber state machine: close the window on SENSING -> SENSING_END and queue the record
+void flux_finish(void);
+
+// uplink: oldest queued record, consume once sent
+int flux_peek(struct flux_record *record);
+void flux_consume(void);
+
+#endif
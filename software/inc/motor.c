@@ -4,29 +4,34 @@
  * @author Thomas Salpietro 45822490
  * @date 06/04/2023
  * @brief Contains source code for the motor driver
+ *
+ * The chamber runs as a state machine on one delayable work item on its
+ * own work queue. Every step arms the next one at an absolute uptime,
+ * so the handler only runs when a pin has to change or a state ends, and
+ * late steps don't push the rest of the cycle back.
  **********************************************************************
  * */
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/logging/log.h>
 #include "motor.h"
 #include "wifi.h"
+#include "flux.h"
+#include "batch.h"
+#include "uplink.h"
+#include "radio.h"
 
 LOG_MODULE_REGISTER(soil_respiration_chamber);
 
 //IO 25 and 26
 #define SW1_NODE DT_ALIAS(sw1)
 #define SW2_NODE DT_ALIAS(sw2)
-#define TICKS_PER_SEC               10000
-#define FIVE_SEC_TIMEOUT_MS         5000
-#define ONE_MIN_TIMEOUT_MS          60000
 #define ONE_HOUR_TIMEOUT_MS         3600000
 #define FIFTEEN_MIN_TIMEOUT_MS      900000
-#define FORTY_FIVE_MIN_TIMEOUT_MS   2700000
-#define FIVE_MIN_TIMEOUT_MS         300000
 #define SIX_SEC_TIMEOUT_MS          6000
 
 static const struct gpio_dt_spec motorUp = GPIO_DT_SPEC_GET_OR(SW1_NODE, gpios, {0});
@@ -35,141 +40,226 @@ static const struct gpio_dt_spec motorDown = GPIO_DT_SPEC_GET_OR(SW2_NODE, gpios
 States state = INIT;
 int64_t period = (int64_t)FIFTEEN_MIN_TIMEOUT_MS;
 
+// one pin setting of the INIT sweep and how long it is held
+struct motor_move {
+    bool up;
+    bool down;
+    int32_t ms;
+};
 
-void thread_entry_motor(void) {
+// all the way up, stop, all the way down
+static const struct motor_move initMoves[] = {
+    {true, false, MOTOR_DEAD_MS + SIX_SEC_TIMEOUT_MS},
+    {false, false, MOTOR_DEAD_MS + MOTOR_PAUSE_MS},
+    {false, true, MOTOR_DEAD_MS + SIX_SEC_TIMEOUT_MS},
+};
+
+static uint8_t initStep;
+// BEGIN and END: motor stopped, settling before the next state
+static bool settling;
+// uptime the running step was due at, and the current cycle's start and period
+static int64_t dueAt;
+static int64_t cycleAt;
+static int64_t cyclePeriod;
+// a cycle start is waiting for the network, the wifi listener resumes it
+static atomic_t networkWait;
+// the handler was run by its timer, not by the wifi listener
+static bool timed;
+// only the work item writes these
+static struct motor_stats stats;
+
+static K_THREAD_STACK_DEFINE(motorStack, MOTOR_STACK_SIZE);
+static struct k_work_q motorQueue;
+
+static void motor_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(motorWork, motor_work_handler);
+
+/*
+    Change state and let the radio scheduler know how long it will last
+*/
+static void motor_set_state(States next, int64_t durationMs) {
+
+    state = next;
+    radio_motor_state(next, durationMs);
+    uplink_motor_state(next, durationMs);
+}
+
+static void motor_drive(bool up, bool down) {
+
+    gpio_pin_set_dt(&motorUp, up);
+    gpio_pin_set_dt(&motorDown, down);
+}
+
+// run the handler again delayMs after the step now due
+static void motor_after(int64_t delayMs) {
+
+    dueAt += delayMs;
+    timed = true;
+    k_work_reschedule_for_queue(&motorQueue, &motorWork, K_TIMEOUT_ABS_MS(dueAt));
+}
+
+/*
+    Cycles only start with the network up. Returns false if the wifi
+    listener will run the handler again once it is.
+*/
+static bool motor_network_ready(void) {
+
+    atomic_set(&networkWait, 1);
+    if (!wifi_is_ready()) {
+        stats.networkWaits++;
+        return false;
+    }
+
+    // lost to the listener: it has queued the handler already
+    return atomic_cas(&networkWait, 1, 0);
+}
+
+static void motor_begin_cycle(void) {
+
+    LOG_INF("Cycle %u: lowering the chamber", stats.cycles + 1);
+    // a period change lands in the next cycle, SLEEP still fills the hour
+    cycleAt = dueAt;
+    cyclePeriod = period;
+    stats.cycles++;
+    motor_drive(false, true);
+    motor_set_state(SENSING_BEGIN, SIX_SEC_TIMEOUT_MS);
+    motor_after(SIX_SEC_TIMEOUT_MS);
+}
+
+static void motor_work_handler(struct k_work *work) {
+
+    int64_t now = k_uptime_get();
+    int64_t sleepMs;
+
+    stats.wakeups++;
+    if (timed) {
+        stats.maxLateMs = MAX(stats.maxLateMs, (uint32_t)MAX(now - dueAt, 0));
+        timed = false;
+    }
+
+    switch (state) {
+        case INIT:
+            if (initStep == 0) {
+                if (!motor_network_ready()) {
+                    return;
+                }
+                LOG_INF("Initialising Chamber...");
+                dueAt = now;
+            }
+            if (initStep < ARRAY_SIZE(initMoves)) {
+                motor_drive(initMoves[initStep].up, initMoves[initStep].down);
+                motor_after(initMoves[initStep].ms);
+                initStep++;
+                break;
+            }
+            motor_begin_cycle();
+            break;
+
+        case SENSING_BEGIN:
+            if (!settling) {
+                motor_drive(false, false);
+                settling = true;
+                motor_after(MOTOR_SETTLE_MS);
+                break;
+            }
+            settling = false;
+            flux_begin();
+            motor_set_state(SENSING, cyclePeriod);
+            LOG_INF("Begin Sensing...");
+            motor_after(cyclePeriod);
+            break;
+
+        case SENSING:
+            LOG_INF("Done Sensing!");
+            flux_finish();
+            batch_cycle_end();
+            uplink_notify();
+            motor_drive(true, false);
+            motor_set_state(SENSING_END, SIX_SEC_TIMEOUT_MS);
+            motor_after(SIX_SEC_TIMEOUT_MS);
+            break;
+
+        case SENSING_END:
+            if (!settling) {
+                motor_drive(false, false);
+                settling = true;
+                motor_after(MOTOR_SETTLE_MS);
+                break;
+            }
+            settling = false;
+            // time left in the hour once the chamber has gone down and up
+            sleepMs = MAX(cycleAt + ONE_HOUR_TIMEOUT_MS - dueAt, 0);
+            motor_set_state(SLEEP, sleepMs);
+            LOG_INF("Sleeping for %lld s", sleepMs / MSEC_PER_SEC);
+            motor_after(sleepMs);
+            break;
+
+        case SLEEP:
+            if (!motor_network_ready()) {
+                return;
+            }
+            // held back by the network: the cycle starts now, not when due
+            dueAt = MAX(dueAt, now);
+            motor_begin_cycle();
+            break;
+    }
+}
+
+static void motor_wifi_changed(uint32_t events) {
+
+    if ((events & WIFI_EVT_READY) == WIFI_EVT_READY && atomic_cas(&networkWait, 1, 0)) {
+        k_work_reschedule_for_queue(&motorQueue, &motorWork, K_NO_WAIT);
+    }
+}
+
+static struct wifi_listener wifiListener = {
+    .handler = motor_wifi_changed,
+};
+
+void motor_start(void) {
     int ret;
-    	
+
     ret = gpio_pin_configure_dt(&motorUp, GPIO_OUTPUT_INACTIVE);
     if (ret != 0) {
 		printk("Error %d: failed to configure UP device %s pin %d\n",
 		    ret, motorUp.port->name, motorUp.pin);
-		//motorUp.port = NULL;
 	} else {
 		printk("Set up UP at %s pin %d\n", motorUp.port->name, motorUp.pin);
 	}
 
-
     ret = gpio_pin_configure_dt(&motorDown, GPIO_OUTPUT_INACTIVE);
     if (ret != 0) {
 		printk("Error %d: failed to configure DOWN device %s pin %d\n",
 		    ret, motorDown.port->name, motorDown.pin);
-		//motorDown.port = NULL;
 	} else {
 		printk("Set up DOWN at %s pin %d\n", motorDown.port->name, motorDown.pin);
 	}
 
-    
-    int64_t upTime = 0;
-
     if (!gpio_is_ready_dt(&motorUp)) {
         printk("Up not ready\r\n");
-		return 0;
+		return;
 	}
     if (!gpio_is_ready_dt(&motorDown)) {
         printk("down not ready\r\n");
-		return 0;
+		return;
 	}
 
-    
-
-    while (true) {
-        while (!wifiConnected) {
-            //do nothing
-            k_msleep(100);
-            
-        }
-        
-
-        switch(state) { 
-            case INIT: 
-                //init state
-                //turn all the way up, then turn all the way down.
-                LOG_INF("Initialising Chamber...\r\n");
-                gpio_pin_set_dt(&motorUp, 1);
-                k_msleep(200);
-                gpio_pin_set_dt(&motorDown, 0);
-                //printk("Going up\r\n");
-                k_msleep(6000);
-                gpio_pin_set_dt(&motorUp, 0);
-                k_msleep(200);
-                gpio_pin_set_dt(&motorDown, 0);
-                k_msleep(1000);
-                //printk("going down\r\n");
-                gpio_pin_set_dt(&motorDown, 1);
-                k_msleep(200);
-                gpio_pin_set_dt(&motorUp, 0);
-                k_msleep(6000);
-                gpio_pin_set_dt(&motorDown, 0);
-                
-                state = SENSING_BEGIN;
-                gpio_pin_set_dt(&motorDown, 1);
-                gpio_pin_set_dt(&motorUp, 0);
-                upTime = k_uptime_get();
-                break;
-            case SENSING_BEGIN:
-                //turn off (DOWN) all the w
-                // so if it is already set, we want to check if the uptime has ticked over 5 seconds, then switch off gpio and change state
-                if (k_uptime_get() - upTime > (int64_t)SIX_SEC_TIMEOUT_MS) {
-                    // so its gone on longer than 5 seconds - turn it off and change state
-                    gpio_pin_set_dt(&motorDown, 0);
-                    k_msleep(500);
-                    gpio_pin_set_dt(&motorUp, 0);
-                    upTime = k_uptime_get();
-                    state = SENSING;
-                    LOG_INF("Begin Sensing... \r\n");
-                }
-                else {
-                    k_msleep(1000);
-                }
-                
-                break;
-            case SENSING:
-                // this should keep track of time (1 minute), after a minute has passed, change state to SENSING_END
-                if (k_uptime_get() - upTime > period) {
-                    //1 minute elapsed, change state to sensing end
-                    LOG_INF("Done Sensing!");
-                    gpio_pin_set_dt(&motorUp, 1);
-                    gpio_pin_set_dt(&motorDown, 0);
-                    upTime = k_uptime_get();
-                    state = SENSING_END;
-                } else {
-                    //15 minutes still going - do nothing
-                    k_msleep(1000);
-                }
-                break;  
-            case SENSING_END:                   
-                // so if it is already set, we want to check if the uptime has ticked over 5 seconds, then switch off gpio and change state
-                if (k_uptime_get() - upTime > (int64_t)SIX_SEC_TIMEOUT_MS) {
-                    // so its gone on longer than 5 seconds - turn it off and change state
-                    gpio_pin_set_dt(&motorUp, 0);
-                    k_msleep(500);
-                    gpio_pin_set_dt(&motorDown, 0);
-                    upTime = k_uptime_get();
-                    state = SLEEP;
-                } else {
-                    k_msleep(1000);
-                }
-                
+    wifi_add_listener(&wifiListener);
+    k_work_reschedule_for_queue(&motorQueue, &motorWork, K_NO_WAIT);
+}
 
-                break;
-            case SLEEP:
-                k_msleep(5000);
-                // do nothing state - check to see if 1 hour has passed
-                if ((k_uptime_get() - upTime) > ((int64_t)ONE_HOUR_TIMEOUT_MS - period - (int64_t)SIX_SEC_TIMEOUT_MS - (int64_t)SIX_SEC_TIMEOUT_MS)) {
-                    //one hour has passed - change state
-                    state = SENSING_BEGIN;
-                    gpio_pin_set_dt(&motorDown, 1);
-                    gpio_pin_set_dt(&motorUp, 0);
-                    upTime = k_uptime_get();
-                } else if ((k_uptime_get() - upTime) % 60000){
-                    LOG_INF("Sleep time remaining: %lld minutes", ((int64_t)ONE_HOUR_TIMEOUT_MS - period - (k_uptime_get() - upTime)) / 60000);
-                }
-                break; 
-        }
-        k_msleep(100);
+void motor_get_stats(struct motor_stats *out) {
 
+    *out = stats;
+}
 
-    }
+static int motor_init(void) {
+
+    k_work_queue_start(&motorQueue, motorStack, K_THREAD_STACK_SIZEOF(motorStack),
+                       MOTOR_PRIORITY, NULL);
+    k_thread_name_set(&motorQueue.thread, "chamber");
 
+    return 0;
+}
 
-}
\ No newline at end of file
+SYS_INIT(motor_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -10,7 +10,32 @@
 #ifndef MOTOR_H
 #define MOTOR_H
 
-void thread_entry_motor(void);
+#include <zephyr/kernel.h>
+
+// both pins off before the motor changes direction
+#define MOTOR_DEAD_MS       200
+// stopped between the up and down sweeps of INIT
+#define MOTOR_PAUSE_MS      1000
+// motor coasting after a move, before the next state starts
+#define MOTOR_SETTLE_MS     500
+// the state machine's work queue, the flux fit at SENSING's end runs on it
+#define MOTOR_STACK_SIZE    2048
+#define MOTOR_PRIORITY      4
+
+struct motor_stats {
+    uint32_t cycles;        // chamber cycles started
+    uint32_t wakeups;       // state machine steps run
+    uint32_t networkWaits;  // cycle starts held back for the network
+    uint32_t maxLateMs;     // latest step after its deadline
+};
+
+/*
+    Configure the motor pins and start the chamber cycle. The state
+    machine runs on a work queue of its own, not a thread that sleeps.
+*/
+void motor_start(void);
+
+void motor_get_stats(struct motor_stats *stats);
 
 //extern bool stateSensing;
 //extern bool stateInit;
@@ -17,15 +17,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/util.h>
-#include <zephyr/sys/reboot.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/random/rand32.h>
 #include <zephyr/data/json.h>
 
+#include "mqtt.h"
 #include "wifi.h"
 #include "sensor.h"
 #include "ota.h"
 #include "motor.h"
+#include "batch.h"
+#include "mqtt_window.h"
+#include "radio.h"
+#include "dns_cache.h"
+#include "uplink.h"
 
 
 
@@ -51,12 +59,16 @@ static uint8_t temp_ws_rx_buf[MQTT_LIB_WEBSOCKET_RECV_BUF_LEN];
 
 
 #define APP_CONNECT_TIMEOUT_MS  2000
-#define APP_SLEEP_MSECS		    500
-#define APP_CONNECT_TRIES	    10
+// reconnect back off, doubled per failed attempt up to the max
+#define APP_BACKOFF_MIN_MSECS	1000
+#define APP_BACKOFF_MAX_MSECS	(5 * 60 * MSEC_PER_SEC)
 #define APP_MQTT_BUFFER_SIZE	4096
+// poll period when the notify socketpair is missing
+#define APP_RETRY_MSECS		1000
 
-#define SIMPLE_HTTP_OTA_MAJOR_VERSION 2
-#define SIMPLE_HTTP_OTA_MINOR_VERSION 2
+// fds[] slots: broker socket, then the mqtt_notify() socketpair
+#define FD_SOCKET		0
+#define FD_NOTIFY		1
 
 #define RC_STR(rc) ((rc) == 0 ? "OK" : "ERROR")
 
@@ -70,28 +82,81 @@ static uint8_t rx_buf[APP_MQTT_BUFFER_SIZE];
 static uint8_t tx_buf[APP_MQTT_BUFFER_SIZE];
 static uint8_t buffer[APP_MQTT_BUFFER_SIZE];
 
-uint8_t flagOta = 0;
-
-#if defined(CONFIG_DNS_RESOLVER)
-static struct zsock_addrinfo hints;
-static struct zsock_addrinfo *haddr;
-#endif
-
 // MQTT client struct
 static struct mqtt_client client_ctx;
 
 // MQTT BROKER parameters
 static struct sockaddr_storage broker;
 
+// password and user for tago dashbaord
+static struct mqtt_utf8 password = {
+	.utf8 = (uint8_t *)"260092b0-8ce9-45a0-9db2-402b4362e14c",
+	.size = sizeof("260092b0-8ce9-45a0-9db2-402b4362e14c") - 1,
+};
+static struct mqtt_utf8 user = {
+	.utf8 = (uint8_t *)"Token",
+	.size = sizeof("Token") - 1,
+};
+
 static uint8_t otaTopic[] = "fota/";
 static uint8_t periodTopic[] = "period/";
+static uint8_t uplinkTopic[] = "uplink/";
+#if BATCH_ENCODING == BATCH_ENCODING_CBOR
+static uint8_t topic[] = BATCH_CBOR_TOPIC;
+#else
 static uint8_t topic[] = "sensor/#";
-static struct mqtt_topic subs_topic;
+#endif
+static uint8_t fluxTopic[] = "flux/";
+static uint8_t otaStatusTopic[] = "ota/status/";
+static struct mqtt_topic subs_topics[3];
 static struct mqtt_subscription_list subs_list;
 
-static struct zsock_pollfd fds[1];
+// poll skips negative fds, no broker socket until the first connect
+static struct zsock_pollfd fds[2] = {
+	[FD_SOCKET] = {.fd = -1},
+	[FD_NOTIFY] = {.fd = -1},
+};
 static int nfds;
 static bool connected;
+static bool sessionPresent;
+
+/*
+    Connection supervisor. The loop only talks to the broker in CONN_CONNECTED;
+    any socket error drops it to CONN_BACKOFF and the next attempt resolves
+    the broker again before connecting.
+*/
+enum conn_state {
+	CONN_DISCONNECTED,
+	CONN_RESOLVING,
+	CONN_CONNECTING,
+	CONN_CONNECTED,
+	CONN_BACKOFF,
+};
+
+static enum conn_state connState = CONN_DISCONNECTED;
+static uint32_t connAttempts;
+static int64_t reconnectAt;
+// WiFi link, IP and DNS all up, as last seen by this thread
+static bool linkReady;
+static int64_t disconnectedAt;
+static struct mqtt_conn_stats connStats;
+
+// mqtt_notify() writes one byte to notifyFds[1], the loop polls notifyFds[0]
+static int notifyFds[2] = {-1, -1};
+static atomic_t notifyPending = ATOMIC_INIT(0);
+static atomic_t notifyCount = ATOMIC_INIT(0);
+static struct mqtt_wakeup_stats wakeups;
+// what went over the wire, for the uplink report
+static struct uplink_status wire;
+
+// what the next poll timeout stands for
+enum wake_deadline {
+	WAKE_CALLER,		// the uplink thread's own deadline
+	WAKE_KEEPALIVE,
+	WAKE_RETRANSMIT,
+	WAKE_RETRY,
+	WAKE_RECONNECT,
+};
 
 struct period_JSON {
     const char *unit;
@@ -105,14 +170,10 @@ static const struct json_obj_descr period_descr[] = {
 
 struct period_JSON periodResults;
 
-struct fota_JSON {
-    const char *unit;
-    const char  *value;
-};
-
 static const struct json_obj_descr fota_descr[] = {
 	JSON_OBJ_DESCR_PRIM(struct fota_JSON, unit, JSON_TOK_STRING),
 	JSON_OBJ_DESCR_PRIM(struct fota_JSON, value, JSON_TOK_STRING),
+	JSON_OBJ_DESCR_PRIM(struct fota_JSON, sha256, JSON_TOK_STRING),
 };
 
 struct fota_JSON fotaResults;
@@ -121,14 +182,16 @@ struct fota_JSON fotaResults;
 static void prepare_fds(struct mqtt_client *client)
 {
 	if (client->transport.type == MQTT_TRANSPORT_NON_SECURE) {
-		fds[0].fd = client->transport.tcp.sock;
+		fds[FD_SOCKET].fd = client->transport.tcp.sock;
 	}
-	fds[0].events = ZSOCK_POLLIN;
+	fds[FD_SOCKET].events = ZSOCK_POLLIN;
 	nfds = 1;
 }
 
 
 static void clear_fds(void) {
+	// poll skips negative fds, the notify slot keeps working
+	fds[FD_SOCKET].fd = -1;
 	nfds = 0;
 }
 
@@ -177,6 +240,51 @@ static ssize_t handle_published_message(const struct mqtt_publish_param *pub)
 }
 
 
+/*
+    Commands from the dashboard, whichever transport brought them. payload
+    is parsed in place.
+*/
+void mqtt_command(const char *topic, char *payload, size_t len)
+{
+	int err;
+
+	if (!strcmp(topic, "period/")) {
+		// read period payload and update
+		json_obj_parse(payload, len, period_descr, ARRAY_SIZE(period_descr), &periodResults);
+		LOG_INF("Sensor period changed to: %s minutes", periodResults.value);
+		period = atoi(periodResults.value) * 1000 * 60;
+
+	} else if (!strcmp(topic, "fota/") || !strcmp(topic, "fota/d/")) {
+		//FOTA NOW
+		
+		// sha256 is optional, don't keep one from an older message
+		memset(&fotaResults, 0, sizeof(fotaResults));
+		json_obj_parse(payload, len, fota_descr, ARRAY_SIZE(fota_descr), &fotaResults);
+		
+		//strncpy(host_ip, fotaResults.value, strlen(fotaResults.value));
+		err = simple_http_ota_request(fotaResults.value, fotaResults.sha256);
+		if (err == -EBUSY) {
+			LOG_WRN("FOTA already running, request ignored");
+		} else if (err != 0) {
+			LOG_ERR("FOTA request rejected: %d", err);
+		} else {
+			LOG_INF("FOTA initiated...");
+		}
+	} else if (!strcmp(topic, "uplink/")) {
+		// {"value": "http"} moves this site off port 1883, reboots
+		struct period_JSON uplinkResults = {0};
+
+		json_obj_parse(payload, len, period_descr, ARRAY_SIZE(period_descr), &uplinkResults);
+		err = uplink_transport_parse(uplinkResults.value);
+		if (err < 0 || uplink_select(err) != 0) {
+			LOG_ERR("Uplink %s not selected", uplinkResults.value ? uplinkResults.value : "?");
+		}
+	} else {
+		//do nothing;
+	}
+}
+
+
 /*
     MQTT event handler
 */
@@ -192,7 +300,9 @@ void mqtt_evt_handler(struct mqtt_client *client,
 		}
 
 		connected = true;
-		LOG_INF("MQTT client connected!");
+		sessionPresent = evt->param.connack.session_present_flag;
+		LOG_INF("MQTT client connected! (session %s)",
+			sessionPresent ? "resumed" : "new");
 
 		break;
 
@@ -210,6 +320,7 @@ void mqtt_evt_handler(struct mqtt_client *client,
 		}
 
 		LOG_INF("PUBACK packet id: %u", evt->param.puback.message_id);
+		mqtt_window_ack(evt->param.puback.message_id);
 
 		break;
 
@@ -253,25 +364,19 @@ void mqtt_evt_handler(struct mqtt_client *client,
 		
 		handle_published_message(pub);
 
-		
-		if (!strcmp((const char *)pub->message.topic.topic.utf8, "period/")) {
-			// read period payload and update
-			json_obj_parse(buffer, sizeof(buffer), period_descr, ARRAY_SIZE(period_descr), &periodResults);
-			LOG_INF("Sensor period changed to: %s minutes", periodResults.value);
-			period = atoi(periodResults.value) * 1000 * 60;
-
-		} else if (!strcmp((const char *)pub->message.topic.topic.utf8, "fota/") || !strcmp((const char *)pub->message.topic.topic.utf8, "fota/d/")) {
-			//FOTA NOW
-			
-			json_obj_parse(buffer, sizeof(buffer), fota_descr, ARRAY_SIZE(fota_descr), &fotaResults);
-			
-			//strncpy(host_ip, fotaResults.value, strlen(fotaResults.value));
-			LOG_INF("FOTA initiated...");
-			flagOta = 1;
-		} else {
-			//do nothing;
+		if (pub->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+			// queued for us by the broker while we were away
+			const struct mqtt_puback_param ack = {
+				.message_id = pub->message_id
+			};
+
+			err = mqtt_publish_qos1_ack(client, &ack);
+			if (err != 0) {
+				LOG_ERR("Failed to send MQTT PUBACK: %d", err);
+			}
 		}
 
+		mqtt_command((const char *)pub->message.topic.topic.utf8, buffer, sizeof(buffer));
 
 		break;
 
@@ -282,304 +387,540 @@ void mqtt_evt_handler(struct mqtt_client *client,
 
 
 
-static void broker_init(void) {
+static int broker_init(void) {
 
 	struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
 
-	broker4->sin_family = AF_INET;
-	broker4->sin_port = htons(SERVER_PORT);
 #if defined(CONFIG_DNS_RESOLVER)
-	net_ipaddr_copy(&broker4->sin_addr,
-			&net_sin(haddr->ai_addr)->sin_addr);
+	return dns_cache_lookup(SERVER_ADDR, SERVER_PORT, broker4);
 #else
+	broker4->sin_family = AF_INET;
+	broker4->sin_port = htons(SERVER_PORT);
 	zsock_inet_pton(AF_INET, SERVER_ADDR, &broker4->sin_addr);
+	return 0;
 #endif
-
 }
 
 
 
 
 /*
-    Connect to MQTT Broker
+    Connect to MQTT Broker, one attempt
 */
 static int connect_to_broker(struct mqtt_client *client)
 {
-	int rc, i = 0;
+	int rc;
 
-	while (i++ < APP_CONNECT_TRIES && !connected) {
-		rc = mqtt_connect(client);
-		if (rc != 0) {
-			PRINT_RESULT("mqtt_connect", rc);
-			k_sleep(K_MSEC(APP_SLEEP_MSECS));
-			continue;
-		}
-
-		prepare_fds(client);
+	rc = mqtt_connect(client);
+	if (rc != 0) {
+		PRINT_RESULT("mqtt_connect", rc);
+		return rc;
+	}
 
-		if (wait(APP_CONNECT_TIMEOUT_MS)) {
-			mqtt_input(client);
-		}
+	prepare_fds(client);
 
-		if (!connected) {
-			mqtt_abort(client);
-		}
+	if (wait(APP_CONNECT_TIMEOUT_MS) > 0) {
+		mqtt_input(client);
 	}
 
-	if (connected) {
-		return 0;
+	if (!connected) {
+		mqtt_abort(client);
+		return -ETIMEDOUT;
 	}
 
-	return -EINVAL;
+	return 0;
 }
 
-#if defined(CONFIG_DNS_RESOLVER)
-static int get_mqtt_broker_addrinfo(void)
-{
-	int retries = 3;
-	int rc = -EINVAL;
-
-	while (retries--) {
-		hints.ai_family = AF_INET;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = 0;
-
-		rc = zsock_getaddrinfo("mqtt.tago.io", "1883",
-				       &hints, &haddr);
-		if (rc == 0) {
-			LOG_INF("DNS resolved for %s:%d",
-			"mqtt.tago.io",
-			1883);
-
-			return 0;
-		}
 
-		LOG_ERR("DNS not resolved for %s:%d, retrying",
-			"mqtt.tago.io",
-			1883);
-	}
-
-	return rc;
-}
-#endif
-
-static void subscribe_ota(struct mqtt_client *client)
+/*
+    Subscribe to every command topic in one SUBSCRIBE. QoS 1 so the broker
+    queues commands for the persistent session while we are offline.
+*/
+static void subscribe_topics(struct mqtt_client *client)
 {
 	int err;
 
-	/* subscribe */
-	subs_topic.topic.utf8 = otaTopic;
-	subs_topic.topic.size = strlen(otaTopic);
-	subs_list.list = &subs_topic;
-	subs_list.list_count = 1U;
-	subs_list.message_id = 1U;
-	LOG_INF("Subscribing to %hu topic(s)", subs_list.list_count);
-
-	err = mqtt_subscribe(client, &subs_list);
-	if (err) {
-		LOG_ERR("Failed on topic %s", otaTopic);
-	}
-}
-
-static void subscribe_period(struct mqtt_client *client) {
-	int err;
-	/* subscribe */
-	subs_topic.topic.utf8 = periodTopic;
-	subs_topic.topic.size = strlen(periodTopic);
-	subs_list.list = &subs_topic;
-	subs_list.list_count = 1U;
-	subs_list.message_id = 1U;
+	subs_topics[0].topic.utf8 = periodTopic;
+	subs_topics[0].topic.size = strlen(periodTopic);
+	subs_topics[0].qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	subs_topics[1].topic.utf8 = otaTopic;
+	subs_topics[1].topic.size = strlen(otaTopic);
+	subs_topics[1].qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	subs_topics[2].topic.utf8 = uplinkTopic;
+	subs_topics[2].topic.size = strlen(uplinkTopic);
+	subs_topics[2].qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	subs_list.list = subs_topics;
+	subs_list.list_count = ARRAY_SIZE(subs_topics);
+	subs_list.message_id = mqtt_window_next_id();
 	LOG_INF("Subscribing to %hu topic(s)", subs_list.list_count);
 
 	err = mqtt_subscribe(client, &subs_list);
 	if (err) {
-		LOG_ERR("Failed on topic %s", otaTopic);
+		LOG_ERR("Failed to subscribe: %d", err);
 	}
 }
 
-static int publish(struct mqtt_client *client, enum mqtt_qos qos, uint8_t topic[])
+static int publish(struct mqtt_client *client, enum mqtt_qos qos, uint8_t topic[],
+		   uint8_t *payload, size_t len)
 {
 	struct mqtt_publish_param param;
-	uint8_t payload[1280];
-	(void)snprintf(payload, sizeof(payload),
-		       "%f,%f,%f,",
-		       (double)sensorData[0], (double)sensorData[1], (double)sensorData[2]);
+
+	if (qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+		// held until PUBACK, resent with DUP if it doesn't come
+		return mqtt_window_publish(client, topic, payload, len);
+	}
 
 	param.message.topic.qos = qos;
 	param.message.topic.topic.utf8 = topic;
 	param.message.topic.topic.size =
 			strlen(param.message.topic.topic.utf8);
 	param.message.payload.data = payload;
-	param.message.payload.len =
-			strlen(param.message.payload.data);
-	param.message_id = 69;
+	param.message.payload.len = len;
+	param.message_id = mqtt_window_next_id();
 	param.dup_flag = 0U;
 	param.retain_flag = 0U;
 
 	return mqtt_publish(client, &param);
 }
 
+/*
+    PUBLISH framing around a QoS 1 payload, and the PUBACK that comes back
+*/
+static size_t publish_overhead(const uint8_t *topic, size_t len)
+{
+	size_t remaining = 2 + strlen(topic) + 2 + len;
+	size_t header = 1 + 1;
+
+	while (remaining >= 128) {
+		remaining >>= 7;
+		header++;
+	}
+
+	return header + 2 + strlen(topic) + 2 + 4;
+}
+
 static int publish_fw(struct mqtt_client *client, enum mqtt_qos qos, uint8_t topic[])
 {
-	struct mqtt_publish_param param;
-	uint8_t payload[1280];
-	(void)snprintf(payload, sizeof(payload),
+	uint8_t payload[16];
+	int len = snprintf(payload, sizeof(payload),
 		       "%d.%d",
 		       (int)SIMPLE_HTTP_OTA_MAJOR_VERSION, (int)SIMPLE_HTTP_OTA_MINOR_VERSION);
 
-	param.message.topic.qos = qos;
-	param.message.topic.topic.utf8 = topic;
-	param.message.topic.topic.size =
-			strlen(param.message.topic.topic.utf8);
-	param.message.payload.data = payload;
-	param.message.payload.len =
-			strlen(param.message.payload.data);
-	param.message_id = 69;
-	param.dup_flag = 0U;
-	param.retain_flag = 0U;
+	return publish(client, qos, topic, payload, len);
+}
 
-	return mqtt_publish(client, &param);
+/*
+    Forward OTA worker events as "event,bytes,total,rate,result,". QoS 0,
+    a lost progress report is superseded by the next one
+*/
+static void publish_ota_events(struct mqtt_client *client)
+{
+	struct ota_event evt;
+	uint8_t payload[64];
+	int len;
+	int rc;
+
+	while (simple_http_ota_get_event(&evt) == 0) {
+		len = snprintf(payload, sizeof(payload), "%s,%u,%u,%u,%d,",
+			       simple_http_ota_event_name(evt.type), evt.bytes,
+			       evt.total, evt.rate, evt.result);
+		rc = publish(client, MQTT_QOS_0_AT_MOST_ONCE, otaStatusTopic, payload, len);
+		if (rc != 0) {
+			PRINT_RESULT("mqtt_publish ota", rc);
+			break;
+		}
+	}
 }
 
 
+/*
+    Exponential back off with jitter, so units that lost the same AP don't
+    all come back at the same instant
+*/
+static int64_t backoff_delay(uint32_t attempt)
+{
+	uint32_t delay = APP_BACKOFF_MIN_MSECS << MIN(attempt, 16);
+
+	delay = MIN(delay, APP_BACKOFF_MAX_MSECS);
 
+	return delay / 2 + sys_rand32_get() % (delay / 2 + 1);
+}
 
+static void conn_lost(int64_t now)
+{
+	connStats.disconnects++;
+	disconnectedAt = now;
+	connAttempts = 0;
+	reconnectAt = now + backoff_delay(0);
+	connState = CONN_BACKOFF;
+	LOG_WRN("Broker connection lost, reconnecting in %lld ms", reconnectAt - now);
+}
 
+/*
+    Link changes come straight from the connectivity manager: a dead link
+    drops the broker session at once instead of at the next keepalive, a
+    new one is tried without waiting out the back off
+*/
+static void conn_link_changed(struct mqtt_client *client, int64_t now)
+{
+	linkReady = !linkReady;
+
+	if (linkReady) {
+		LOG_INF("Network up, connecting to the broker");
+		connAttempts = 0;
+		reconnectAt = now;
+	} else if (connState == CONN_CONNECTED) {
+		LOG_WRN("Network down, dropping the broker session");
+		mqtt_abort(client);
+	}
+}
 
-int thread_mqtt_entry(void) {
+static void wifi_changed(uint32_t events)
+{
+	mqtt_notify();
+}
 
-    int rc, val, timeout;
-	int ret;
-    //init client and broker
-	//k_msleep(25000);
-	while (!wifiConnected) {
-		//do nothing
-		k_msleep(1000);
+static struct wifi_listener wifiListener = {
+	.handler = wifi_changed,
+};
+
+/*
+    One reconnect attempt: resolve, connect, then restore the session.
+    Blocks for at most the DNS and CONNACK timeouts.
+*/
+static void conn_attempt(struct mqtt_client *client)
+{
+	int64_t now;
+	int64_t outage;
+	int rc;
+
+	connStats.attempts++;
+
+	connState = CONN_RESOLVING;
+	// cached, only waits on the resolver the first time or after a failed connect
+	rc = broker_init();
+	if (rc != 0) {
+		goto failed;
 	}
-	printk("==MQTT START==\r\n");
-	//printk("==FW Ver: %d.%d\r\n", SIMPLE_HTTP_OTA_MAJOR_VERSION, SIMPLE_HTTP_OTA_MINOR_VERSION);
-	//k_msleep(15000);
+
+	connState = CONN_CONNECTING;
+	// long enough to doze through SLEEP when the radio stays associated
+	client->keepalive = radio_keepalive();
+	rc = connect_to_broker(client);
+	if (rc != 0) {
 #if defined(CONFIG_DNS_RESOLVER)
-	rc = get_mqtt_broker_addrinfo();
-	if (rc) {
-		printk("Failed to resolve. Thread ended\r\n");
-		return 0;
-	}
+		// the broker may have moved while we were away
+		dns_cache_invalidate(SERVER_ADDR);
 #endif
+		goto failed;
+	}
 
-    mqtt_client_init(&client_ctx);
-    broker_init();
-
-    // password and user for tago dashbaord
-    struct mqtt_utf8 password;
-    struct mqtt_utf8 user;
-
-	password.utf8 = (uint8_t *)"260092b0-8ce9-45a0-9db2-402b4362e14c";
-	password.size = strlen("260092b0-8ce9-45a0-9db2-402b4362e14c");
-
-	user.utf8 = (uint8_t *)"Token";
-	user.size = strlen("Token");
-
-    /* MQTT client configuration */
-    client_ctx.broker = &broker;
-    client_ctx.evt_cb = mqtt_evt_handler;
-    client_ctx.client_id.utf8 = (uint8_t *) MQTT_CLIENT_ID;
-    client_ctx.client_id.size = sizeof(MQTT_CLIENT_ID) - 1;
-    client_ctx.password = &password;
-    client_ctx.user_name = &user;
-    client_ctx.protocol_version = MQTT_VERSION_3_1_1;
-    client_ctx.transport.type = MQTT_TRANSPORT_NON_SECURE;
-
-    /* MQTT buffers configuration */
-    client_ctx.rx_buf = rx_buf;
-    client_ctx.rx_buf_size = sizeof(rx_buf);
-    client_ctx.tx_buf = tx_buf;
-    client_ctx.tx_buf_size = sizeof(tx_buf);
-
-
-    // connect to broker - tago io
-	printk("Attempting to connect to MQTT Broker\r\n");
-	connect_to_broker(&client_ctx);
-	
-	subscribe_period(&client_ctx);
-	subscribe_ota(&client_ctx);
-    while (1) {
-		if (state == SLEEP) {
-			timeout = mqtt_keepalive_time_left(&client_ctx);
-			//printk("TIMEOUT: %d\r\n", timeout);
-			rc = zsock_poll(&fds[0], 1u, timeout);
-			if (rc >= 0) {
-				if (fds->revents & ZSOCK_POLLIN) {
-					rc = mqtt_input(&client_ctx);
-					if (rc != 0) {
-						LOG_ERR("Failed to read MQTT input: %d", rc);
-						
-					} 
-				} 
-				if (fds->revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR)) {
-					LOG_ERR("Socket closed/error");
-					
-				}
-				rc = mqtt_live(&client_ctx);
-				if ((rc != 0) && (rc != -EAGAIN)) {
-					LOG_ERR("Failed to live MQTT: %d", rc);
-					
-				}
-			} else {
-				LOG_ERR("poll failed: %d", rc);
-				
-			}
-		} else {
-			timeout = mqtt_keepalive_time_left(&client_ctx);
-			//printk("TIMEOUT: %d\r\n", timeout);
-			rc = zsock_poll(&fds[0], 1u, 1000);
-			if (rc >= 0) {
-				if (fds->revents & ZSOCK_POLLIN) {
-					rc = mqtt_input(&client_ctx);
-					if (rc != 0) {
-						LOG_ERR("Failed to read MQTT input: %d", rc);
-						
-					} 
-				} 
-				if (fds->revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR)) {
-					LOG_ERR("Socket closed/error");
-					
-				}
-				rc = mqtt_live(&client_ctx);
-				if ((rc != 0) && (rc != -EAGAIN)) {
-					LOG_ERR("Failed to live MQTT: %d", rc);
-					
-				}
-			} else {
-				LOG_ERR("poll failed: %d", rc);
-				
-			}
+	now = k_uptime_get();
+	connState = CONN_CONNECTED;
+	connAttempts = 0;
+	connStats.connects++;
+	if (connStats.connects > 1) {
+		outage = now - disconnectedAt;
+		connStats.lastOutageMs = outage;
+		connStats.maxOutageMs = MAX(connStats.maxOutageMs, outage);
+		connStats.totalOutageMs += outage;
+		LOG_INF("Reconnected after %lld ms (%u reconnects)", outage,
+			connStats.connects - 1);
+	} else {
+		LOG_INF("Broker connected %lld ms after boot", now);
+	}
+
+	if (!sessionPresent) {
+		subscribe_topics(client);
+	}
+	// whatever was in flight when the link dropped goes again, with DUP
+	mqtt_window_retransmit(client, true);
+	return;
+
+failed:
+	now = k_uptime_get();
+	reconnectAt = now + backoff_delay(++connAttempts);
+	connState = CONN_BACKOFF;
+	LOG_WRN("Connect attempt %u failed: %d, next in %lld ms", connAttempts, rc,
+		reconnectAt - now);
+}
+
+void mqtt_get_conn_stats(struct mqtt_conn_stats *stats)
+{
+	*stats = connStats;
+	stats->connected = (connState == CONN_CONNECTED);
+}
+
+/*
+    Producer -> MQTT thread wakeup. A socketpair lets the thread sleep in a
+    single zsock_poll() on the broker socket and the producers together.
+*/
+static void notify_init(void)
+{
+	if (zsock_socketpair(AF_UNIX, SOCK_STREAM, 0, notifyFds) != 0) {
+		LOG_ERR("socketpair failed: %d, polling every %d ms", errno, APP_RETRY_MSECS);
+		notifyFds[0] = notifyFds[1] = -1;
+	}
+
+	fds[FD_NOTIFY].fd = notifyFds[0];
+	fds[FD_NOTIFY].events = ZSOCK_POLLIN;
+}
 
+void mqtt_notify(void)
+{
+	uint8_t token = 1;
+
+	atomic_inc(&notifyCount);
+
+	// one byte in the pair at a time, it can never fill up
+	if (notifyFds[1] >= 0 && atomic_cas(&notifyPending, 0, 1)) {
+		zsock_send(notifyFds[1], &token, sizeof(token), ZSOCK_MSG_DONTWAIT);
+	}
+}
+
+static void notify_drain(void)
+{
+	uint8_t tokens[4];
+
+	// clear first: a notify racing this pass gets its own wakeup
+	atomic_set(&notifyPending, 0);
+	while (zsock_recv(notifyFds[0], tokens, sizeof(tokens), ZSOCK_MSG_DONTWAIT) > 0) {
+	}
+}
+
+
+/*
+    Earliest uptime (ms) poll has to return without being woken, and why:
+    the uplink thread's deadline or one of the protocol's own timers.
+*/
+static int64_t next_deadline(int64_t now, int64_t until, enum wake_deadline *why)
+{
+	int64_t deadline = until;
+	int64_t t;
+	int keepalive = mqtt_keepalive_time_left(&client_ctx);
+
+	*why = WAKE_CALLER;
 
+	if (connState != CONN_CONNECTED) {
+		// no broker without a network: wifi_changed() wakes us when it returns
+		if ((linkReady || notifyFds[0] < 0) && reconnectAt < deadline) {
+			deadline = reconnectAt;
+			*why = WAKE_RECONNECT;
 		}
-		//k_msleep(500);
-		if (flagOta) {
-			// initiate ota
-			ret = simple_http_ota_run();
-			k_msleep(100);
-			if (ret < 0) {
-				//ota failed: try again
-				flagOta = 1;
-			} else {
-				flagOta = 0;
-				sys_reboot(1);
-			}
-			
-			
+	} else {
+		if (keepalive >= 0 && now + keepalive < deadline) {
+			deadline = now + keepalive;
+			*why = WAKE_KEEPALIVE;
+		}
+
+		t = mqtt_window_next_deadline();
+		if (t < deadline) {
+			deadline = t;
+			*why = WAKE_RETRANSMIT;
+		}
+	}
+
+	if (notifyFds[0] < 0 && now + APP_RETRY_MSECS < deadline) {
+		// no socketpair: fall back to a fixed poll
+		deadline = now + APP_RETRY_MSECS;
+		*why = WAKE_RETRY;
+	}
+
+	return deadline;
+}
+
+static void count_timeout(enum wake_deadline why)
+{
+	switch (why) {
+	case WAKE_KEEPALIVE:
+		wakeups.keepalive++;
+		break;
+	case WAKE_RETRANSMIT:
+		wakeups.retransmit++;
+		break;
+	case WAKE_RETRY:
+		wakeups.retry++;
+		break;
+	case WAKE_RECONNECT:
+		wakeups.reconnect++;
+		break;
+	default:
+		break;
+	}
+}
+
+void mqtt_get_wakeup_stats(struct mqtt_wakeup_stats *stats)
+{
+	*stats = wakeups;
+	stats->notifies = atomic_get(&notifyCount);
+}
+
+
+static void mqtt_transport_init(void)
+{
+	printk("==MQTT START==\r\n");
+
+	mqtt_client_init(&client_ctx);
+
+	/* MQTT client configuration */
+	client_ctx.broker = &broker;
+	client_ctx.evt_cb = mqtt_evt_handler;
+	client_ctx.client_id.utf8 = (uint8_t *) MQTT_CLIENT_ID;
+	client_ctx.client_id.size = sizeof(MQTT_CLIENT_ID) - 1;
+	client_ctx.password = &password;
+	client_ctx.user_name = &user;
+	client_ctx.protocol_version = MQTT_VERSION_3_1_1;
+	client_ctx.transport.type = MQTT_TRANSPORT_NON_SECURE;
+	// keep subscriptions and queued QoS 1 messages across reconnects
+	client_ctx.clean_session = 0;
+
+	/* MQTT buffers configuration */
+	client_ctx.rx_buf = rx_buf;
+	client_ctx.rx_buf_size = sizeof(rx_buf);
+	client_ctx.tx_buf = tx_buf;
+	client_ctx.tx_buf_size = sizeof(tx_buf);
+
+	notify_init();
+	wifi_add_listener(&wifiListener);
+}
+
+static void mqtt_transport_connect(void)
+{
+	int64_t now = k_uptime_get();
+
+	if (wifi_is_ready() != linkReady) {
+		conn_link_changed(&client_ctx, now);
+	}
+	if (linkReady && connState != CONN_CONNECTED && now >= reconnectAt) {
+		// connect to broker - tago io
+		printk("Attempting to connect to MQTT Broker\r\n");
+		conn_attempt(&client_ctx);
+	}
+}
+
+/*
+    QoS 1: the window holds a copy until PUBACK, so a full window is the
+    only back pressure the uplink sees
+*/
+static int mqtt_transport_send(enum uplink_payload kind, const uint8_t *payload, size_t len)
+{
+	uint8_t *to = (kind == UPLINK_FLUX) ? fluxTopic : topic;
+	int rc;
+
+	if (connState != CONN_CONNECTED) {
+		return -ENOTCONN;
+	}
+	if (mqtt_window_full()) {
+		return -EBUSY;
+	}
+
+	rc = publish(&client_ctx, MQTT_QOS_1_AT_LEAST_ONCE, to, (uint8_t *)payload, len);
+	PRINT_RESULT("mqtt_publish", rc);
+	if (rc != 0) {
+		return rc;
+	}
+
+	wire.sends++;
+	wire.payloadBytes += len;
+	wire.overheadBytes += publish_overhead(to, len);
+
+	return 0;
+}
+
+static int mqtt_transport_poll(int64_t until)
+{
+	int64_t now = k_uptime_get();
+	int64_t deadline;
+	enum wake_deadline why;
+	int rc, timeout;
+
+	deadline = next_deadline(now, until, &why);
+	timeout = (deadline == INT64_MAX) ? -1 : (int)CLAMP(deadline - now, 0, INT_MAX);
+
+	rc = zsock_poll(fds, ARRAY_SIZE(fds), timeout);
+	if (rc < 0) {
+		LOG_ERR("poll failed: %d", errno);
+		k_msleep(APP_RETRY_MSECS);
+		return 1;
+	}
+
+	if (rc == 0) {
+		count_timeout(why);
+	}
+	if (fds[FD_NOTIFY].revents & ZSOCK_POLLIN) {
+		wakeups.notify++;
+		notify_drain();
+	}
+	if (fds[FD_SOCKET].revents & ZSOCK_POLLIN) {
+		wakeups.socket++;
+		rc = mqtt_input(&client_ctx);
+		if (rc != 0) {
+			LOG_ERR("Failed to read MQTT input: %d", rc);
+			mqtt_abort(&client_ctx);
 		}
-		if (sensorTransmit) {
-			rc = publish(&client_ctx, MQTT_QOS_1_AT_LEAST_ONCE, topic);
-			PRINT_RESULT("mqtt_publish", rc);
-			sensorTransmit = false;			
+	}
+	if (fds[FD_SOCKET].revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR | ZSOCK_POLLNVAL)) {
+		LOG_ERR("Socket closed/error");
+		mqtt_abort(&client_ctx);
+	}
+	if (connected) {
+		rc = mqtt_live(&client_ctx);
+		if ((rc != 0) && (rc != -EAGAIN)) {
+			LOG_ERR("Failed to live MQTT: %d", rc);
+			mqtt_abort(&client_ctx);
 		}
+	}
+	if (connState == CONN_CONNECTED && !connected) {
+		conn_lost(k_uptime_get());
+	}
+
+	if (connState == CONN_CONNECTED) {
+		publish_ota_events(&client_ctx);
+		mqtt_window_retransmit(&client_ctx, false);
+	}
+
+	return (k_uptime_get() >= until) ? 0 : 1;
+}
 
-		//k_msleep(1000);
+static void mqtt_transport_status(struct uplink_status *status)
+{
+	struct mqtt_window_stats window;
 
-    }
+	mqtt_window_get_stats(&window);
+	*status = wire;
+	status->connected = (connState == CONN_CONNECTED);
+	status->inFlight = window.inFlight;
+	status->connects = connStats.connects;
+}
 
-}
\ No newline at end of file
+static void mqtt_transport_report(void)
+{
+	struct mqtt_wakeup_stats wakeStats;
+	struct mqtt_conn_stats connReport;
+
+	mqtt_get_wakeup_stats(&wakeStats);
+	mqtt_get_conn_stats(&connReport);
+	LOG_INF("Wakeups: socket %u, notify %u (%u calls), keepalive %u, "
+		"retransmit %u, retry %u, reconnect %u",
+		wakeStats.socket, wakeStats.notify, wakeStats.notifies,
+		wakeStats.keepalive, wakeStats.retransmit, wakeStats.retry,
+		wakeStats.reconnect);
+	LOG_INF("Broker: %u connects, %u drops, %u attempts, "
+		"outage last %lld ms max %lld ms total %lld ms",
+		connReport.connects, connReport.disconnects, connReport.attempts,
+		connReport.lastOutageMs, connReport.maxOutageMs,
+		connReport.totalOutageMs);
+}
+
+const struct uplink_transport_api mqtt_transport = {
+	.name = "mqtt",
+	.encoding = UPLINK_ENCODING_BATCH,
+	.maxPayload = BATCH_MAX_BYTES,
+	.init = mqtt_transport_init,
+	.connect = mqtt_transport_connect,
+	.send = mqtt_transport_send,
+	.poll = mqtt_transport_poll,
+	.wake = mqtt_notify,
+	.status = mqtt_transport_status,
+	.report = mqtt_transport_report,
+};
@@ -10,11 +10,48 @@
 #ifndef MQTT_H
 #define MQTT_H
 
-int thread_mqtt_entry(void);
+#include <zephyr/kernel.h>
+
+struct mqtt_wakeup_stats {
+    uint32_t socket;        // broker traffic
+    uint32_t notify;        // mqtt_notify() from a producer
+    uint32_t keepalive;
+    uint32_t retransmit;    // in-flight publish due for a resend
+    uint32_t retry;         // fixed poll, no notify socketpair
+    uint32_t reconnect;     // broker reconnect back off elapsed
+    uint32_t notifies;      // mqtt_notify() calls, coalesced into the wakeups above
+};
+
+struct mqtt_conn_stats {
+    bool connected;
+    uint32_t connects;      // CONNACKs, the first one included
+    uint32_t disconnects;
+    uint32_t attempts;      // resolve + connect attempts
+    int64_t lastOutageMs;   // drop to CONNACK, time-to-reconnect
+    int64_t maxOutageMs;
+    int64_t totalOutageMs;
+};
+
+/*
+    Wake the uplink thread out of the MQTT poll, e.g. for an OTA event.
+    Cheap and non-blocking, calls made before the thread has handled the
+    last one are merged.
+*/
+void mqtt_notify(void);
+
+/*
+    Act on a period/, fota/ or uplink/ command. Also used by the MQTT-SN
+    transport, which maps its predefined topic IDs back to these names.
+*/
+void mqtt_command(const char *topic, char *payload, size_t len);
+
+void mqtt_get_wakeup_stats(struct mqtt_wakeup_stats *stats);
+void mqtt_get_conn_stats(struct mqtt_conn_stats *stats);
 
 struct fota_JSON {
     const char *unit;
     const char  *value;
+    const char  *sha256;    // hex digest of the image, optional
 };
 
 extern struct fota_JSON fotaResults;
@@ -0,0 +1,803 @@
+/**
+ ************************************************************************
+ * @file inc/mqtt_sn.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the MQTT-SN uplink transport
+ *
+ * A small MQTT-SN v1.2 client over UDP: predefined topic IDs only, QoS 1
+ * with one PUBLISH in flight, and a session that is kept at the gateway
+ * across reconnects so subscriptions are made once per boot. While the
+ * chamber sleeps the session is parked with a DISCONNECT carrying the
+ * sleep duration; the gateway buffers commands until the next CONNECT.
+ **********************************************************************
+ * */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/logging/log.h>
+#include "mqtt_sn.h"
+#include "mqtt.h"
+#include "uplink.h"
+#include "wifi.h"
+#include "dns_cache.h"
+#include "ota.h"
+
+LOG_MODULE_REGISTER(mqtt_sn);
+
+// message types, MQTT-SN v1.2
+#define SN_CONNECT          0x04
+#define SN_CONNACK          0x05
+#define SN_PUBLISH          0x0C
+#define SN_PUBACK           0x0D
+#define SN_SUBSCRIBE        0x12
+#define SN_SUBACK           0x13
+#define SN_PINGREQ          0x16
+#define SN_PINGRESP         0x17
+#define SN_DISCONNECT       0x18
+
+#define SN_FLAG_DUP         0x80
+#define SN_FLAG_QOS1        0x20
+#define SN_FLAG_QOS_MASK    0x60
+#define SN_TOPIC_PREDEFINED 0x01
+#define SN_TOPIC_TYPE_MASK  0x03
+#define SN_PROTOCOL_ID      0x01
+
+#define SN_RC_ACCEPTED      0x00
+#define SN_RC_CONGESTION    0x01
+#define SN_RC_INVALID_TOPIC 0x02
+
+// fds[] slots: gateway socket, then the uplink_notify() socketpair
+#define FD_SOCKET           0
+#define FD_NOTIFY           1
+
+// largest command accepted from the gateway, fota/ with a URL and a digest
+#define SN_COMMAND_MAX      512
+
+enum sn_state {
+    SN_DISCONNECTED,
+    SN_ACTIVE,
+    SN_ASLEEP,      // session parked at the gateway for a SLEEP
+};
+
+static const struct {
+    uint16_t id;
+    const char *name;
+} commandTopics[] = {
+    {MQTT_SN_TOPIC_PERIOD, "period/"},
+    {MQTT_SN_TOPIC_FOTA, "fota/"},
+    {MQTT_SN_TOPIC_UPLINK, "uplink/"},
+};
+
+static int sock = -1;
+static struct sockaddr_in gateway;
+static enum sn_state snState = SN_DISCONNECTED;
+static bool linkReady;
+static uint32_t connAttempts;
+static int64_t reconnectAt;
+static int64_t lastSentAt;
+static uint16_t lastId;
+
+// the one PUBLISH waiting for its PUBACK
+static struct {
+    bool busy;
+    uint16_t msgId;
+    uint8_t retries;
+    size_t flagsAt;         // offset of the flags byte, for DUP
+    size_t len;
+    int64_t resendAt;
+    uint8_t packet[MQTT_SN_PACKET_MAX];
+} pending;
+
+// PINGREQ waiting for its PINGRESP
+static bool pingOut;
+static uint8_t pingRetries;
+static int64_t pingAt;
+
+static uint8_t rx[MQTT_SN_PACKET_MAX];
+static char command[SN_COMMAND_MAX];
+
+static struct zsock_pollfd fds[2] = {
+    [FD_SOCKET] = {.fd = -1},
+    [FD_NOTIFY] = {.fd = -1},
+};
+static int notifyFds[2] = {-1, -1};
+static atomic_t notifyPending = ATOMIC_INIT(0);
+
+static struct uplink_status wire;
+static struct mqtt_sn_stats stats;
+
+/*
+    Length and type in front of a body of bodyLen bytes, the three byte
+    length form above 255. Returns the header length.
+*/
+static size_t sn_header(uint8_t *buf, size_t bodyLen, uint8_t type) {
+
+    if (bodyLen + 2 <= UINT8_MAX) {
+        buf[0] = bodyLen + 2;
+        buf[1] = type;
+        return 2;
+    }
+
+    buf[0] = 0x01;
+    sys_put_be16(bodyLen + 4, &buf[1]);
+    buf[3] = type;
+
+    return 4;
+}
+
+static int sn_parse(const uint8_t *buf, size_t n, uint8_t *type,
+                    const uint8_t **body, size_t *bodyLen) {
+
+    size_t total, hdr;
+
+    if (n < 2) {
+        return -EBADMSG;
+    }
+
+    if (buf[0] == 0x01) {
+        if (n < 4) {
+            return -EBADMSG;
+        }
+        total = sys_get_be16(&buf[1]);
+        hdr = 4;
+    } else {
+        total = buf[0];
+        hdr = 2;
+    }
+
+    if (total < hdr || total > n) {
+        return -EBADMSG;
+    }
+
+    *type = buf[hdr - 1];
+    *body = &buf[hdr];
+    *bodyLen = total - hdr;
+
+    return 0;
+}
+
+static uint16_t sn_next_id(void) {
+
+    if (++lastId == 0) {
+        lastId = 1;
+    }
+
+    return lastId;
+}
+
+/*
+    Everything but payloadLen bytes of it counts as protocol overhead
+*/
+static int sn_send(const uint8_t *buf, size_t len, size_t payloadLen) {
+
+    if (zsock_send(sock, buf, len, 0) < 0) {
+        return -errno;
+    }
+
+    wire.overheadBytes += len - payloadLen;
+    lastSentAt = k_uptime_get();
+
+    return 0;
+}
+
+static void sn_puback(uint16_t topicId, uint16_t msgId, uint8_t rc) {
+
+    uint8_t buf[7];
+    size_t pos = sn_header(buf, 5, SN_PUBACK);
+
+    sys_put_be16(topicId, &buf[pos]);
+    sys_put_be16(msgId, &buf[pos + 2]);
+    buf[pos + 4] = rc;
+
+    if (sn_send(buf, sizeof(buf), 0) != 0) {
+        LOG_ERR("PUBACK not sent");
+    }
+}
+
+static const char *sn_topic_name(uint8_t flags, uint16_t topicId) {
+
+    if ((flags & SN_TOPIC_TYPE_MASK) != SN_TOPIC_PREDEFINED) {
+        return NULL;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(commandTopics); i++) {
+        if (commandTopics[i].id == topicId) {
+            return commandTopics[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+static void sn_lost(int64_t now) {
+
+    stats.lost++;
+    snState = SN_DISCONNECTED;
+    pingOut = false;
+    connAttempts = 0;
+    reconnectAt = now + MQTT_SN_BACKOFF_MIN_MS;
+    LOG_WRN("Gateway not answering, reconnecting in %d ms", MQTT_SN_BACKOFF_MIN_MS);
+}
+
+/*
+    Anything the gateway sends unasked: commands, acknowledgements
+*/
+static void sn_handle(const uint8_t *buf, size_t n) {
+
+    const uint8_t *body;
+    const char *name;
+    size_t bodyLen, dataLen;
+    uint16_t topicId, msgId;
+    uint8_t type;
+
+    if (sn_parse(buf, n, &type, &body, &bodyLen) != 0) {
+        LOG_WRN("Malformed datagram, %u B", n);
+        return;
+    }
+
+    switch (type) {
+        case SN_PUBLISH:
+            if (bodyLen < 5) {
+                break;
+            }
+            topicId = sys_get_be16(&body[1]);
+            msgId = sys_get_be16(&body[3]);
+            name = sn_topic_name(body[0], topicId);
+            if ((body[0] & SN_FLAG_QOS_MASK) == SN_FLAG_QOS1) {
+                sn_puback(topicId, msgId, name ? SN_RC_ACCEPTED : SN_RC_INVALID_TOPIC);
+            }
+            if (!name) {
+                LOG_WRN("PUBLISH on unknown topic %u", topicId);
+                break;
+            }
+
+            dataLen = MIN(bodyLen - 5, sizeof(command) - 1);
+            memcpy(command, &body[5], dataLen);
+            command[dataLen] = '\0';
+            LOG_INF("RECEIVED on %s, %u B", name, dataLen);
+            mqtt_command(name, command, dataLen);
+            break;
+
+        case SN_PUBACK:
+            if (bodyLen < 5 || !pending.busy || sys_get_be16(&body[2]) != pending.msgId) {
+                break;
+            }
+            if (body[4] == SN_RC_CONGESTION) {
+                // the gateway wants us to slow down, same message later
+                pending.resendAt = k_uptime_get() + MQTT_SN_RETRY_MS;
+                break;
+            }
+            if (body[4] != SN_RC_ACCEPTED) {
+                LOG_ERR("PUBLISH %u rejected by the gateway: %u", pending.msgId, body[4]);
+                stats.rejected++;
+            }
+            pending.busy = false;
+            break;
+
+        case SN_PINGRESP:
+            pingOut = false;
+            break;
+
+        case SN_DISCONNECT:
+            if (snState == SN_ACTIVE) {
+                LOG_WRN("Gateway closed the session");
+                sn_lost(k_uptime_get());
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+    Wait up to timeoutMs for a message of type expect, handling whatever
+    else arrives meanwhile. *body points into rx.
+*/
+static int sn_receive(int timeoutMs, uint8_t expect, const uint8_t **body, size_t *bodyLen) {
+
+    int64_t deadline = k_uptime_get() + timeoutMs;
+    int64_t left;
+    uint8_t type;
+    ssize_t n;
+    int rc;
+
+    while ((left = deadline - k_uptime_get()) > 0) {
+        rc = zsock_poll(&fds[FD_SOCKET], 1, (int)left);
+        if (rc < 0) {
+            return -errno;
+        }
+        if (rc == 0) {
+            break;
+        }
+
+        n = zsock_recv(sock, rx, sizeof(rx), 0);
+        if (n < 0) {
+            return -errno;
+        }
+        wire.overheadBytes += n;
+
+        if (sn_parse(rx, n, &type, body, bodyLen) == 0 && type == expect) {
+            return 0;
+        }
+        sn_handle(rx, n);
+    }
+
+    return -ETIMEDOUT;
+}
+
+/*
+    Request and answer, resent every MQTT_SN_RETRY_MS up to MQTT_SN_RETRIES
+    times. Blocks.
+*/
+static int sn_exchange(const uint8_t *req, size_t len, uint8_t expect,
+                       const uint8_t **body, size_t *bodyLen) {
+
+    int rc = -ETIMEDOUT;
+
+    for (int attempt = 0; attempt < MQTT_SN_RETRIES; attempt++) {
+        rc = sn_send(req, len, 0);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = sn_receive(MQTT_SN_RETRY_MS, expect, body, bodyLen);
+        if (rc != -ETIMEDOUT) {
+            return rc;
+        }
+    }
+
+    return rc;
+}
+
+static int sn_open(void) {
+
+    int rc;
+
+    if (sock >= 0) {
+        return 0;
+    }
+
+    // cached, an address literal resolves without asking anyone
+    rc = dns_cache_lookup(MQTT_SN_GATEWAY_ADDR, MQTT_SN_GATEWAY_PORT, &gateway);
+    if (rc != 0) {
+        return rc;
+    }
+
+    sock = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -errno;
+    }
+
+    // connected, so send() and recv() only talk to the gateway
+    if (zsock_connect(sock, (struct sockaddr *)&gateway, sizeof(gateway)) < 0) {
+        rc = -errno;
+        zsock_close(sock);
+        sock = -1;
+        return rc;
+    }
+
+    fds[FD_SOCKET].fd = sock;
+    fds[FD_SOCKET].events = ZSOCK_POLLIN;
+
+    return 0;
+}
+
+static void sn_close(void) {
+
+    if (sock >= 0) {
+        zsock_close(sock);
+        sock = -1;
+    }
+    fds[FD_SOCKET].fd = -1;
+}
+
+static int sn_subscribe(uint16_t topicId) {
+
+    uint8_t req[7];
+    const uint8_t *body;
+    size_t bodyLen;
+    size_t pos = sn_header(req, 5, SN_SUBSCRIBE);
+    uint16_t msgId = sn_next_id();
+    int rc;
+
+    req[pos] = SN_FLAG_QOS1 | SN_TOPIC_PREDEFINED;
+    sys_put_be16(msgId, &req[pos + 1]);
+    sys_put_be16(topicId, &req[pos + 3]);
+
+    rc = sn_exchange(req, sizeof(req), SN_SUBACK, &body, &bodyLen);
+    if (rc != 0) {
+        return rc;
+    }
+    if (bodyLen < 6 || sys_get_be16(&body[3]) != msgId || body[5] != SN_RC_ACCEPTED) {
+        return -EACCES;
+    }
+
+    return 0;
+}
+
+/*
+    Exponential back off with jitter, as for the broker
+*/
+static int64_t sn_backoff_delay(uint32_t attempt) {
+
+    uint32_t delay = MQTT_SN_BACKOFF_MIN_MS << MIN(attempt, 16);
+
+    delay = MIN(delay, MQTT_SN_BACKOFF_MAX_MS);
+
+    return delay / 2 + sys_rand32_get() % (delay / 2 + 1);
+}
+
+/*
+    One CONNECT and the subscriptions. Blocks for at most the retries of
+    each exchange.
+*/
+static void sn_connect_attempt(void) {
+
+    uint8_t req[6 + sizeof(MQTT_SN_CLIENT_ID) - 1];
+    const uint8_t *body;
+    size_t bodyLen;
+    size_t pos;
+    int64_t startedAt = k_uptime_get();
+    uint32_t bytesBefore = wire.overheadBytes;
+    int rc;
+
+    stats.attempts++;
+
+    rc = sn_open();
+    if (rc != 0) {
+        goto failed;
+    }
+
+    pos = sn_header(req, sizeof(req) - 2, SN_CONNECT);
+    // no CleanSession: the gateway keeps commands queued while we sleep
+    req[pos] = 0;
+    req[pos + 1] = SN_PROTOCOL_ID;
+    sys_put_be16(MQTT_SN_KEEPALIVE_S, &req[pos + 2]);
+    memcpy(&req[pos + 4], MQTT_SN_CLIENT_ID, sizeof(MQTT_SN_CLIENT_ID) - 1);
+
+    rc = sn_exchange(req, sizeof(req), SN_CONNACK, &body, &bodyLen);
+    if (rc == 0 && (bodyLen < 1 || body[0] != SN_RC_ACCEPTED)) {
+        rc = -ECONNREFUSED;
+    }
+    if (rc != 0) {
+        // the gateway may have moved while we were away
+        dns_cache_invalidate(MQTT_SN_GATEWAY_ADDR);
+        sn_close();
+        goto failed;
+    }
+
+    snState = SN_ACTIVE;
+    connAttempts = 0;
+    pingOut = false;
+    stats.connects++;
+    stats.lastConnectMs = k_uptime_get() - startedAt;
+    LOG_INF("Gateway connected in %u ms", stats.lastConnectMs);
+
+    // CONNACK says nothing of whether the gateway still has the session,
+    // so every CONNECT subscribes again; a repeat SUBSCRIBE is harmless
+    for (int i = 0; i < ARRAY_SIZE(commandTopics); i++) {
+        rc = sn_subscribe(commandTopics[i].id);
+        if (rc != 0) {
+            LOG_WRN("Subscribe to %s failed: %d", commandTopics[i].name, rc);
+        }
+    }
+
+    // whatever was in flight when the gateway went quiet goes again, with DUP
+    if (pending.busy) {
+        pending.retries = 0;
+        pending.resendAt = k_uptime_get();
+    }
+    stats.connectBytes += wire.overheadBytes - bytesBefore;
+    return;
+
+failed:
+    stats.connectBytes += wire.overheadBytes - bytesBefore;
+    reconnectAt = k_uptime_get() + sn_backoff_delay(++connAttempts);
+    LOG_WRN("Gateway connect attempt %u failed: %d, next in %lld ms", connAttempts, rc,
+            reconnectAt - k_uptime_get());
+}
+
+/*
+    Resends and keepalive, on the poll after their deadline
+*/
+static void sn_timers(int64_t now) {
+
+    uint8_t ping[2];
+
+    if (snState != SN_ACTIVE) {
+        return;
+    }
+
+    if (pending.busy && now >= pending.resendAt) {
+        if (pending.retries >= MQTT_SN_RETRIES) {
+            sn_lost(now);
+            return;
+        }
+        pending.packet[pending.flagsAt] |= SN_FLAG_DUP;
+        if (sn_send(pending.packet, pending.len, 0) == 0) {
+            stats.retransmits++;
+        }
+        pending.retries++;
+        pending.resendAt = now + MQTT_SN_RETRY_MS;
+    }
+
+    if (pingOut && now >= pingAt + MQTT_SN_RETRY_MS) {
+        if (++pingRetries >= MQTT_SN_RETRIES) {
+            sn_lost(now);
+            return;
+        }
+    } else if (pingOut || now < lastSentAt + MQTT_SN_KEEPALIVE_S * MSEC_PER_SEC) {
+        return;
+    } else {
+        pingOut = true;
+        pingRetries = 0;
+        stats.pings++;
+    }
+
+    sn_header(ping, 0, SN_PINGREQ);
+    sn_send(ping, sizeof(ping), 0);
+    pingAt = now;
+}
+
+static int64_t sn_next_deadline(int64_t now, int64_t until) {
+
+    int64_t deadline = until;
+
+    if (snState == SN_ACTIVE) {
+        deadline = MIN(deadline, pingOut ? pingAt + MQTT_SN_RETRY_MS :
+                       lastSentAt + MQTT_SN_KEEPALIVE_S * MSEC_PER_SEC);
+        if (pending.busy) {
+            deadline = MIN(deadline, pending.resendAt);
+        }
+    } else if (snState == SN_DISCONNECTED && linkReady) {
+        deadline = MIN(deadline, reconnectAt);
+    }
+
+    if (notifyFds[0] < 0) {
+        // no socketpair: fall back to a fixed poll
+        deadline = MIN(deadline, now + MQTT_SN_RETRY_MS);
+    }
+
+    return deadline;
+}
+
+static void sn_notify(void) {
+
+    uint8_t token = 1;
+
+    // one byte in the pair at a time, it can never fill up
+    if (notifyFds[1] >= 0 && atomic_cas(&notifyPending, 0, 1)) {
+        zsock_send(notifyFds[1], &token, sizeof(token), ZSOCK_MSG_DONTWAIT);
+    }
+}
+
+static void sn_wifi_changed(uint32_t events) {
+
+    sn_notify();
+}
+
+static struct wifi_listener wifiListener = {
+    .handler = sn_wifi_changed,
+};
+
+static void mqtt_sn_init(void) {
+
+    if (zsock_socketpair(AF_UNIX, SOCK_STREAM, 0, notifyFds) != 0) {
+        LOG_ERR("socketpair failed: %d, polling every %d ms", errno, MQTT_SN_RETRY_MS);
+        notifyFds[0] = notifyFds[1] = -1;
+    }
+    fds[FD_NOTIFY].fd = notifyFds[0];
+    fds[FD_NOTIFY].events = ZSOCK_POLLIN;
+
+    wifi_add_listener(&wifiListener);
+    LOG_INF("MQTT-SN gateway %s:%d", MQTT_SN_GATEWAY_ADDR, MQTT_SN_GATEWAY_PORT);
+}
+
+static void mqtt_sn_connect(void) {
+
+    int64_t now = k_uptime_get();
+
+    if (wifi_is_ready() != linkReady) {
+        linkReady = !linkReady;
+        if (linkReady) {
+            connAttempts = 0;
+            reconnectAt = now;
+        } else if (snState == SN_ACTIVE) {
+            // nothing to tear down over UDP, the gateway keeps the session
+            LOG_WRN("Network down, gateway session idle");
+            snState = SN_DISCONNECTED;
+        }
+    }
+
+    if (linkReady && snState == SN_DISCONNECTED && now >= reconnectAt) {
+        sn_connect_attempt();
+    }
+}
+
+static int mqtt_sn_send(enum uplink_payload kind, const uint8_t *payload, size_t len) {
+
+    uint16_t topicId = (kind == UPLINK_FLUX) ? MQTT_SN_TOPIC_FLUX : MQTT_SN_TOPIC_SENSOR;
+    size_t pos;
+    int rc;
+
+    if (snState != SN_ACTIVE) {
+        return -ENOTCONN;
+    }
+    // one QoS 1 PUBLISH outstanding at a time
+    if (pending.busy) {
+        return -EBUSY;
+    }
+    if (len > MQTT_SN_PAYLOAD_MAX) {
+        return -EBADMSG;
+    }
+
+    pos = sn_header(pending.packet, len + 5, SN_PUBLISH);
+    pending.flagsAt = pos;
+    pending.msgId = sn_next_id();
+    pending.packet[pos] = SN_FLAG_QOS1 | SN_TOPIC_PREDEFINED;
+    sys_put_be16(topicId, &pending.packet[pos + 1]);
+    sys_put_be16(pending.msgId, &pending.packet[pos + 3]);
+    memcpy(&pending.packet[pos + 5], payload, len);
+    pending.len = pos + 5 + len;
+
+    rc = sn_send(pending.packet, pending.len, len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    pending.busy = true;
+    pending.retries = 0;
+    pending.resendAt = k_uptime_get() + MQTT_SN_RETRY_MS;
+    wire.sends++;
+    wire.payloadBytes += len;
+
+    return 0;
+}
+
+/*
+    Forward OTA worker events as "event,bytes,total,rate,result,", the same
+    as over MQTT. QoS 0, a lost progress report is superseded by the next one
+*/
+static void sn_publish_ota_events(void) {
+
+    struct ota_event evt;
+    char text[64];
+    uint8_t buf[7 + sizeof(text)];
+    size_t pos;
+    int len;
+
+    while (simple_http_ota_get_event(&evt) == 0) {
+        len = snprintf(text, sizeof(text), "%s,%u,%u,%u,%d,",
+                       simple_http_ota_event_name(evt.type), evt.bytes,
+                       evt.total, evt.rate, evt.result);
+        len = MIN(len, sizeof(text) - 1);
+
+        pos = sn_header(buf, len + 5, SN_PUBLISH);
+        buf[pos] = SN_TOPIC_PREDEFINED;
+        sys_put_be16(MQTT_SN_TOPIC_OTA_STATUS, &buf[pos + 1]);
+        sys_put_be16(0, &buf[pos + 3]);
+        memcpy(&buf[pos + 5], text, len);
+        if (sn_send(buf, pos + 5 + len, 0) != 0) {
+            LOG_WRN("OTA event not sent");
+            break;
+        }
+    }
+}
+
+static int mqtt_sn_poll(int64_t until) {
+
+    int64_t now = k_uptime_get();
+    int64_t deadline = sn_next_deadline(now, until);
+    int timeout = (deadline == INT64_MAX) ? -1 : (int)CLAMP(deadline - now, 0, INT_MAX);
+    uint8_t tokens[4];
+    ssize_t n;
+    int rc;
+
+    rc = zsock_poll(fds, ARRAY_SIZE(fds), timeout);
+    if (rc < 0) {
+        LOG_ERR("poll failed: %d", errno);
+        k_msleep(MQTT_SN_RETRY_MS);
+        return 1;
+    }
+
+    if (fds[FD_NOTIFY].revents & ZSOCK_POLLIN) {
+        // clear first: a notify racing this pass gets its own wakeup
+        atomic_set(&notifyPending, 0);
+        while (zsock_recv(notifyFds[0], tokens, sizeof(tokens), ZSOCK_MSG_DONTWAIT) > 0) {
+        }
+    }
+    if (fds[FD_SOCKET].revents & ZSOCK_POLLIN) {
+        while ((n = zsock_recv(sock, rx, sizeof(rx), ZSOCK_MSG_DONTWAIT)) > 0) {
+            wire.overheadBytes += n;
+            sn_handle(rx, n);
+        }
+    }
+
+    sn_timers(k_uptime_get());
+    if (snState == SN_ACTIVE) {
+        sn_publish_ota_events();
+    }
+
+    return (k_uptime_get() >= until) ? 0 : 1;
+}
+
+/*
+    Park the session for a SLEEP: the gateway holds commands for us and
+    expects no keepalive until then. Waking only has to CONNECT again.
+*/
+static void mqtt_sn_sleep(int64_t durationMs) {
+
+    uint8_t req[4];
+    const uint8_t *body;
+    size_t bodyLen;
+    uint16_t seconds;
+    size_t pos;
+
+    if (durationMs == 0) {
+        if (snState == SN_ASLEEP) {
+            snState = SN_DISCONNECTED;
+            connAttempts = 0;
+            reconnectAt = k_uptime_get();
+        }
+        return;
+    }
+
+    seconds = MIN(durationMs / MSEC_PER_SEC + MQTT_SN_SLEEP_SLACK_S, UINT16_MAX);
+    if (snState == SN_ACTIVE) {
+        pos = sn_header(req, 2, SN_DISCONNECT);
+        sys_put_be16(seconds, &req[pos]);
+        if (sn_exchange(req, sizeof(req), SN_DISCONNECT, &body, &bodyLen) != 0) {
+            LOG_WRN("Gateway did not confirm the sleep");
+        }
+    }
+
+    snState = SN_ASLEEP;
+    pingOut = false;
+    stats.sleeps++;
+    LOG_INF("Session parked for %u s", seconds);
+}
+
+static void mqtt_sn_status(struct uplink_status *status) {
+
+    *status = wire;
+    status->connected = (snState == SN_ACTIVE);
+    status->inFlight = pending.busy;
+    status->connects = stats.connects;
+}
+
+static void mqtt_sn_report(void) {
+
+    LOG_INF("MQTT-SN: %u connects (%u attempts, last %u ms, %u B per connect), %u lost, "
+            "%u retransmits, %u rejected, %u sleeps, %u pings",
+            stats.connects, stats.attempts, stats.lastConnectMs,
+            stats.attempts ? stats.connectBytes / stats.attempts : 0, stats.lost,
+            stats.retransmits, stats.rejected, stats.sleeps, stats.pings);
+}
+
+void mqtt_sn_get_stats(struct mqtt_sn_stats *out) {
+
+    *out = stats;
+}
+
+const struct uplink_transport_api mqtt_sn_transport = {
+    .name = "mqtt-sn",
+    .encoding = UPLINK_ENCODING_BATCH,
+    .maxPayload = MQTT_SN_PAYLOAD_MAX,
+    .init = mqtt_sn_init,
+    .connect = mqtt_sn_connect,
+    .send = mqtt_sn_send,
+    .poll = mqtt_sn_poll,
+    .wake = sn_notify,
+    .status = mqtt_sn_status,
+    .report = mqtt_sn_report,
+    .sleep = mqtt_sn_sleep,
+};
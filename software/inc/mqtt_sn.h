@@ -0,0 +1,58 @@
+/**
+ ************************************************************************
+ * @file inc/mqtt_sn.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the MQTT-SN uplink transport
+ **********************************************************************
+ * */
+
+#ifndef MQTT_SN_H
+#define MQTT_SN_H
+
+#include <zephyr/kernel.h>
+#include "batch.h"
+
+// site gateway: tools/mqttsn_gateway.py, or the Paho MQTT-SN gateway in front of TagoIO
+#define MQTT_SN_GATEWAY_ADDR        "192.168.1.50"
+#define MQTT_SN_GATEWAY_PORT        10000
+#define MQTT_SN_CLIENT_ID           "soil_resp"
+
+// CONNECT keepalive (s), a PINGREQ goes out after this long without traffic
+#define MQTT_SN_KEEPALIVE_S         300
+// Tretry and Nretry of the spec: resend an unanswered message, give up after
+#define MQTT_SN_RETRY_MS            2000
+#define MQTT_SN_RETRIES             3
+// reconnect back off, doubled per failed attempt up to the max
+#define MQTT_SN_BACKOFF_MIN_MS      1000
+#define MQTT_SN_BACKOFF_MAX_MS      (5 * 60 * MSEC_PER_SEC)
+// asked for on top of the SLEEP when parking the session, covers the reconnect
+#define MQTT_SN_SLEEP_SLACK_S       60
+
+// largest PUBLISH data; over 255 B the long length form is used, still one datagram
+#define MQTT_SN_PAYLOAD_MAX         BATCH_MAX_BYTES
+#define MQTT_SN_PACKET_MAX          (MQTT_SN_PAYLOAD_MAX + 9)
+
+// predefined topic IDs, the gateway has to map them to the same names
+#define MQTT_SN_TOPIC_SENSOR        1   // sensor/, or BATCH_CBOR_TOPIC
+#define MQTT_SN_TOPIC_FLUX          2   // flux/
+#define MQTT_SN_TOPIC_PERIOD        3   // period/
+#define MQTT_SN_TOPIC_FOTA          4   // fota/
+#define MQTT_SN_TOPIC_UPLINK        5   // uplink/
+#define MQTT_SN_TOPIC_OTA_STATUS    6   // ota/status/
+
+struct mqtt_sn_stats {
+    uint32_t attempts;      // CONNECTs sent, retries excluded
+    uint32_t connects;      // CONNACKs accepted
+    uint32_t lost;          // gateway stopped answering
+    uint32_t retransmits;   // PUBLISH resent with DUP
+    uint32_t rejected;      // PUBACK with an error code, data lost
+    uint32_t sleeps;        // sessions parked for a SLEEP
+    uint32_t pings;
+    uint32_t connectBytes;  // on the wire for connects, both ways, every attempt
+    uint32_t lastConnectMs; // CONNECT to CONNACK
+};
+
+void mqtt_sn_get_stats(struct mqtt_sn_stats *stats);
+
+#endif
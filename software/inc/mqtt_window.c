@@ -0,0 +1,166 @@
+/**
+ ************************************************************************
+ * @file inc/mqtt_window.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the QoS 1 in-flight publish window
+ *
+ * Only used from the MQTT thread (publish calls and the event handler run
+ * inside mqtt_input), so there is no locking.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/logging/log.h>
+#include "mqtt_window.h"
+
+LOG_MODULE_DECLARE(net_mqtt_publisher, LOG_LEVEL_DBG);
+
+struct mqtt_window_entry {
+    bool used;
+    uint16_t messageId;
+    int64_t sentAt;
+    uint8_t *topic;
+    size_t len;
+    uint8_t payload[MQTT_WINDOW_PAYLOAD_MAX];
+};
+
+static struct mqtt_window_entry window[MQTT_WINDOW_SIZE];
+static struct mqtt_window_stats stats;
+static uint16_t lastId;
+
+
+static struct mqtt_window_entry *find(uint16_t messageId) {
+
+    for (size_t i = 0; i < ARRAY_SIZE(window); i++) {
+        if (window[i].used && window[i].messageId == messageId) {
+            return &window[i];
+        }
+    }
+
+    return NULL;
+}
+
+uint16_t mqtt_window_next_id(void) {
+
+    // 0 is not a valid packet identifier, skip ids still in flight
+    do {
+        lastId++;
+    } while (lastId == 0 || find(lastId) != NULL);
+
+    return lastId;
+}
+
+static int window_send(struct mqtt_client *client, struct mqtt_window_entry *entry, bool dup) {
+
+    struct mqtt_publish_param param;
+
+    param.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE;
+    param.message.topic.topic.utf8 = entry->topic;
+    param.message.topic.topic.size = strlen(entry->topic);
+    param.message.payload.data = entry->payload;
+    param.message.payload.len = entry->len;
+    param.message_id = entry->messageId;
+    param.dup_flag = dup ? 1U : 0U;
+    param.retain_flag = 0U;
+
+    entry->sentAt = k_uptime_get();
+
+    return mqtt_publish(client, &param);
+}
+
+int mqtt_window_publish(struct mqtt_client *client, uint8_t *topic,
+                        const uint8_t *payload, size_t len) {
+
+    struct mqtt_window_entry *entry = NULL;
+    int rc;
+
+    if (len > MQTT_WINDOW_PAYLOAD_MAX) {
+        return -EMSGSIZE;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(window); i++) {
+        if (!window[i].used) {
+            entry = &window[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        return -EBUSY;
+    }
+
+    entry->messageId = mqtt_window_next_id();
+    entry->topic = topic;
+    entry->len = len;
+    memcpy(entry->payload, payload, len);
+
+    rc = window_send(client, entry, false);
+    if (rc != 0) {
+        return rc;
+    }
+
+    entry->used = true;
+    stats.inFlight++;
+    stats.published++;
+
+    return 0;
+}
+
+bool mqtt_window_full(void) {
+
+    return stats.inFlight >= MQTT_WINDOW_SIZE;
+}
+
+void mqtt_window_ack(uint16_t messageId) {
+
+    struct mqtt_window_entry *entry = find(messageId);
+
+    if (entry == NULL) {
+        LOG_WRN("PUBACK for unknown packet id %u", messageId);
+        return;
+    }
+
+    entry->used = false;
+    stats.inFlight--;
+    stats.acked++;
+}
+
+void mqtt_window_retransmit(struct mqtt_client *client, bool all) {
+
+    int64_t now = k_uptime_get();
+    int rc;
+
+    for (size_t i = 0; i < ARRAY_SIZE(window); i++) {
+        if (!window[i].used ||
+            (!all && now - window[i].sentAt < MQTT_WINDOW_RETRY_MS)) {
+            continue;
+        }
+
+        rc = window_send(client, &window[i], true);
+        LOG_INF("Retransmit packet id %u: %d", window[i].messageId, rc);
+        if (rc != 0) {
+            // socket gone - leave the rest for the next pass
+            break;
+        }
+        stats.retransmits++;
+    }
+}
+
+int64_t mqtt_window_next_deadline(void) {
+
+    int64_t deadline = INT64_MAX;
+
+    for (size_t i = 0; i < ARRAY_SIZE(window); i++) {
+        if (window[i].used) {
+            deadline = MIN(deadline, window[i].sentAt + MQTT_WINDOW_RETRY_MS);
+        }
+    }
+
+    return deadline;
+}
+
+void mqtt_window_get_stats(struct mqtt_window_stats *out) {
+
+    *out = stats;
+}
@@ -0,0 +1,54 @@
+/**
+ ************************************************************************
+ * @file inc/mqtt_window.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the QoS 1 in-flight publish window
+ **********************************************************************
+ * */
+
+#ifndef MQTT_WINDOW_H
+#define MQTT_WINDOW_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/mqtt.h>
+#include "batch.h"
+
+// unacknowledged publishes allowed at once
+#define MQTT_WINDOW_SIZE            4
+#define MQTT_WINDOW_PAYLOAD_MAX     BATCH_MAX_BYTES
+// resend with DUP if no PUBACK within this time
+#define MQTT_WINDOW_RETRY_MS        10000
+
+struct mqtt_window_stats {
+    uint32_t inFlight;
+    uint32_t published;
+    uint32_t acked;
+    uint32_t retransmits;
+};
+
+// next free packet identifier, also for SUBSCRIBE
+uint16_t mqtt_window_next_id(void);
+
+/*
+    Copy the payload into a free slot and publish it at QoS 1. The caller
+    may reuse its buffer straight away. Returns -EBUSY when the window is
+    full, or the mqtt_publish() error (the slot is freed again).
+*/
+int mqtt_window_publish(struct mqtt_client *client, uint8_t *topic,
+                        const uint8_t *payload, size_t len);
+
+bool mqtt_window_full(void);
+
+// MQTT_EVT_PUBACK: free the matching slot
+void mqtt_window_ack(uint16_t messageId);
+
+// resend everything older than MQTT_WINDOW_RETRY_MS, or everything if all
+void mqtt_window_retransmit(struct mqtt_client *client, bool all);
+
+// uptime (ms) of the next retransmission, INT64_MAX if nothing in flight
+int64_t mqtt_window_next_deadline(void);
+
+void mqtt_window_get_stats(struct mqtt_window_stats *stats);
+
+#endif
@@ -18,22 +18,37 @@
 #include <zephyr/storage/flash_map.h>
 #include <zephyr/dfu/mcuboot.h>
 #include <zephyr/dfu/flash_img.h>
+#include <zephyr/storage/stream_flash.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/net/http/client.h>
 #include <zephyr/net/http/parser_url.h>
 #include <zephyr/sys/reboot.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <mbedtls/sha256.h>
 
 #include <zephyr/logging/log.h>
-#include "mqtt.h"
+#include "ota.h"
+#include "ota_delta.h"
+#include "ota_lzss.h"
+#include "uplink.h"
+#include "wifi.h"
 LOG_MODULE_REGISTER(simple_http_ota);
 
 #define SLOT_SIZE1 FLASH_AREA_SIZE(image_1)
-#define MAX_RECV_BUF_LEN 512
 #define HOST "172.20.10.4"
 #define CONFIG_SIMPLE_HTTP_OTA_FILE_URL "http://172.20.10.4/zephyr.signed.bin"
 #define CONFIG_SIMPLE_HTTP_OTA_DOWNLOAD_TIMEOUT 30
 
 #define HTTP_TIMEOUT (CONFIG_SIMPLE_HTTP_OTA_DOWNLOAD_TIMEOUT * MSEC_PER_SEC)
 
+/* A broken download resumes from the last whole flash page written: with
+ * CONFIG_IMG_ERASE_PROGRESSIVELY the first write into a page erases all of it */
+#define OTA_RESUME_ALIGN 4096
+/* how often the resume point is saved while downloading */
+#define OTA_RESUME_SAVE_BYTES (16 * 1024)
+#define OTA_HOST_MAX 64
+
 /* Copy URL locally so we can parse it */
 static char download_url[] = CONFIG_SIMPLE_HTTP_OTA_FILE_URL;
 
@@ -42,16 +57,309 @@ static char download_url[] = CONFIG_SIMPLE_HTTP_OTA_FILE_URL;
 enum simple_http_ota_response {
 	SIMPLE_HTTP_OTA_OK,
 	SIMPLE_HTTP_OTA_ERROR,
+	SIMPLE_HTTP_OTA_NOT_FOUND,	/* 404 for a patch or compressed image */
+};
+
+/* What the body is, tried in this order until the server has one */
+enum ota_mode {
+	OTA_MODE_DELTA,		/* patch against the running image */
+	OTA_MODE_COMPRESSED,	/* heatshrink compressed image */
+	OTA_MODE_FULL,		/* zephyr.signed.bin as is, the only resumable one */
 };
 
 static struct simple_http_ota_context {
 	int sock;
 	struct flash_img_context flash_ctx;
-	uint8_t recv_buf[MAX_RECV_BUF_LEN];
+	uint8_t recv_buf[OTA_RECV_BUF_SIZE];
 	enum simple_http_ota_response status;
 	size_t content_length;
+	size_t offset;		/* image offset this request started at */
+	size_t saved;		/* resume point last persisted */
+	size_t reported;	/* image bytes at the last progress event */
+	int64_t started;	/* k_uptime_get() when this attempt began */
+	int64_t stalled;	/* ms the receive path waited for a free buffer */
+	mbedtls_sha256_context sha;	/* over every image byte written so far */
+	enum ota_mode mode;
+	size_t received;	/* body bytes of this attempt, as sent */
 } ota_context;
 
+/*
+ * Double buffer between the HTTP receive path and the flash writer: the
+ * worker fills one buffer while the flash queue writes out the other.
+ */
+struct ota_buf {
+	struct k_work work;
+	size_t len;
+	uint8_t data[OTA_WRITE_BUF_SIZE];
+};
+
+K_THREAD_STACK_DEFINE(ota_flash_stack, OTA_FLASH_STACK_SIZE);
+static struct k_work_q ota_flash_queue;
+static struct ota_buf ota_bufs[2];
+static struct ota_buf *ota_fill;
+static uint8_t ota_next;
+static K_SEM_DEFINE(ota_buf_free, ARRAY_SIZE(ota_bufs), ARRAY_SIZE(ota_bufs));
+static atomic_t ota_write_error;
+
+/* Worker requests and progress reporting */
+static K_SEM_DEFINE(ota_request_sem, 0, 1);
+static atomic_t ota_busy;
+static char ota_host[OTA_HOST_MAX];
+static uint8_t ota_digest[OTA_SHA256_LEN];
+static bool ota_verify;
+
+/* Delta updates: patch decoder and the running image it copies from */
+static struct ota_delta ota_patch;
+static const struct flash_area *ota_base;
+/* Compressed images */
+static struct ota_lzss ota_unpack;
+/* BIT(enum ota_mode) for formats this request won't ask for again */
+static uint8_t ota_skip;
+K_MSGQ_DEFINE(ota_events, sizeof(struct ota_event), OTA_EVENT_QUEUE_LEN, 4);
+
+/* Persisted as "ota/resume", survives a reboot mid-download */
+static struct simple_http_ota_resume {
+	uint32_t offset;	/* image bytes safely in slot 1 */
+	uint32_t total;		/* full image size */
+	char host[OTA_HOST_MAX];
+	uint8_t sha256[OTA_SHA256_LEN];	/* expected digest, if verify */
+	uint8_t verify;
+} resume;
+
+static int ota_settings_set(const char *name, size_t len,
+			    settings_read_cb read_cb, void *cb_arg)
+{
+	if (!settings_name_steq(name, "resume", NULL)) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(resume) ||
+	    read_cb(cb_arg, &resume, sizeof(resume)) != sizeof(resume)) {
+		memset(&resume, 0, sizeof(resume));
+		return -EINVAL;
+	}
+	resume.host[OTA_HOST_MAX - 1] = '\0';
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(simple_http_ota, "ota", NULL, ota_settings_set, NULL, NULL);
+
+static void resume_save(void)
+{
+	int ret = settings_save_one("ota/resume", &resume, sizeof(resume));
+
+	if (ret) {
+		LOG_WRN("Could not save OTA resume point (%d)", ret);
+	}
+}
+
+static void resume_clear(void)
+{
+	memset(&resume, 0, sizeof(resume));
+	settings_delete("ota/resume");
+}
+
+/* Restart the slot 1 writer at an image offset, offset must be page aligned */
+static int ota_flash_seek(size_t offset)
+{
+	struct flash_img_context *img = &ota_context.flash_ctx;
+	int ret;
+
+	ret = flash_img_init(img);
+	if (ret || offset == 0) {
+		return ret;
+	}
+
+	return stream_flash_init(&img->stream, flash_area_get_device(img->flash_area),
+				 img->buf, sizeof(img->buf),
+				 img->flash_area->fa_off + offset,
+				 img->flash_area->fa_size - offset, NULL);
+}
+
+/* Image bytes that are in flash, not just in the write buffer */
+static size_t ota_image_bytes(void)
+{
+	return ota_context.offset + flash_img_bytes_written(&ota_context.flash_ctx);
+}
+
+static void ota_save_progress(void)
+{
+	size_t safe = ROUND_DOWN(ota_image_bytes(), OTA_RESUME_ALIGN);
+
+	/* body offsets don't map to image offsets, patches and
+	 * compressed images start over
+	 */
+	if (ota_context.mode != OTA_MODE_FULL) {
+		return;
+	}
+
+	if (safe > ota_context.saved) {
+		resume.offset = safe;
+		resume_save();
+		ota_context.saved = safe;
+	}
+}
+
+/*
+ * Start the image digest at an image offset. On a resume the bytes already
+ * in slot 1 are hashed again, only that prefix is read back.
+ */
+static int ota_hash_start(size_t offset)
+{
+	uint8_t *chunk = ota_bufs[0].data;	/* pipeline is idle here */
+	size_t pos, n;
+	int ret;
+
+	mbedtls_sha256_init(&ota_context.sha);
+	mbedtls_sha256_starts(&ota_context.sha, 0);
+
+	for (pos = 0; pos < offset; pos += n) {
+		n = MIN(offset - pos, sizeof(ota_bufs[0].data));
+		ret = flash_area_read(ota_context.flash_ctx.flash_area, pos, chunk, n);
+		if (ret < 0) {
+			return ret;
+		}
+		mbedtls_sha256_update(&ota_context.sha, chunk, n);
+	}
+
+	return 0;
+}
+
+/* Compare the finished digest against the one from the fota/ request */
+static int ota_hash_check(void)
+{
+	uint8_t digest[OTA_SHA256_LEN];
+	char hex[2 * OTA_SHA256_LEN + 1];
+
+	mbedtls_sha256_finish(&ota_context.sha, digest);
+	mbedtls_sha256_free(&ota_context.sha);
+
+	if (!resume.verify) {
+		LOG_WRN("No image digest given, not verified");
+		return 0;
+	}
+
+	if (memcmp(digest, resume.sha256, sizeof(digest)) != 0) {
+		bin2hex(digest, sizeof(digest), hex, sizeof(hex));
+		LOG_ERR("Image digest mismatch, got %s", hex);
+		return -EBADMSG;
+	}
+
+	LOG_INF("Image digest verified");
+
+	return 0;
+}
+
+static void ota_post_event(enum ota_event_type type, int result)
+{
+	struct ota_event evt = {
+		.type = type,
+		.bytes = ota_image_bytes(),
+		.total = resume.total,
+		.result = result,
+	};
+	int64_t elapsed = k_uptime_get() - ota_context.started;
+
+	if (elapsed > 0) {
+		evt.rate = (evt.bytes - ota_context.offset) * MSEC_PER_SEC / elapsed;
+	}
+	ota_context.reported = evt.bytes;
+
+	if (k_msgq_put(&ota_events, &evt, K_NO_WAIT) != 0) {
+		/* keep the newest */
+		struct ota_event oldest;
+
+		k_msgq_get(&ota_events, &oldest, K_NO_WAIT);
+		k_msgq_put(&ota_events, &evt, K_NO_WAIT);
+	}
+	uplink_notify();
+}
+
+/* Flash queue: write one buffer out, then hand it back to the receive path */
+static void ota_flash_work(struct k_work *work)
+{
+	struct ota_buf *buf = CONTAINER_OF(work, struct ota_buf, work);
+	int ret;
+
+	if (atomic_get(&ota_write_error) == 0) {
+		ret = flash_img_buffered_write(&ota_context.flash_ctx, buf->data, buf->len, false);
+		if (ret < 0) {
+			atomic_set(&ota_write_error, ret);
+		} else {
+			mbedtls_sha256_update(&ota_context.sha, buf->data, buf->len);
+			if (ota_image_bytes() - ota_context.saved >= OTA_RESUME_SAVE_BYTES) {
+				ota_save_progress();
+			}
+			if (ota_image_bytes() - ota_context.reported >= OTA_PROGRESS_STEP) {
+				ota_post_event(OTA_EVT_PROGRESS, 0);
+			}
+		}
+	}
+
+	k_sem_give(&ota_buf_free);
+}
+
+/* Receive path: copy a body fragment into the fill buffer */
+static int ota_pipe_write(const uint8_t *data, size_t len)
+{
+	int64_t wait;
+	size_t n;
+
+	while (len > 0) {
+		if (atomic_get(&ota_write_error) != 0) {
+			return atomic_get(&ota_write_error);
+		}
+
+		if (ota_fill == NULL) {
+			if (k_sem_take(&ota_buf_free, K_NO_WAIT) != 0) {
+				/* flash is the bottleneck right now */
+				wait = k_uptime_get();
+				k_sem_take(&ota_buf_free, K_FOREVER);
+				ota_context.stalled += k_uptime_get() - wait;
+			}
+			ota_fill = &ota_bufs[ota_next];
+			ota_next ^= 1;
+			ota_fill->len = 0;
+		}
+
+		n = MIN(len, sizeof(ota_fill->data) - ota_fill->len);
+		memcpy(ota_fill->data + ota_fill->len, data, n);
+		ota_fill->len += n;
+		data += n;
+		len -= n;
+
+		if (ota_fill->len == sizeof(ota_fill->data)) {
+			k_work_submit_to_queue(&ota_flash_queue, &ota_fill->work);
+			ota_fill = NULL;
+		}
+	}
+
+	return 0;
+}
+
+/* Hand over the partly filled buffer and wait until the writer is idle */
+static int ota_pipe_drain(void)
+{
+	if (ota_fill != NULL) {
+		if (ota_fill->len > 0) {
+			k_work_submit_to_queue(&ota_flash_queue, &ota_fill->work);
+		} else {
+			k_sem_give(&ota_buf_free);
+		}
+		ota_fill = NULL;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(ota_bufs); i++) {
+		k_sem_take(&ota_buf_free, K_FOREVER);
+	}
+	for (int i = 0; i < ARRAY_SIZE(ota_bufs); i++) {
+		k_sem_give(&ota_buf_free);
+	}
+
+	return atomic_get(&ota_write_error);
+}
+
 int server_connect(struct simple_http_ota_context *ctx)
 {
 	struct addrinfo *addr;
@@ -159,29 +467,147 @@ static int connect_socket(sa_family_t family, const char *server, int port,
 	return ret;
 }
 
+/* A patch or compressed image names the image it produces, so those are
+ * always verified
+ */
+static int ota_accept_target(uint32_t size, const uint8_t *sha256)
+{
+	if (size > SLOT_SIZE1) {
+		LOG_ERR("Image too big (%u, max is %d)", size, SLOT_SIZE1);
+		return -EINVAL;
+	}
+
+	if (ota_verify && memcmp(sha256, ota_digest, sizeof(ota_digest)) != 0) {
+		LOG_ERR("Server has a different image than requested");
+		return -EINVAL;
+	}
+
+	resume.total = size;
+	memcpy(resume.sha256, sha256, sizeof(resume.sha256));
+	resume.verify = 1;
+
+	return 0;
+}
+
+static int ota_delta_header(void *ctx, const struct ota_delta_header *hdr)
+{
+	if (hdr->base_major != SIMPLE_HTTP_OTA_MAJOR_VERSION ||
+	    hdr->base_minor != SIMPLE_HTTP_OTA_MINOR_VERSION ||
+	    hdr->base_size > ota_base->fa_size) {
+		LOG_ERR("Patch is against %d.%d (%u bytes), running %d.%d",
+			hdr->base_major, hdr->base_minor, hdr->base_size,
+			SIMPLE_HTTP_OTA_MAJOR_VERSION, SIMPLE_HTTP_OTA_MINOR_VERSION);
+		return -EINVAL;
+	}
+
+	LOG_INF("Patch to a %u byte image", hdr->target_size);
+
+	return ota_accept_target(hdr->target_size, hdr->target_sha256);
+}
+
+static int ota_delta_read_base(void *ctx, uint32_t off, uint8_t *buf, size_t len)
+{
+	return flash_area_read(ota_base, off, buf, len);
+}
+
+static int ota_decoded_write(void *ctx, const uint8_t *data, size_t len)
+{
+	return ota_pipe_write(data, len);
+}
+
+static const struct ota_delta_ops ota_delta_ops = {
+	.header = ota_delta_header,
+	.read_base = ota_delta_read_base,
+	.write = ota_decoded_write,
+};
+
+static int ota_lzss_header(void *ctx, const struct ota_lzss_header *hdr)
+{
+	LOG_INF("Compressed %u byte image", hdr->image_size);
+
+	return ota_accept_target(hdr->image_size, hdr->image_sha256);
+}
+
+static const struct ota_lzss_ops ota_lzss_ops = {
+	.header = ota_lzss_header,
+	.write = ota_decoded_write,
+};
+
+/* Hand a body fragment to the decoder for the current mode */
+static int ota_body_write(const uint8_t *data, size_t len)
+{
+	ota_context.received += len;
+
+	switch (ota_context.mode) {
+	case OTA_MODE_DELTA:
+		return ota_delta_feed(&ota_patch, data, len);
+	case OTA_MODE_COMPRESSED:
+		return ota_lzss_feed(&ota_unpack, data, len);
+	default:
+		return ota_pipe_write(data, len);
+	}
+}
+
 static void response_cb(struct http_response *rsp,
 			enum http_final_call final_data,
 			void *user_data)
 {
 	static size_t body_len;
 	uint8_t *body_data = NULL;
+	size_t total;
 	int ret = 0;
 
-	/* check if file exists and its size */
-	if (rsp->http_status_code != 200) {
-		ota_context.status = SIMPLE_HTTP_OTA_ERROR;
-		LOG_ERR("Could not download file: HTTP error %d", rsp->http_status_code);
+	if (ota_context.status != SIMPLE_HTTP_OTA_OK) {
 		return;
 	}
 
-	if (rsp->content_length > SLOT_SIZE1) {
+	if (ota_context.mode != OTA_MODE_FULL && rsp->http_status_code == 404) {
+		ota_context.status = SIMPLE_HTTP_OTA_NOT_FOUND;
+		return;
+	}
+
+	/* check if file exists and its size */
+	if (rsp->http_status_code != 200 && rsp->http_status_code != 206) {
 		ota_context.status = SIMPLE_HTTP_OTA_ERROR;
-		LOG_ERR("File size too big (got %d, max is %d)",
-				rsp->content_length, SLOT_SIZE1);
+		LOG_ERR("Could not download file: HTTP error %d", rsp->http_status_code);
 		return;
 	}
 
 	if (ota_context.content_length == 0) {
+		if (rsp->http_status_code == 200 && ota_context.offset > 0) {
+			/* server ignored the Range, take the whole image again */
+			LOG_WRN("No partial content, restarting at 0");
+			ret = ota_flash_seek(0);
+			if (ret < 0) {
+				ota_context.status = SIMPLE_HTTP_OTA_ERROR;
+				LOG_ERR("Flash init error %d", ret);
+				return;
+			}
+			ota_context.offset = 0;
+			ota_context.saved = 0;
+			ota_hash_start(0);
+		}
+
+		total = ota_context.offset + rsp->content_length;
+		if (total > SLOT_SIZE1) {
+			ota_context.status = SIMPLE_HTTP_OTA_ERROR;
+			LOG_ERR("File size too big (got %d, max is %d)",
+					total, SLOT_SIZE1);
+			return;
+		}
+
+		if (ota_context.offset > 0 && total != resume.total) {
+			/* not the image the saved part belongs to */
+			ota_context.status = SIMPLE_HTTP_OTA_ERROR;
+			LOG_WRN("Image changed (%d bytes, was %d), restarting", total, resume.total);
+			resume_clear();
+			return;
+		}
+		if (ota_context.mode == OTA_MODE_FULL) {
+			/* otherwise the body header gives the image size */
+			resume.total = total;
+		}
+
 		body_data = rsp->body_frag_start;
 		body_len = rsp->data_len;
 		body_len -= (rsp->body_frag_start - rsp->recv_buf);
@@ -198,16 +624,33 @@ static void response_cb(struct http_response *rsp,
 	}
 
 	if (body_data != NULL) {
-		ret = flash_img_buffered_write(&ota_context.flash_ctx, body_data, body_len, false);
+		ret = ota_body_write(body_data, body_len);
 		if (ret < 0) {
 			ota_context.status = SIMPLE_HTTP_OTA_ERROR;
-			LOG_ERR("Flash write error %d", ret);
+			LOG_ERR("Write error %d", ret);
+			if (ret == -EINVAL) {
+				/* unusable patch or compressed image, don't ask for it again */
+				ota_skip |= BIT(ota_context.mode);
+			}
 			return;
 		}
 	}
 }
 
-int simple_http_ota_run(void)
+static void ota_log_rate(void)
+{
+	int64_t elapsed = k_uptime_get() - ota_context.started;
+	size_t bytes = ota_image_bytes() - ota_context.offset;
+
+	LOG_INF("Downloaded %d image bytes (%d sent) in %lld ms, %lld KB/s "
+		"(%lld ms waiting on flash)",
+		bytes, ota_context.received, elapsed,
+		elapsed > 0 ? (int64_t)bytes * MSEC_PER_SEC / 1024 / elapsed : 0,
+		ota_context.stalled);
+}
+
+/* One GET of the full image (resumable), a patch or a compressed image */
+static int ota_download(enum ota_mode mode)
 {
 	struct sockaddr_in addr4;
 	int ret = 0;
@@ -217,8 +660,8 @@ int simple_http_ota_run(void)
 
 	struct http_parser_url parser;
 	uint16_t off, len;
-
-	flash_img_init(&ota_context.flash_ctx);
+	char range[32];
+	const char *headers[] = { range, NULL };
 
 	http_parser_url_init(&parser);
 	ret = http_parser_parse_url(download_url, strlen(download_url), 0, &parser);
@@ -242,7 +685,7 @@ int simple_http_ota_run(void)
 	len = parser.field_data[UF_HOST].len;
 	//strncpy(host, download_url+off, len);
 	memset(host, 0, 64);
-	strncpy(host, fotaResults.value, strlen(fotaResults.value));
+	strncpy(host, ota_host, sizeof(host) - 1);
 	//host[len] = '\0';
 	printk("HOST: %s\r\n", host);
 
@@ -250,8 +693,14 @@ int simple_http_ota_run(void)
 	off = parser.field_data[UF_PATH].off;
 	len = parser.field_data[UF_PATH].len;
 	//strncpy(uri, download_url+off, len);
-	memset(uri, 0, 64);
-	strncpy(uri, "/zephyr.signed.bin", strlen("/zephyr.signed.bin"));
+	if (mode == OTA_MODE_DELTA) {
+		snprintk(uri, sizeof(uri), OTA_DELTA_URI,
+			 SIMPLE_HTTP_OTA_MAJOR_VERSION, SIMPLE_HTTP_OTA_MINOR_VERSION);
+	} else if (mode == OTA_MODE_COMPRESSED) {
+		snprintk(uri, sizeof(uri), "%s", OTA_COMPRESSED_URI);
+	} else {
+		snprintk(uri, sizeof(uri), "%s", OTA_IMAGE_URI);
+	}
 	//uri[len] = '\0';
 	printk("URI: %s\r\n", uri);
 
@@ -262,6 +711,37 @@ int simple_http_ota_run(void)
 
 	LOG_INF("URL: http://%s:%d%s", host, port, uri);
 
+	/* pick up where the last attempt stopped */
+	if (resume.offset > 0 && (strcmp(resume.host, host) != 0 ||
+				  resume.verify != ota_verify ||
+				  memcmp(resume.sha256, ota_digest, sizeof(ota_digest)) != 0)) {
+		LOG_INF("New OTA image, discarding %d saved bytes", resume.offset);
+		resume_clear();
+	}
+	strncpy(resume.host, host, sizeof(resume.host) - 1);
+	memcpy(resume.sha256, ota_digest, sizeof(resume.sha256));
+	resume.verify = ota_verify;
+
+	ota_context.mode = mode;
+	ota_context.received = 0;
+	ota_context.offset = resume.offset;
+	ota_context.saved = resume.offset;
+	ota_context.reported = resume.offset;
+	ota_context.stalled = 0;
+	ota_context.started = k_uptime_get();
+	atomic_set(&ota_write_error, 0);
+	ret = ota_flash_seek(ota_context.offset);
+	if (ret < 0) {
+		LOG_ERR("Flash init error %d", ret);
+		return ret;
+	}
+
+	ret = ota_hash_start(ota_context.offset);
+	if (ret < 0) {
+		LOG_ERR("Slot 1 read error %d", ret);
+		return ret;
+	}
+
 	connect_socket(AF_INET, host, port, &ota_context.sock,
 					(struct sockaddr *)&addr4, sizeof(addr4));
 
@@ -271,6 +751,18 @@ int simple_http_ota_run(void)
 		return -ECONNABORTED;
 	}
 
+	if (mode == OTA_MODE_DELTA) {
+		ret = flash_area_open(FLASH_AREA_ID(image_0), &ota_base);
+		if (ret < 0) {
+			LOG_ERR("Slot 0 open error %d", ret);
+			close(ota_context.sock);
+			return ret;
+		}
+		ota_delta_init(&ota_patch, &ota_delta_ops, NULL);
+	} else if (mode == OTA_MODE_COMPRESSED) {
+		ota_lzss_init(&ota_unpack, &ota_lzss_ops, NULL);
+	}
+
 	if (ota_context.sock >= 0) {
 		struct http_request req;
 
@@ -284,26 +776,79 @@ int simple_http_ota_run(void)
 		req.recv_buf = ota_context.recv_buf;
 		req.recv_buf_len = sizeof(ota_context.recv_buf);
 
+		if (ota_context.offset > 0) {
+			snprintk(range, sizeof(range), "Range: bytes=%u-\r\n",
+				 (unsigned int)ota_context.offset);
+			req.header_fields = headers;
+			LOG_INF("Resuming at %d of %d bytes", ota_context.offset, resume.total);
+		}
+
 		ota_context.content_length = 0;
 		ota_context.status = SIMPLE_HTTP_OTA_OK;
 
 		ret = http_client_req(ota_context.sock, &req, HTTP_TIMEOUT, NULL);
-		if (ret < 0 || ota_context.status != SIMPLE_HTTP_OTA_OK) {
+
+		if (mode == OTA_MODE_COMPRESSED && ret >= 0 &&
+		    ota_context.status == SIMPLE_HTTP_OTA_OK && ota_context.content_length > 0 &&
+		    ota_lzss_finish(&ota_unpack) < 0) {
+			ota_context.status = SIMPLE_HTTP_OTA_ERROR;
+		}
+
+		/* everything received is in flash after this */
+		if (ota_pipe_drain() < 0) {
+			ota_context.status = SIMPLE_HTTP_OTA_ERROR;
+			LOG_ERR("Flash write error %d", (int)atomic_get(&ota_write_error));
+		}
+		ota_log_rate();
+
+		if (ret >= 0 && ota_context.status == SIMPLE_HTTP_OTA_OK &&
+		    ota_context.content_length == 0) {
+			LOG_ERR("No response body");
+			ret = -EIO;
+		}
+		if (ota_context.status == SIMPLE_HTTP_OTA_NOT_FOUND) {
+			ret = -ENOENT;
+		} else if (ret < 0 || ota_context.status != SIMPLE_HTTP_OTA_OK) {
 			LOG_ERR("Error downloading file ret = %d", ret);
+			/* keep what made it to flash for the next attempt */
+			ota_save_progress();
+			if (resume.offset > 0) {
+				LOG_INF("Download stopped, %d of %d bytes kept", resume.offset, resume.total);
+			}
+			if (ret >= 0) {
+				ret = -EIO;
+			}
 		} else {
 			/* finish image flashing in here */
-			int ret = flash_img_buffered_write(&ota_context.flash_ctx, NULL, 0, true);
+			ret = flash_img_buffered_write(&ota_context.flash_ctx, NULL, 0, true);
 
 			if (ret < 0) {
 				LOG_ERR("Flash write error %d", ret);
-			}
-
-			/* perform boot upgrade check */
-			if (boot_request_upgrade(BOOT_UPGRADE_TEST) == 0) {
-				LOG_INF("Update installed. Restart the board to complete.");
+			} else if (ota_image_bytes() < resume.total ||
+				   (mode == OTA_MODE_DELTA && !ota_delta_done(&ota_patch))) {
+				/* connection closed early without an error */
+				LOG_ERR("Image truncated at %d of %d bytes", ota_image_bytes(), resume.total);
+				ota_save_progress();
+				ret = -EIO;
+			} else if (ota_hash_check() < 0) {
+				/* corrupt or wrong image, never mark it for MCUboot */
+				resume_clear();
+				if (mode != OTA_MODE_FULL) {
+					/* e.g. a patch against another base, try the next format */
+					ota_skip |= BIT(mode);
+				}
+				ret = -EBADMSG;
 			} else {
-				LOG_ERR("Update not installed. File is corrupted or invalid.");
-				ret = -1;
+				/* complete, nothing left to resume */
+				resume_clear();
+
+				/* perform boot upgrade check */
+				if (boot_request_upgrade(BOOT_UPGRADE_TEST) == 0) {
+					LOG_INF("Update installed. Restart the board to complete.");
+				} else {
+					LOG_ERR("Update not installed. File is corrupted or invalid.");
+					ret = -1;
+				}
 			}
 		}
 	}
@@ -311,10 +856,168 @@ int simple_http_ota_run(void)
 	if (ota_context.sock >= 0) {
 		close(ota_context.sock);
 	}
+	if (mode == OTA_MODE_DELTA) {
+		flash_area_close(ota_base);
+	}
 
 	return ret;
 }
 
+int simple_http_ota_run(void)
+{
+	enum ota_mode mode;
+	int ret;
+
+	/* only the full image resumes, so a started one is finished as is */
+	for (mode = OTA_MODE_DELTA; mode < OTA_MODE_FULL && resume.offset == 0; mode++) {
+		if (ota_skip & BIT(mode)) {
+			continue;
+		}
+
+		ret = ota_download(mode);
+		if (ret != -ENOENT) {
+			return ret;
+		}
+		LOG_INF("No %s on the server", mode == OTA_MODE_DELTA ? "patch" : "compressed image");
+		ota_skip |= BIT(mode);
+	}
+
+	return ota_download(OTA_MODE_FULL);
+}
+
+bool simple_http_ota_pending(void)
+{
+	return resume.offset > 0 && resume.host[0] != '\0';
+}
+
+bool simple_http_ota_busy(void)
+{
+	return atomic_get(&ota_busy) != 0;
+}
+
+static int ota_submit(const char *host, const uint8_t *sha256)
+{
+	if (!atomic_cas(&ota_busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	memset(ota_host, 0, sizeof(ota_host));
+	strncpy(ota_host, host, sizeof(ota_host) - 1);
+	ota_verify = (sha256 != NULL);
+	if (ota_verify) {
+		memcpy(ota_digest, sha256, sizeof(ota_digest));
+	} else {
+		memset(ota_digest, 0, sizeof(ota_digest));
+	}
+	k_sem_give(&ota_request_sem);
+
+	return 0;
+}
+
+int simple_http_ota_request(const char *host, const char *sha256)
+{
+	uint8_t digest[OTA_SHA256_LEN];
+
+	if (host == NULL) {
+		return -EINVAL;
+	}
+
+	if (sha256 == NULL) {
+		return ota_submit(host, NULL);
+	}
+
+	if (strlen(sha256) != 2 * sizeof(digest) ||
+	    hex2bin(sha256, strlen(sha256), digest, sizeof(digest)) != sizeof(digest)) {
+		return -EINVAL;
+	}
+
+	return ota_submit(host, digest);
+}
+
+int simple_http_ota_get_event(struct ota_event *evt)
+{
+	return k_msgq_get(&ota_events, evt, K_NO_WAIT);
+}
+
+const char *simple_http_ota_event_name(enum ota_event_type type)
+{
+	switch (type) {
+	case OTA_EVT_STARTED:
+		return "started";
+	case OTA_EVT_PROGRESS:
+		return "progress";
+	case OTA_EVT_RETRY:
+		return "retry";
+	case OTA_EVT_DONE:
+		return "done";
+	case OTA_EVT_FAILED:
+		return "failed";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * OTA worker: waits for simple_http_ota_request(), downloads with retries
+ * and reboots into the new image. Runs preemptible below the sensor and
+ * MQTT threads, so telemetry keeps going during a download.
+ */
+void thread_ota_entry(void)
+{
+	size_t progress;
+	int attempts;
+	int ret;
+
+	k_work_queue_start(&ota_flash_queue, ota_flash_stack,
+			   K_THREAD_STACK_SIZEOF(ota_flash_stack),
+			   OTA_FLASH_PRIORITY, NULL);
+	k_thread_name_set(&ota_flash_queue.thread, "ota_flash");
+	for (int i = 0; i < ARRAY_SIZE(ota_bufs); i++) {
+		k_work_init(&ota_bufs[i].work, ota_flash_work);
+	}
+
+	if (simple_http_ota_pending()) {
+		/* power cycled mid-download, finish it */
+		LOG_INF("Resuming interrupted OTA from %s", resume.host);
+		ota_submit(resume.host, resume.verify ? resume.sha256 : NULL);
+	}
+
+	while (1) {
+		k_sem_take(&ota_request_sem, K_FOREVER);
+		ota_skip = 0;
+
+		wifi_wait_ready(K_FOREVER);
+
+		ota_context.started = k_uptime_get();
+		ota_context.offset = resume.offset;
+		ota_post_event(OTA_EVT_STARTED, 0);
+
+		attempts = 0;
+		while (1) {
+			progress = resume.offset;
+			ret = simple_http_ota_run();
+			if (ret == 0) {
+				ota_post_event(OTA_EVT_DONE, 0);
+				k_msleep(OTA_REBOOT_DELAY_MS);
+				sys_reboot(SYS_REBOOT_COLD);
+			}
+
+			/* an attempt that moved the resume point doesn't count */
+			attempts = (resume.offset > progress) ? 1 : attempts + 1;
+			if (attempts >= OTA_MAX_ATTEMPTS) {
+				LOG_ERR("OTA failed %d times in a row, giving up", attempts);
+				ota_post_event(OTA_EVT_FAILED, ret);
+				break;
+			}
+
+			ota_post_event(OTA_EVT_RETRY, ret);
+			k_msleep(OTA_RETRY_MS);
+		}
+
+		atomic_set(&ota_busy, 0);
+	}
+}
+
 int simple_http_ota_init(void)
 {
 	bool image_ok = false;
@@ -329,6 +1032,9 @@ int simple_http_ota_init(void)
 			return ret;
 		}
 
+		/* slot 1 is erased below, a saved partial download is gone */
+		resume_clear();
+
 		LOG_INF("Erasing bank in slot 1...");
 		ret = boot_erase_img_bank(FLASH_AREA_ID(image_1));
 		if (ret) {
@@ -7,9 +7,56 @@
  **********************************************************************
  * */
 
-#ifndef MQTT_H
-#define MQTT_H
+#ifndef OTA_H
+#define OTA_H
 
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+/* HTTP receive buffer, one http_client fragment */
+#define OTA_RECV_BUF_SIZE	2048
+/* each of the two buffers between the receive path and the flash writer */
+#define OTA_WRITE_BUF_SIZE	4096
+#define OTA_FLASH_STACK_SIZE	2048
+#define OTA_FLASH_PRIORITY	3
+
+/* worker retry policy: attempts that add nothing to slot 1 count */
+#define OTA_RETRY_MS		10000
+#define OTA_MAX_ATTEMPTS	5
+/* progress event every this many bytes */
+#define OTA_PROGRESS_STEP	(64 * 1024)
+/* let the final event reach the broker before rebooting */
+#define OTA_REBOOT_DELAY_MS	3000
+#define OTA_EVENT_QUEUE_LEN	8
+
+/* version of this build, a delta update patches from it */
+#define SIMPLE_HTTP_OTA_MAJOR_VERSION 2
+#define SIMPLE_HTTP_OTA_MINOR_VERSION 2
+
+#define OTA_IMAGE_URI		"/zephyr.signed.bin"
+/* patch from the running version, tools/ota_delta.py names it */
+#define OTA_DELTA_URI		"/zephyr-%d.%d.patch"
+/* tools/ota_compress.py output, tried when there is no patch */
+#define OTA_COMPRESSED_URI	"/zephyr.signed.bin.hs"
+
+/* SHA-256 of the served file (zephyr.signed.bin), checked before upgrading */
+#define OTA_SHA256_LEN		32
+
+enum ota_event_type {
+	OTA_EVT_STARTED,
+	OTA_EVT_PROGRESS,
+	OTA_EVT_RETRY,		/* attempt failed, trying again */
+	OTA_EVT_DONE,		/* image marked for upgrade, rebooting */
+	OTA_EVT_FAILED,		/* gave up */
+};
+
+struct ota_event {
+	enum ota_event_type type;
+	uint32_t bytes;		/* image bytes in slot 1 */
+	uint32_t total;		/* image size, 0 until known */
+	uint32_t rate;		/* this attempt's download rate, bytes/s */
+	int32_t result;		/* error code for RETRY and FAILED */
+};
 
 
 /**
@@ -33,6 +80,51 @@ int simple_http_ota_init(void);
  */
 int simple_http_ota_run(void);
 
+/**
+ * @brief Check for an interrupted download
+ *
+ * @return true if part of an image is in slot 1 and the download can be
+ * resumed with simple_http_ota_run()
+ */
+bool simple_http_ota_pending(void);
+
+/**
+ * @brief Check whether the worker is running a download
+ *
+ * @return true from simple_http_ota_request() until the image is done or
+ * the worker gives up
+ */
+bool simple_http_ota_busy(void);
+
+/**
+ * @brief Start an update in the OTA worker
+ *
+ * Returns at once; the download, retries and reboot happen on the worker,
+ * progress comes back through simple_http_ota_get_event().
+ *
+ * @param host image server, copied
+ * @param sha256 expected image digest as 64 hex digits, NULL to skip the check
+ *
+ * @return 0 on success
+ * @return -EBUSY if an update is already running
+ * @return -EINVAL if the digest isn't valid hex
+ */
+int simple_http_ota_request(const char *host, const char *sha256);
+
+/**
+ * @brief Take the oldest progress event, non-blocking
+ *
+ * uplink_notify() is called whenever one is queued; the MQTT and
+ * MQTT-SN transports publish them on ota/status/.
+ *
+ * @return 0 on success, -ENOMSG if none is queued
+ */
+int simple_http_ota_get_event(struct ota_event *evt);
+
+const char *simple_http_ota_event_name(enum ota_event_type type);
+
+void thread_ota_entry(void);
+
 //extern char host_ip[64];
 
 #endif /* __SIMPLE_HTTP_OTA_H__ */
\ No newline at end of file
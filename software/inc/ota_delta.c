@@ -0,0 +1,204 @@
+/**
+ ************************************************************************
+ * @file inc/ota_delta.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the streaming OTA patch decoder
+ *
+ * Only needs the header and one operation buffered, so a patch is applied
+ * straight from the HTTP body fragments.
+ **********************************************************************
+ * */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include "ota_delta.h"
+LOG_MODULE_REGISTER(ota_delta);
+
+/* opcode and arguments, the INSERT payload follows separately */
+#define OP_COPY_LEN	9
+#define OP_INSERT_LEN	5
+
+static int delta_fail(struct ota_delta *delta, int err)
+{
+	delta->state = OTA_DELTA_ERROR;
+
+	return err;
+}
+
+static int delta_parse_header(struct ota_delta *delta)
+{
+	const uint8_t *p = delta->stage;
+	struct ota_delta_header *hdr = &delta->hdr;
+
+	if (memcmp(p, OTA_DELTA_MAGIC, 4) != 0) {
+		LOG_ERR("Not a patch");
+		return -EINVAL;
+	}
+
+	hdr->version = p[4];
+	hdr->base_major = p[5];
+	hdr->base_minor = p[6];
+	hdr->base_size = sys_get_le32(&p[8]);
+	hdr->target_size = sys_get_le32(&p[12]);
+	memcpy(hdr->target_sha256, &p[16], sizeof(hdr->target_sha256));
+
+	if (hdr->version != OTA_DELTA_VERSION) {
+		LOG_ERR("Patch version %d not supported", hdr->version);
+		return -EINVAL;
+	}
+
+	return delta->ops->header(delta->ctx, hdr);
+}
+
+static int delta_copy(struct ota_delta *delta, uint32_t off, uint32_t len)
+{
+	size_t n;
+	int ret;
+
+	if (off > delta->hdr.base_size || len > delta->hdr.base_size - off) {
+		LOG_ERR("COPY %u+%u outside the base image", off, len);
+		return -EINVAL;
+	}
+
+	while (len > 0) {
+		n = MIN(len, sizeof(delta->copy_buf));
+		ret = delta->ops->read_base(delta->ctx, off, delta->copy_buf, n);
+		if (ret < 0) {
+			return ret;
+		}
+		ret = delta->ops->write(delta->ctx, delta->copy_buf, n);
+		if (ret < 0) {
+			return ret;
+		}
+		off += n;
+		len -= n;
+		delta->written += n;
+	}
+
+	return 0;
+}
+
+/* Run the staged operation, once all of its argument bytes are in */
+static int delta_run_op(struct ota_delta *delta)
+{
+	const uint8_t *p = delta->stage;
+	uint32_t len;
+	int ret = 0;
+
+	len = sys_get_le32(&p[p[0] == OTA_DELTA_OP_COPY ? 5 : 1]);
+	if (len > delta->hdr.target_size - delta->written) {
+		LOG_ERR("Patch runs past the %u byte image", delta->hdr.target_size);
+		return -EINVAL;
+	}
+
+	if (p[0] == OTA_DELTA_OP_COPY) {
+		ret = delta_copy(delta, sys_get_le32(&p[1]), len);
+	} else {
+		delta->remaining = len;
+		delta->state = OTA_DELTA_INSERT;
+	}
+	delta->staged = 0;
+
+	return ret;
+}
+
+static void delta_check_done(struct ota_delta *delta)
+{
+	if (delta->state == OTA_DELTA_OP && delta->written == delta->hdr.target_size) {
+		delta->state = OTA_DELTA_DONE;
+	}
+}
+
+void ota_delta_init(struct ota_delta *delta, const struct ota_delta_ops *ops, void *ctx)
+{
+	memset(delta, 0, sizeof(*delta));
+	delta->ops = ops;
+	delta->ctx = ctx;
+	delta->state = OTA_DELTA_HEADER;
+}
+
+int ota_delta_feed(struct ota_delta *delta, const uint8_t *data, size_t len)
+{
+	size_t need, n;
+	int ret;
+
+	while (len > 0) {
+		switch (delta->state) {
+		case OTA_DELTA_HEADER:
+			n = MIN(len, OTA_DELTA_HEADER_LEN - delta->staged);
+			memcpy(delta->stage + delta->staged, data, n);
+			delta->staged += n;
+			if (delta->staged == OTA_DELTA_HEADER_LEN) {
+				ret = delta_parse_header(delta);
+				if (ret < 0) {
+					return delta_fail(delta, ret);
+				}
+				delta->staged = 0;
+				delta->state = OTA_DELTA_OP;
+				delta_check_done(delta);
+			}
+			break;
+
+		case OTA_DELTA_OP:
+			if (delta->staged == 0 && data[0] != OTA_DELTA_OP_COPY &&
+			    data[0] != OTA_DELTA_OP_INSERT) {
+				LOG_ERR("Bad patch opcode 0x%02x", data[0]);
+				return delta_fail(delta, -EINVAL);
+			}
+			need = (delta->staged ? delta->stage[0] : data[0]) == OTA_DELTA_OP_COPY ?
+			       OP_COPY_LEN : OP_INSERT_LEN;
+			n = MIN(len, need - delta->staged);
+			memcpy(delta->stage + delta->staged, data, n);
+			delta->staged += n;
+			if (delta->staged == need) {
+				ret = delta_run_op(delta);
+				if (ret < 0) {
+					return delta_fail(delta, ret);
+				}
+				delta_check_done(delta);
+			}
+			break;
+
+		case OTA_DELTA_INSERT:
+			n = MIN(len, delta->remaining);
+			ret = delta->ops->write(delta->ctx, data, n);
+			if (ret < 0) {
+				return delta_fail(delta, ret);
+			}
+			delta->remaining -= n;
+			delta->written += n;
+			if (delta->remaining == 0) {
+				delta->state = OTA_DELTA_OP;
+				delta_check_done(delta);
+			}
+			break;
+
+		case OTA_DELTA_DONE:
+			LOG_ERR("%d bytes after the end of the patch", len);
+			return delta_fail(delta, -EINVAL);
+
+		default:
+			return -EINVAL;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	/* an INSERT of 0 bytes at the very end */
+	if (delta->state == OTA_DELTA_INSERT && delta->remaining == 0) {
+		delta->state = OTA_DELTA_OP;
+		delta_check_done(delta);
+	}
+
+	return 0;
+}
+
+bool ota_delta_done(const struct ota_delta *delta)
+{
+	return delta->state == OTA_DELTA_DONE;
+}
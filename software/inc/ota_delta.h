@@ -0,0 +1,95 @@
+/**
+ ************************************************************************
+ * @file inc/ota_delta.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the streaming OTA patch decoder
+ *
+ * Patch format, all integers little endian (tools/ota_delta.py writes it):
+ *
+ *   header  "SRDP" | version | base major | base minor | 0 |
+ *           base size (u32) | target size (u32) | target sha256 (32)
+ *   COPY    0x01 | base offset (u32) | length (u32)
+ *   INSERT  0x02 | length (u32) | length bytes
+ *
+ * Operations rebuild the target image front to back, the patch ends once
+ * target size bytes have been produced.
+ **********************************************************************
+ * */
+
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_DELTA_MAGIC		"SRDP"
+#define OTA_DELTA_VERSION	1
+#define OTA_DELTA_HEADER_LEN	48
+
+#define OTA_DELTA_OP_COPY	0x01
+#define OTA_DELTA_OP_INSERT	0x02
+
+/* base image bytes read per flash access while copying */
+#define OTA_DELTA_COPY_CHUNK	256
+
+struct ota_delta_header {
+	uint8_t version;
+	uint8_t base_major;
+	uint8_t base_minor;
+	uint32_t base_size;
+	uint32_t target_size;
+	uint8_t target_sha256[32];
+};
+
+struct ota_delta_ops {
+	/* header parsed: accept (0) or reject the patch */
+	int (*header)(void *ctx, const struct ota_delta_header *hdr);
+	/* read len bytes of the running image at off */
+	int (*read_base)(void *ctx, uint32_t off, uint8_t *buf, size_t len);
+	/* append to the rebuilt image */
+	int (*write)(void *ctx, const uint8_t *data, size_t len);
+};
+
+enum ota_delta_state {
+	OTA_DELTA_HEADER,
+	OTA_DELTA_OP,
+	OTA_DELTA_INSERT,
+	OTA_DELTA_DONE,
+	OTA_DELTA_ERROR,
+};
+
+struct ota_delta {
+	const struct ota_delta_ops *ops;
+	void *ctx;
+	enum ota_delta_state state;
+	struct ota_delta_header hdr;
+	/* header or operation bytes collected so far */
+	uint8_t stage[OTA_DELTA_HEADER_LEN];
+	size_t staged;
+	uint32_t remaining;	/* INSERT bytes still to come */
+	uint32_t written;	/* target bytes produced */
+	uint8_t copy_buf[OTA_DELTA_COPY_CHUNK];
+};
+
+void ota_delta_init(struct ota_delta *delta, const struct ota_delta_ops *ops, void *ctx);
+
+/**
+ * @brief Decode the next patch fragment
+ *
+ * Fragments can be split anywhere, ops->write is called as target bytes
+ * become available.
+ *
+ * @return 0 on success
+ * @return -EINVAL for a malformed patch, or the first callback error.
+ * Every later call fails too.
+ */
+int ota_delta_feed(struct ota_delta *delta, const uint8_t *data, size_t len);
+
+/**
+ * @brief Check that the whole target image was produced
+ */
+bool ota_delta_done(const struct ota_delta *delta);
+
+#endif
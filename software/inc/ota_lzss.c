@@ -0,0 +1,223 @@
+/**
+ ************************************************************************
+ * @file inc/ota_lzss.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the streaming OTA image decompressor
+ *
+ * Bits are consumed as they arrive, fragments can end anywhere, even in the
+ * middle of a back reference.
+ **********************************************************************
+ * */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include "ota_lzss.h"
+LOG_MODULE_REGISTER(ota_lzss);
+
+#define WINDOW_MASK	((1 << OTA_LZSS_WINDOW_BITS) - 1)
+
+static int lzss_fail(struct ota_lzss *lzss, int err)
+{
+	lzss->state = OTA_LZSS_ERROR;
+
+	return err;
+}
+
+static int lzss_parse_header(struct ota_lzss *lzss)
+{
+	const uint8_t *p = lzss->stage;
+	struct ota_lzss_header *hdr = &lzss->hdr;
+
+	if (memcmp(p, OTA_LZSS_MAGIC, 4) != 0) {
+		LOG_ERR("Not a compressed image");
+		return -EINVAL;
+	}
+
+	hdr->version = p[4];
+	hdr->image_size = sys_get_le32(&p[8]);
+	memcpy(hdr->image_sha256, &p[12], sizeof(hdr->image_sha256));
+
+	if (hdr->version != OTA_LZSS_VERSION || p[5] != OTA_LZSS_WINDOW_BITS ||
+	    p[6] != OTA_LZSS_LOOKAHEAD_BITS) {
+		LOG_ERR("Compressed image v%d -w %d -l %d not supported", p[4], p[5], p[6]);
+		return -EINVAL;
+	}
+
+	return lzss->ops->header(lzss->ctx, hdr);
+}
+
+static int lzss_flush(struct ota_lzss *lzss)
+{
+	int ret = 0;
+
+	if (lzss->out_len > 0) {
+		ret = lzss->ops->write(lzss->ctx, lzss->out, lzss->out_len);
+		lzss->out_len = 0;
+	}
+
+	return ret;
+}
+
+static int lzss_emit(struct ota_lzss *lzss, uint8_t byte)
+{
+	if (lzss->written >= lzss->hdr.image_size) {
+		LOG_ERR("Stream runs past the %u byte image", lzss->hdr.image_size);
+		return -EINVAL;
+	}
+
+	lzss->window[lzss->head] = byte;
+	lzss->head = (lzss->head + 1) & WINDOW_MASK;
+	lzss->written++;
+
+	lzss->out[lzss->out_len++] = byte;
+	if (lzss->out_len == sizeof(lzss->out)) {
+		return lzss_flush(lzss);
+	}
+
+	return 0;
+}
+
+/* Take n bits off the top of the accumulator, false if there aren't enough */
+static bool lzss_bits(struct ota_lzss *lzss, uint8_t n, uint16_t *value)
+{
+	if (lzss->nbits < n) {
+		return false;
+	}
+
+	lzss->nbits -= n;
+	*value = (lzss->bits >> lzss->nbits) & ((1 << n) - 1);
+
+	return true;
+}
+
+/* Decode every complete literal or back reference in the accumulator */
+static int lzss_decode(struct ota_lzss *lzss)
+{
+	uint16_t value;
+	int ret;
+
+	while (1) {
+		switch (lzss->state) {
+		case OTA_LZSS_TAG:
+			if (!lzss_bits(lzss, 1, &value)) {
+				return 0;
+			}
+			lzss->state = value ? OTA_LZSS_LITERAL : OTA_LZSS_DISTANCE;
+			break;
+
+		case OTA_LZSS_LITERAL:
+			if (!lzss_bits(lzss, 8, &value)) {
+				return 0;
+			}
+			ret = lzss_emit(lzss, value);
+			if (ret < 0) {
+				return ret;
+			}
+			lzss->state = OTA_LZSS_TAG;
+			break;
+
+		case OTA_LZSS_DISTANCE:
+			if (!lzss_bits(lzss, OTA_LZSS_WINDOW_BITS, &value)) {
+				return 0;
+			}
+			lzss->distance = value + 1;
+			lzss->state = OTA_LZSS_LENGTH;
+			break;
+
+		case OTA_LZSS_LENGTH:
+			if (!lzss_bits(lzss, OTA_LZSS_LOOKAHEAD_BITS, &value)) {
+				return 0;
+			}
+			if (lzss->distance > lzss->written) {
+				LOG_ERR("Reference before the start of the image");
+				return -EINVAL;
+			}
+			for (int i = 0; i <= value; i++) {
+				ret = lzss_emit(lzss, lzss->window[(lzss->head - lzss->distance) & WINDOW_MASK]);
+				if (ret < 0) {
+					return ret;
+				}
+			}
+			lzss->state = OTA_LZSS_TAG;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+	}
+}
+
+void ota_lzss_init(struct ota_lzss *lzss, const struct ota_lzss_ops *ops, void *ctx)
+{
+	memset(lzss, 0, sizeof(*lzss));
+	lzss->ops = ops;
+	lzss->ctx = ctx;
+	lzss->state = OTA_LZSS_HEADER;
+}
+
+int ota_lzss_feed(struct ota_lzss *lzss, const uint8_t *data, size_t len)
+{
+	size_t n;
+	int ret;
+
+	if (lzss->state == OTA_LZSS_ERROR) {
+		return -EINVAL;
+	}
+
+	if (lzss->state == OTA_LZSS_HEADER) {
+		n = MIN(len, OTA_LZSS_HEADER_LEN - lzss->staged);
+		memcpy(lzss->stage + lzss->staged, data, n);
+		lzss->staged += n;
+		data += n;
+		len -= n;
+		if (lzss->staged < OTA_LZSS_HEADER_LEN) {
+			return 0;
+		}
+
+		ret = lzss_parse_header(lzss);
+		if (ret < 0) {
+			return lzss_fail(lzss, ret);
+		}
+		lzss->state = OTA_LZSS_TAG;
+	}
+
+	/* the longest code is 15 bits, a byte at a time keeps it in 32 */
+	while (len > 0) {
+		lzss->bits = (lzss->bits << 8) | *data++;
+		lzss->nbits += 8;
+		len--;
+
+		ret = lzss_decode(lzss);
+		if (ret < 0) {
+			return lzss_fail(lzss, ret);
+		}
+	}
+
+	return 0;
+}
+
+int ota_lzss_finish(struct ota_lzss *lzss)
+{
+	int ret;
+
+	if (lzss->state == OTA_LZSS_ERROR || lzss->state == OTA_LZSS_HEADER) {
+		return -EIO;
+	}
+
+	ret = lzss_flush(lzss);
+	if (ret < 0) {
+		return lzss_fail(lzss, ret);
+	}
+
+	/* up to 7 bits of padding are left over, that's fine */
+	if (lzss->written != lzss->hdr.image_size) {
+		LOG_ERR("Image short: %u of %u bytes", lzss->written, lzss->hdr.image_size);
+		return lzss_fail(lzss, -EIO);
+	}
+
+	return 0;
+}
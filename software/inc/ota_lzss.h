@@ -0,0 +1,95 @@
+/**
+ ************************************************************************
+ * @file inc/ota_lzss.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the streaming OTA image decompressor
+ *
+ * Compressed image format, integers little endian (tools/ota_compress.py):
+ *
+ *   header  "SRHS" | version | window bits | lookahead bits | 0 |
+ *           image size (u32) | image sha256 (32)
+ *   body    heatshrink bit stream, MSB first:
+ *           1 + 8 bit literal, or
+ *           0 + (distance - 1) in window bits + (length - 1) in lookahead bits
+ *
+ * Laid out like a heatshrink stream with -w 10 -l 4; the decoder needs the 1 KiB
+ * window and nothing else.
+ **********************************************************************
+ * */
+
+#ifndef OTA_LZSS_H
+#define OTA_LZSS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_LZSS_MAGIC		"SRHS"
+#define OTA_LZSS_VERSION	1
+#define OTA_LZSS_HEADER_LEN	44
+
+#define OTA_LZSS_WINDOW_BITS	10
+#define OTA_LZSS_LOOKAHEAD_BITS	4
+
+/* decoded bytes handed to ops->write at a time */
+#define OTA_LZSS_OUT_CHUNK	256
+
+struct ota_lzss_header {
+	uint8_t version;
+	uint32_t image_size;
+	uint8_t image_sha256[32];
+};
+
+struct ota_lzss_ops {
+	/* header parsed: accept (0) or reject the image */
+	int (*header)(void *ctx, const struct ota_lzss_header *hdr);
+	/* append to the decompressed image */
+	int (*write)(void *ctx, const uint8_t *data, size_t len);
+};
+
+enum ota_lzss_state {
+	OTA_LZSS_HEADER,
+	OTA_LZSS_TAG,
+	OTA_LZSS_LITERAL,
+	OTA_LZSS_DISTANCE,
+	OTA_LZSS_LENGTH,
+	OTA_LZSS_ERROR,
+};
+
+struct ota_lzss {
+	const struct ota_lzss_ops *ops;
+	void *ctx;
+	enum ota_lzss_state state;
+	struct ota_lzss_header hdr;
+	uint8_t stage[OTA_LZSS_HEADER_LEN];
+	size_t staged;
+	uint32_t bits;		/* input bits not decoded yet, right aligned */
+	uint8_t nbits;
+	uint16_t distance;
+	uint16_t head;		/* next window slot */
+	uint32_t written;	/* image bytes produced */
+	uint8_t window[1 << OTA_LZSS_WINDOW_BITS];
+	uint8_t out[OTA_LZSS_OUT_CHUNK];
+	size_t out_len;
+};
+
+void ota_lzss_init(struct ota_lzss *lzss, const struct ota_lzss_ops *ops, void *ctx);
+
+/**
+ * @brief Decompress the next fragment
+ *
+ * @return 0 on success
+ * @return -EINVAL for a bad header or stream, or the first callback error.
+ * Every later call fails too.
+ */
+int ota_lzss_feed(struct ota_lzss *lzss, const uint8_t *data, size_t len);
+
+/**
+ * @brief Write out buffered bytes, call once the body is complete
+ *
+ * @return 0 on success, -EIO if the image is short, or a write error
+ */
+int ota_lzss_finish(struct ota_lzss *lzss);
+
+#endif
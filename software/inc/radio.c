@@ -0,0 +1,181 @@
+/**
+ ************************************************************************
+ * @file inc/radio.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the radio scheduler
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include "radio.h"
+#include "wifi.h"
+#include "uplink.h"
+#include "ota.h"
+
+LOG_MODULE_REGISTER(radio);
+
+static const char *const stateNames[RADIO_MOTOR_STATES] = {
+    [INIT] = "init",
+    [SENSING_BEGIN] = "begin",
+    [SENSING] = "sensing",
+    [SENSING_END] = "end",
+    [SLEEP] = "sleep",
+};
+
+static enum radio_mode mode = RADIO_ON;
+static States motorState = INIT;
+static int64_t markAt;
+static int64_t sleepStartedAt;
+static int64_t wakeAt;
+// the driver refused power save once, don't ask again
+static bool psUnsupported;
+
+static struct radio_stats stats;
+static K_MUTEX_DEFINE(statsLock);
+
+static K_THREAD_STACK_DEFINE(radioStack, RADIO_STACK_SIZE);
+static struct k_work_q radioQueue;
+
+static void radio_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(radioWork, radio_work_handler);
+
+/*
+    Charge the time since the last change to the current mode and state.
+    Call with statsLock held.
+*/
+static void radio_account(int64_t now) {
+
+    stats.ms[mode][motorState] += now - markAt;
+    markAt = now;
+}
+
+static void radio_set_mode(enum radio_mode next) {
+
+    enum radio_mode prev = mode;
+
+    if (next == RADIO_POWER_SAVE && psUnsupported) {
+        next = RADIO_OFF;
+    }
+    if (next == prev) {
+        return;
+    }
+
+    switch (next) {
+        case RADIO_ON:
+            if (prev == RADIO_OFF) {
+                wifi_set_radio(true);
+            } else {
+                wifi_power_save(false);
+            }
+            break;
+
+        case RADIO_POWER_SAVE:
+            if (wifi_power_save(true) < 0) {
+                LOG_WRN("No WiFi power save, turning the radio off instead");
+                psUnsupported = true;
+                stats.psFailures++;
+                next = RADIO_OFF;
+                wifi_set_radio(false);
+            }
+            break;
+
+        default:
+            wifi_set_radio(false);
+            break;
+    }
+
+    k_mutex_lock(&statsLock, K_FOREVER);
+    radio_account(k_uptime_get());
+    mode = next;
+    k_mutex_unlock(&statsLock);
+    LOG_INF("Radio %s in %s", next == RADIO_ON ? "on" : next == RADIO_OFF ? "off" : "power save",
+            stateNames[motorState]);
+}
+
+/*
+    Nothing left to send and no download to finish
+*/
+static bool radio_uplink_idle(void) {
+
+    return uplink_idle() && !simple_http_ota_busy();
+}
+
+static void radio_work_handler(struct k_work *work) {
+
+    int64_t now = k_uptime_get();
+
+    if (motorState != SLEEP || now >= wakeAt) {
+        radio_set_mode(RADIO_ON);
+        return;
+    }
+
+    if (mode == RADIO_ON) {
+        if (!radio_uplink_idle()) {
+            if (now - sleepStartedAt < RADIO_DRAIN_MAX_MS) {
+                k_work_reschedule_for_queue(&radioQueue, &radioWork, K_MSEC(RADIO_DRAIN_POLL_MS));
+                return;
+            }
+            LOG_WRN("Uplink still busy after %d ms, turning the radio down", RADIO_DRAIN_MAX_MS);
+            stats.drainTimeouts++;
+        }
+        stats.sleeps++;
+        radio_set_mode(RADIO_SLEEP_MODE);
+    }
+
+    k_work_reschedule_for_queue(&radioQueue, &radioWork, K_MSEC(wakeAt - now));
+}
+
+void radio_motor_state(States state, int64_t durationMs) {
+
+    int64_t now = k_uptime_get();
+
+    k_mutex_lock(&statsLock, K_FOREVER);
+    radio_account(now);
+    motorState = state;
+    k_mutex_unlock(&statsLock);
+
+    if (state == SLEEP) {
+        sleepStartedAt = now;
+        // too short to be worth a reconnect, stay on
+        wakeAt = (durationMs < RADIO_WAKE_LEAD_MS + RADIO_MIN_OFF_MS) ?
+                 now : now + durationMs - RADIO_WAKE_LEAD_MS;
+    }
+
+    k_work_reschedule_for_queue(&radioQueue, &radioWork, K_NO_WAIT);
+}
+
+uint16_t radio_keepalive(void) {
+
+    if (RADIO_SLEEP_MODE == RADIO_POWER_SAVE && !psUnsupported) {
+        return RADIO_PS_KEEPALIVE_S;
+    }
+
+    return CONFIG_MQTT_KEEPALIVE;
+}
+
+void radio_get_stats(struct radio_stats *out) {
+
+    k_mutex_lock(&statsLock, K_FOREVER);
+    radio_account(k_uptime_get());
+    *out = stats;
+    k_mutex_unlock(&statsLock);
+}
+
+const char *radio_state_name(States state) {
+
+    return (state < RADIO_MOTOR_STATES) ? stateNames[state] : "?";
+}
+
+static int radio_init(void) {
+
+    k_work_queue_start(&radioQueue, radioStack, K_THREAD_STACK_SIZEOF(radioStack),
+                       RADIO_PRIORITY, NULL);
+    k_thread_name_set(&radioQueue.thread, "radio");
+
+    return 0;
+}
+
+SYS_INIT(radio_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
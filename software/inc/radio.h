@@ -0,0 +1,72 @@
+/**
+ ************************************************************************
+ * @file inc/radio.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the radio scheduler
+ *
+ * The radio follows the chamber: fully on while it moves and senses, and
+ * dozing (WiFi power save) or off during SLEEP, back on in time for the
+ * next SENSING_BEGIN.
+ **********************************************************************
+ * */
+
+#ifndef RADIO_H
+#define RADIO_H
+
+#include <zephyr/kernel.h>
+#include "motor.h"
+
+enum radio_mode {
+    RADIO_ON,
+    RADIO_POWER_SAVE,   // associated, wakes every RADIO_PS_LISTEN_INTERVAL beacons
+    RADIO_OFF,          // disconnected, session dropped
+    RADIO_MODES
+};
+
+#define RADIO_MOTOR_STATES          (SLEEP + 1)
+
+// what SLEEP does with the radio, RADIO_POWER_SAVE falls back to off if
+// the driver has no power save
+#define RADIO_SLEEP_MODE            RADIO_OFF
+// reconnect this long before SLEEP ends, covers a cached channel connect,
+// DHCP and the broker CONNECT
+#define RADIO_WAKE_LEAD_MS          30000
+// don't bother switching for a SLEEP shorter than this plus the lead
+#define RADIO_MIN_OFF_MS            60000
+// give the uplink this long to drain before the radio goes anyway, the
+// rest waits in the sample log
+#define RADIO_DRAIN_MAX_MS          120000
+#define RADIO_DRAIN_POLL_MS         1000
+// beacons between wakeups in power save
+#define RADIO_PS_LISTEN_INTERVAL    10
+// broker keepalive while SLEEP dozes, longer than a SLEEP so the broker
+// is not pinged through it (MQTT allows up to 65535 s)
+#define RADIO_PS_KEEPALIVE_S        3600
+// the switching blocks in the WiFi driver, so it has a queue of its own
+#define RADIO_STACK_SIZE            2048
+#define RADIO_PRIORITY              5
+
+struct radio_stats {
+    // ms spent in each radio mode, per motor state
+    int64_t ms[RADIO_MODES][RADIO_MOTOR_STATES];
+    uint32_t sleeps;        // SLEEPs the radio was turned down for
+    uint32_t drainTimeouts; // turned down with the uplink still busy
+    uint32_t psFailures;    // power save refused, went off instead
+};
+
+/*
+    Chamber state machine: the chamber entered a state expected to last durationMs.
+    Non-blocking, the switching happens on the radio work queue.
+*/
+void radio_motor_state(States state, int64_t durationMs);
+
+// broker keepalive (s) to ask for in CONNECT
+uint16_t radio_keepalive(void);
+
+void radio_get_stats(struct radio_stats *stats);
+
+// short name for a motor state, for logs
+const char *radio_state_name(States state);
+
+#endif
@@ -0,0 +1,456 @@
+/**
+ ************************************************************************
+ * @file inc/sample_log.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the flash store-and-forward sample log
+ *
+ * An FCB (flash circular buffer) on its own partition. Entries are a
+ * struct sensor_sample, a struct flux_record or a struct sample_log_mark,
+ * told apart by length. Samples and flux records share one sequence and are
+ * appended in its order, so replay runs in log order over both kinds.
+ * FCB only ever appends and erases whole sectors in turn, which spreads the
+ * wear over the partition. Sectors are erased once every entry in them has
+ * been replayed, or when the log is full.
+ *
+ * Marks record how far the sequence numbers are reserved and replayed, so
+ * both survive a reboot. At most the samples between the last mark and the
+ * reboot are replayed twice; their sequence numbers let the backend drop them.
+ **********************************************************************
+ * */
+
+#include <stddef.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/logging/log.h>
+#include "sample_log.h"
+
+LOG_MODULE_REGISTER(soil_respiration_sample_log);
+
+#define SAMPLE_LOG_MAGIC    0x534c4f47  // "SLOG"
+#define SAMPLE_LOG_VERSION  3  // 2: sensor_sample.utc, 3: flux records
+
+struct sample_log_mark {
+    uint32_t reserved;      // every seq below this may have been handed out
+    uint32_t replayed;      // every logged seq below this has been sent
+};
+
+BUILD_ASSERT(sizeof(struct sample_log_mark) != sizeof(struct sensor_sample) &&
+    sizeof(struct sample_log_mark) != sizeof(struct flux_record) &&
+    sizeof(struct sensor_sample) != sizeof(struct flux_record),
+    "log entries are told apart by length");
+
+static struct fcb logFcb;
+static struct flash_sector logSectors[SAMPLE_LOG_MAX_SECTORS];
+// last consumed entry, fe_sector == NULL starts at the oldest
+static struct fcb_entry readLoc;
+static K_MUTEX_DEFINE(logLock);
+static bool logReady;
+
+static uint32_t nextSeq;
+static uint32_t bootSeq;
+static uint32_t reservedSeq;
+static uint32_t replayedSeq;
+static struct sample_log_stats stats;
+
+
+// read a sample or flux entry whole, false if loc holds another kind
+static bool log_read_entry(const struct fcb_entry *loc, void *out, size_t len) {
+
+    if (loc->fe_data_len != len) {
+        return false;
+    }
+
+    if (flash_area_read(logFcb.fap, FCB_ENTRY_FA_DATA_OFF((*loc)), out, len)) {
+        stats.errors++;
+        return false;
+    }
+
+    return true;
+}
+
+// sequence number of a sample or flux entry, false for a mark
+static bool log_read_seq(const struct fcb_entry *loc, uint32_t *seq) {
+
+    off_t offset;
+
+    if (loc->fe_data_len == sizeof(struct sensor_sample)) {
+        offset = offsetof(struct sensor_sample, seq);
+    } else if (loc->fe_data_len == sizeof(struct flux_record)) {
+        offset = offsetof(struct flux_record, seq);
+    } else {
+        return false;
+    }
+
+    if (flash_area_read(logFcb.fap, FCB_ENTRY_FA_DATA_OFF((*loc)) + offset, seq, sizeof(*seq))) {
+        stats.errors++;
+        return false;
+    }
+
+    return true;
+}
+
+static bool log_unreplayed(const struct fcb_entry *loc) {
+
+    uint32_t seq;
+
+    return log_read_seq(loc, &seq) && seq >= replayedSeq;
+}
+
+static int log_write_raw(const void *data, uint16_t len) {
+
+    struct fcb_entry loc;
+    int rc;
+
+    rc = fcb_append(&logFcb, len, &loc);
+    if (rc) {
+        return rc;
+    }
+
+    rc = flash_area_write(logFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), data, len);
+    if (rc) {
+        return rc;
+    }
+
+    return fcb_append_finish(&logFcb, &loc);
+}
+
+static int log_put_mark(void) {
+
+    struct sample_log_mark mark = {
+        .reserved = reservedSeq,
+        .replayed = replayedSeq,
+    };
+
+    return log_write_raw(&mark, sizeof(mark));
+}
+
+/*
+    The rotation erases the oldest sector, so write a fresh mark - the
+    newest one may have been in it
+*/
+static int log_rotate(void) {
+
+    int rc = fcb_rotate(&logFcb);
+
+    if (rc) {
+        stats.errors++;
+        return rc;
+    }
+
+    if (log_put_mark()) {
+        stats.errors++;
+    }
+
+    return 0;
+}
+
+static int log_count_unreplayed(struct fcb_entry_ctx *ctx, void *arg) {
+
+    if (log_unreplayed(&ctx->loc)) {
+        (*(uint32_t *)arg)++;
+    }
+
+    return 0;
+}
+
+/*
+    Log full: give up the oldest sector, newer samples matter more
+*/
+static int log_drop_oldest(void) {
+
+    uint32_t lost = 0;
+
+    fcb_walk(&logFcb, logFcb.f_oldest, log_count_unreplayed, &lost);
+    if (readLoc.fe_sector == logFcb.f_oldest) {
+        readLoc.fe_sector = NULL;
+    }
+
+    stats.dropped += lost;
+    stats.pending -= MIN(lost, stats.pending);
+    LOG_WRN("Sample log full, %u unsent entries dropped", lost);
+
+    return log_rotate();
+}
+
+/*
+    Record the reservation and replay positions. A full log gives up its
+    oldest sector for the mark, as for a sample; the rotation writes it.
+*/
+static int log_write_mark(void) {
+
+    int rc = log_put_mark();
+
+    if (rc == -ENOSPC) {
+        return log_drop_oldest();
+    }
+    if (rc) {
+        stats.errors++;
+    }
+
+    return rc;
+}
+
+uint32_t sample_log_next_seq(void) {
+
+    uint32_t seq;
+
+    k_mutex_lock(&logLock, K_FOREVER);
+
+    seq = nextSeq++;
+    if (seq >= reservedSeq) {
+        reservedSeq = seq + SAMPLE_LOG_SEQ_BLOCK;
+        if (logReady) {
+            log_write_mark();
+        }
+    }
+
+    k_mutex_unlock(&logLock);
+
+    return seq;
+}
+
+uint32_t sample_log_boot_seq(void) {
+
+    // set once at init, before any sample is taken
+    return bootSeq;
+}
+
+static int log_append(const void *entry, uint16_t len) {
+
+    uint32_t start = k_cycle_get_32();
+    uint32_t us;
+    int rc;
+
+    if (!logReady) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&logLock, K_FOREVER);
+
+    rc = log_write_raw(entry, len);
+    if (rc == -ENOSPC) {
+        rc = log_drop_oldest();
+        if (rc == 0) {
+            rc = log_write_raw(entry, len);
+        }
+    }
+
+    if (rc) {
+        stats.errors++;
+    } else {
+        stats.appended++;
+        stats.fluxAppended += (len == sizeof(struct flux_record));
+        stats.pending++;
+        us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+        stats.appendMaxUs = MAX(stats.appendMaxUs, us);
+        stats.appendTotalUs += us;
+    }
+
+    k_mutex_unlock(&logLock);
+
+    return rc;
+}
+
+int sample_log_append(const struct sensor_sample *sample) {
+
+    return log_append(sample, sizeof(*sample));
+}
+
+int sample_log_append_flux(const struct flux_record *record) {
+
+    return log_append(record, sizeof(*record));
+}
+
+size_t sample_log_peek(struct sensor_sample *out, size_t max) {
+
+    struct fcb_entry loc;
+    size_t n = 0;
+
+    if (!logReady) {
+        return 0;
+    }
+
+    k_mutex_lock(&logLock, K_FOREVER);
+
+    loc = readLoc;
+    while (n < max && stats.pending > 0 && fcb_getnext(&logFcb, &loc) == 0) {
+        if (!log_unreplayed(&loc)) {
+            continue;
+        }
+        // samples after a flux record wait until it is sent
+        if (loc.fe_data_len != sizeof(out[n])) {
+            break;
+        }
+        if (log_read_entry(&loc, &out[n], sizeof(out[n]))) {
+            n++;
+        }
+    }
+
+    k_mutex_unlock(&logLock);
+
+    return n;
+}
+
+int sample_log_peek_flux(struct flux_record *record) {
+
+    struct fcb_entry loc;
+    int rc = -ENOENT;
+
+    if (!logReady) {
+        return -ENOENT;
+    }
+
+    k_mutex_lock(&logLock, K_FOREVER);
+
+    loc = readLoc;
+    while (stats.pending > 0 && fcb_getnext(&logFcb, &loc) == 0) {
+        if (log_unreplayed(&loc)) {
+            if (log_read_entry(&loc, record, sizeof(*record))) {
+                rc = 0;
+            }
+            break;
+        }
+    }
+
+    k_mutex_unlock(&logLock);
+
+    return rc;
+}
+
+void sample_log_consume(size_t n) {
+
+    struct fcb_entry loc;
+    uint32_t seq;
+    bool rotated = false;
+
+    if (!logReady) {
+        return;
+    }
+
+    k_mutex_lock(&logLock, K_FOREVER);
+
+    loc = readLoc;
+    while (n > 0 && fcb_getnext(&logFcb, &loc) == 0) {
+        readLoc = loc;
+        if (log_read_seq(&loc, &seq) && seq >= replayedSeq) {
+            replayedSeq = seq + 1;
+            stats.replayed++;
+            stats.pending--;
+            n--;
+        }
+    }
+
+    // every sector before the read position is fully sent
+    while (readLoc.fe_sector && logFcb.f_oldest != readLoc.fe_sector) {
+        if (log_rotate()) {
+            break;
+        }
+        rotated = true;
+    }
+
+    if (stats.pending == 0 && !rotated) {
+        // remember the log is drained, or a reboot replays it again
+        log_write_mark();
+    }
+
+    k_mutex_unlock(&logLock);
+}
+
+bool sample_log_empty(void) {
+
+    return stats.pending == 0;
+}
+
+void sample_log_get_stats(struct sample_log_stats *out) {
+
+    k_mutex_lock(&logLock, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&logLock);
+}
+
+/*
+    Walk the log once to recover the sequence and replay positions
+*/
+static void sample_log_recover(void) {
+
+    struct fcb_entry loc = {0};
+    struct sample_log_mark mark;
+    uint32_t seq;
+    uint32_t maxSeq = 0;
+    bool haveEntry = false;
+
+    while (fcb_getnext(&logFcb, &loc) == 0) {
+        if (log_read_seq(&loc, &seq)) {
+            maxSeq = haveEntry ? MAX(maxSeq, seq) : seq;
+            haveEntry = true;
+        } else if (loc.fe_data_len == sizeof(mark) &&
+                   flash_area_read(logFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), &mark, sizeof(mark)) == 0) {
+            reservedSeq = MAX(reservedSeq, mark.reserved);
+            replayedSeq = MAX(replayedSeq, mark.replayed);
+        }
+    }
+
+    // everything up to the reservation may have gone out before the reboot
+    nextSeq = reservedSeq;
+    if (haveEntry) {
+        nextSeq = MAX(nextSeq, maxSeq + 1);
+    }
+    reservedSeq = nextSeq;
+    bootSeq = nextSeq;
+
+    memset(&loc, 0, sizeof(loc));
+    while (fcb_getnext(&logFcb, &loc) == 0) {
+        if (log_unreplayed(&loc)) {
+            stats.pending++;
+        }
+    }
+}
+
+static int sample_log_init(void) {
+
+    const struct flash_area *fa;
+    uint32_t sectorCount = ARRAY_SIZE(logSectors);
+    int areaId = FIXED_PARTITION_ID(samplelog_partition);
+    int rc;
+
+    rc = flash_area_get_sectors(areaId, &sectorCount, logSectors);
+    if (rc) {
+        LOG_ERR("Error %d: sample log partition layout", rc);
+        return 0;
+    }
+
+    logFcb.f_magic = SAMPLE_LOG_MAGIC;
+    logFcb.f_version = SAMPLE_LOG_VERSION;
+    logFcb.f_sector_cnt = sectorCount;
+    logFcb.f_scratch_cnt = 0;
+    logFcb.f_sectors = logSectors;
+
+    rc = fcb_init(areaId, &logFcb);
+    if (rc) {
+        // foreign or older contents - start over
+        LOG_WRN("Error %d: sample log unreadable, erasing", rc);
+        if (flash_area_open(areaId, &fa) == 0) {
+            flash_area_erase(fa, 0, fa->fa_size);
+            flash_area_close(fa);
+        }
+        rc = fcb_init(areaId, &logFcb);
+    }
+    if (rc) {
+        LOG_ERR("Error %d: sample log disabled", rc);
+        return 0;
+    }
+
+    sample_log_recover();
+    logReady = true;
+
+    LOG_INF("Sample log: %u sectors, %u entries to replay, next seq %u",
+        sectorCount, stats.pending, nextSeq);
+
+    return 0;
+}
+
+SYS_INIT(sample_log_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,69 @@
+/**
+ ************************************************************************
+ * @file inc/sample_log.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the flash store-and-forward sample log
+ **********************************************************************
+ * */
+
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H
+
+#include <zephyr/kernel.h>
+#include "sample_ring.h"
+#include "flux.h"
+
+// FCB sectors on samplelog_partition (esp32.overlay), 4 KiB each
+#define SAMPLE_LOG_MAX_SECTORS          64
+// sequence numbers are reserved in blocks so a reboot never reuses one
+#define SAMPLE_LOG_SEQ_BLOCK            256
+// pace of replayed publishes once the uplink is back
+#define SAMPLE_LOG_REPLAY_INTERVAL_MS   250
+
+struct sample_log_stats {
+    uint32_t pending;       // logged samples and flux records not replayed yet
+    uint32_t appended;
+    uint32_t fluxAppended;  // of the appended, flux records
+    uint32_t replayed;
+    uint32_t dropped;       // unreplayed entries lost to a full log
+    uint32_t errors;        // failed flash operations
+    uint32_t appendMaxUs;   // slowest append, sector erase included
+    uint64_t appendTotalUs;
+};
+
+/*
+    Next sequence number, for samples and flux records alike. Numbers
+    increase across reboots, so the backend can drop replayed entries it
+    already has.
+*/
+uint32_t sample_log_next_seq(void);
+
+/*
+    First sequence number of this boot. Logged samples below it were taken
+    before the reboot, their uptime can't be mapped to UTC any more.
+*/
+uint32_t sample_log_boot_seq(void);
+
+/*
+    Uplink thread: store a sample or flux record while the uplink is down,
+    in sequence number order. When the log is full the oldest sector is
+    dropped.
+*/
+int sample_log_append(const struct sensor_sample *sample);
+int sample_log_append_flux(const struct flux_record *record);
+
+/*
+    Replay side, in log order. peek copies up to max of the oldest
+    unreplayed samples, stopping at a flux record; peek_flux copies the
+    oldest unreplayed entry if it is a flux record, -ENOENT otherwise.
+    consume marks n entries of either kind as sent.
+*/
+size_t sample_log_peek(struct sensor_sample *out, size_t max);
+int sample_log_peek_flux(struct flux_record *record);
+void sample_log_consume(size_t n);
+
+bool sample_log_empty(void);
+void sample_log_get_stats(struct sample_log_stats *stats);
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ ************************************************************************
+ * @file inc/sample_ring.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Single-producer/single-consumer ring of timestamped sensor samples
+ *
+ * head is only written by the producer and tail only by the consumer, both
+ * free-running, so neither side needs a lock. Zephyr atomics are full
+ * barriers: the slot is written before head moves past it and read before
+ * tail moves past it.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include "sample_ring.h"
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SAMPLE_RING_SIZE), "SAMPLE_RING_SIZE must be a power of two");
+
+#define SAMPLE_RING_MASK    (SAMPLE_RING_SIZE - 1)
+
+static struct sensor_sample ring[SAMPLE_RING_SIZE];
+static atomic_t head = ATOMIC_INIT(0);
+static atomic_t tail = ATOMIC_INIT(0);
+static atomic_t highWater = ATOMIC_INIT(0);
+static atomic_t overflows = ATOMIC_INIT(0);
+
+
+bool sample_ring_put(const struct sensor_sample *sample) {
+
+    uint32_t h = (uint32_t)atomic_get(&head);
+    uint32_t used = h - (uint32_t)atomic_get(&tail);
+
+    if (used >= SAMPLE_RING_SIZE) {
+        atomic_inc(&overflows);
+        return false;
+    }
+
+    ring[h & SAMPLE_RING_MASK] = *sample;
+    atomic_set(&head, (atomic_val_t)(h + 1));
+
+    if (used + 1 > (uint32_t)atomic_get(&highWater)) {
+        atomic_set(&highWater, (atomic_val_t)(used + 1));
+    }
+
+    return true;
+}
+
+size_t sample_ring_peek(struct sensor_sample *out, size_t max) {
+
+    uint32_t t = (uint32_t)atomic_get(&tail);
+    size_t n = MIN((uint32_t)atomic_get(&head) - t, max);
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ring[(t + i) & SAMPLE_RING_MASK];
+    }
+
+    return n;
+}
+
+void sample_ring_consume(size_t n) {
+
+    uint32_t t = (uint32_t)atomic_get(&tail);
+
+    n = MIN((uint32_t)atomic_get(&head) - t, n);
+    atomic_set(&tail, (atomic_val_t)(t + n));
+}
+
+size_t sample_ring_get(struct sensor_sample *out, size_t max) {
+
+    size_t n = sample_ring_peek(out, max);
+
+    sample_ring_consume(n);
+
+    return n;
+}
+
+size_t sample_ring_count(void) {
+
+    return (uint32_t)atomic_get(&head) - (uint32_t)atomic_get(&tail);
+}
+
+void sample_ring_get_stats(struct sample_ring_stats *stats) {
+
+    stats->count = sample_ring_count();
+    stats->highWater = (uint32_t)atomic_get(&highWater);
+    stats->overflows = (uint32_t)atomic_get(&overflows);
+}
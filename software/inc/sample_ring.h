@@ -0,0 +1,56 @@
+/**
+ ************************************************************************
+ * @file inc/sample_ring.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Single-producer/single-consumer ring of timestamped sensor samples
+ **********************************************************************
+ * */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <zephyr/kernel.h>
+
+// must be a power of two
+#define SAMPLE_RING_SIZE    64
+
+// fixed-point sample fields, value = field / 10^decimals
+#define SAMPLE_CO2_DECIMALS             2
+#define SAMPLE_TEMPERATURE_DECIMALS     3
+#define SAMPLE_HUMIDITY_DECIMALS        3
+
+struct sensor_sample {
+    int64_t timestamp;      // k_uptime_get() at read-out, ms
+    int64_t utc;            // timesync_utc() of timestamp, 0 until the clock is synced
+    uint32_t seq;           // sample_log_next_seq(), for deduplication
+    int32_t co2;            // centi-ppm
+    int32_t temperature;    // milli-degrees Celsius
+    int32_t humidity;       // milli-%RH
+};
+
+struct sample_ring_stats {
+    uint32_t count;         // samples waiting
+    uint32_t highWater;     // most samples ever waiting at once
+    uint32_t overflows;     // samples dropped because the ring was full
+};
+
+/*
+    Producer side (sensor thread). Returns false and counts an overflow
+    if the consumer has fallen a full ring behind.
+*/
+bool sample_ring_put(const struct sensor_sample *sample);
+
+/*
+    Consumer side (uplink thread). peek copies up to max of the oldest
+    samples without removing them, consume drops n of them once they are
+    sent, get does both.
+*/
+size_t sample_ring_peek(struct sensor_sample *out, size_t max);
+void sample_ring_consume(size_t n);
+size_t sample_ring_get(struct sensor_sample *out, size_t max);
+
+size_t sample_ring_count(void);
+void sample_ring_get_stats(struct sample_ring_stats *stats);
+
+#endif
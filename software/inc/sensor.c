@@ -10,6 +10,7 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
 #include <stdio.h>
 #include <zephyr/logging/log.h>
 
@@ -17,23 +18,185 @@
 #include "sensirion_common.h"
 #include "sensor.h"
 #include "motor.h"
+#include "flux.h"
+#include "batch.h"
+#include "uplink.h"
+#include "sample_log.h"
+#include "timesync.h"
 
 LOG_MODULE_REGISTER(soil_respiration_sensor);
 
 #define SCD30_ALIAS     DT_ALIAS(i2c_0)
+#define SCD30_RDY_NODE  DT_ALIAS(scd30_rdy)
 
-float sensorData[3];
-bool sensorTransmit = false;
+#define SENSOR_INTERVAL_SEC         5
+#define SENSOR_IDLE_SLEEP_MS        5000
+// polled fallback: sleep this long before the next sample is due, then poll
+#define SENSOR_POLL_LEAD_MS         500
+#define SENSOR_POLL_INTERVAL_MS     250
 
+#if DT_NODE_HAS_STATUS(SCD30_RDY_NODE, okay)
+#define SENSOR_HAS_RDY_PIN  1
+static const struct gpio_dt_spec rdyPin = GPIO_DT_SPEC_GET(SCD30_RDY_NODE, gpios);
+static struct gpio_callback rdyCallback;
+#else
+#define SENSOR_HAS_RDY_PIN  0
+#endif
+
+static K_SEM_DEFINE(dataReadySem, 0, 1);
+
+// measurement read queued on the I2C engine, finished in sensor_read_done()
+static struct sensirion_i2c_txn readTxn;
+static uint8_t readData[SCD30_MEASUREMENT_BYTES];
+static atomic_t readPending;
+static uint32_t readTransfers;
+
+// a finished read, decoded on the engine queue and taken by the thread
+struct sensor_read {
+    struct sensor_sample sample;
+    int16_t result;
+};
+
+// one read is in flight at a time and the thread takes it before the next
+static K_MSGQ_DEFINE(readMsgq, sizeof(struct sensor_read), 1, 4);
+
+#if SENSOR_HAS_RDY_PIN
+/*
+    RDY pin ISR - wake the sensor thread
+*/
+static void scd30_rdy_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins) {
+    k_sem_give(&dataReadySem);
+}
+#endif
+
+/*
+    Configure the SCD30 RDY pin as an interrupt, returns false to use polling
+*/
+static bool scd30_rdy_init(void) {
+#if SENSOR_HAS_RDY_PIN
+    int ret;
+
+    if (!gpio_is_ready_dt(&rdyPin)) {
+        LOG_WRN("RDY pin not ready, polling data ready");
+        return false;
+    }
+
+    ret = gpio_pin_configure_dt(&rdyPin, GPIO_INPUT);
+    if (ret == 0) {
+        ret = gpio_pin_interrupt_configure_dt(&rdyPin, GPIO_INT_EDGE_TO_ACTIVE);
+    }
+    if (ret != 0) {
+        LOG_WRN("Error %d: failed to configure RDY pin, polling data ready", ret);
+        return false;
+    }
+
+    gpio_init_callback(&rdyCallback, scd30_rdy_isr, BIT(rdyPin.pin));
+    gpio_add_callback(rdyPin.port, &rdyCallback);
+    LOG_INF("SCD30 RDY interrupt on %s pin %d", rdyPin.port->name, rdyPin.pin);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+    Wait for the SCD30 to have a measurement ready. With the RDY pin this
+    sleeps until the interrupt fires; otherwise data ready is polled over I2C.
+*/
+static bool scd30_wait_data_ready(bool useRdyPin, int32_t timeoutMs, const struct device *i2cDev) {
+    uint16_t dataReady = 0;
+    int64_t deadline = k_uptime_get() + timeoutMs;
+
+#if SENSOR_HAS_RDY_PIN
+    if (useRdyPin) {
+        // RDY stays high until the buffer is read, so a level check covers a
+        // missed edge - unless the read is still queued
+        k_sem_reset(&dataReadySem);
+        if (!atomic_get(&readPending) && gpio_pin_get_dt(&rdyPin) > 0) {
+            return true;
+        }
+        return k_sem_take(&dataReadySem, K_MSEC(timeoutMs)) == 0;
+    }
+#endif
+
+    while (1) {
+        if (scd30_get_data_ready(&dataReady, i2cDev) == NO_ERROR && dataReady) {
+            return true;
+        }
+        if (k_uptime_get() >= deadline) {
+            return false;
+        }
+        k_msleep(SENSOR_POLL_INTERVAL_MS);
+    }
+}
+
+/*
+    Measurement read completed, on the I2C engine's work queue. That queue
+    serves every transfer on the bus, so only decode here and leave the
+    rest to the sensor thread.
+*/
+static void sensor_read_done(int16_t result, void *user_data) {
+
+    struct sensor_read read = {.result = result};
+
+    if (result == NO_ERROR) {
+        scd30_measurement_fixed(readData, &read.sample.co2, &read.sample.temperature,
+                                &read.sample.humidity);
+        read.sample.timestamp = k_uptime_get();
+    }
+    k_msgq_put(&readMsgq, &read, K_NO_WAIT);
+    // readData is free for the next read
+    atomic_clear(&readPending);
+    k_sem_give(&dataReadySem);
+}
+
+/*
+    Take a finished read, if there is one: stamp it and hand it to the
+    flux calculation and the uplink. Returns false if none was waiting.
+*/
+static bool sensor_take_read(void) {
+
+    struct sensor_read read;
+    struct sensor_sample *sample = &read.sample;
+
+    if (k_msgq_get(&readMsgq, &read, K_NO_WAIT) != 0) {
+        return false;
+    }
+
+    if (read.result != NO_ERROR) {
+        LOG_ERR("Error %d reading measurement", read.result);
+        return true;
+    }
+
+    sample->utc = timesync_utc(sample->timestamp);
+
+    LOG_INF("measured co2 concentration: %d centi-ppm, "
+    "measured temperature: %d milli-degreeCelsius, "
+    "measured humidity: %d milli-%%RH\r\n",
+    sample->co2, sample->temperature, sample->humidity);
+    flux_add(sample);
+    if (SENSOR_RAW_STREAMING) {
+        sample->seq = sample_log_next_seq();
+        if (!sample_ring_put(sample)) {
+            LOG_WRN("sample ring full, uplink behind - sample dropped");
+        } else if (batch_ready()) {
+            uplink_notify();
+        }
+    }
+    LOG_DBG("I2C transfers for sample: %u",
+        sensirion_i2c_get_transfer_count() - readTransfers);
+
+    return true;
+}
 
 void thread_sensor_entry(void) {
 
     // variables
-    float co2, temperature, relativeHumidity;
     int16_t err;
-    uint16_t dataReady, ver;
-    uint16_t intervalSeconds = 5;
-    uint16_t timeout = 0;
+    uint16_t ver;
+    uint16_t intervalSeconds = SENSOR_INTERVAL_SEC;
+    bool useRdyPin;
 
 
     //i2c dev
@@ -48,6 +211,8 @@ void thread_sensor_entry(void) {
     scd30_get_driver_version(&ver, i2cDev);
     printk("Device ready. Firmware Version: %d\r\n", ver);
 
+    useRdyPin = scd30_rdy_init();
+
     //k_msleep(25000);
     // set measurment interval - 2 seconds
     scd30_set_measurement_interval(intervalSeconds, i2cDev);
@@ -55,25 +220,33 @@ void thread_sensor_entry(void) {
     scd30_start_periodic_measurement(0, i2cDev);
 
     while(1) {
+        sensor_take_read();
         if (state == SENSING){
-            scd30_get_data_ready(&dataReady, i2cDev);
-
-            
-            if (dataReady) {
-                //get co2
-                err = scd30_read_measurement(&sensorData[0], &sensorData[1], &sensorData[2], i2cDev);
-                if (err != NO_ERROR) {
-                    LOG_ERR("error reading measurement\r\n");
+            if (scd30_wait_data_ready(useRdyPin, 2 * intervalSeconds * MSEC_PER_SEC, i2cDev)) {
+                // a finished read wakes the wait as well, take it and wait again
+                if (sensor_take_read()) {
+                    continue;
+                }
+                // queue the read and go back to waiting, sensor_read_done() decodes it
+                if (!atomic_cas(&readPending, 0, 1)) {
+                    LOG_WRN("previous read still queued, sample skipped");
                 } else {
-                    LOG_INF("measured co2 concentration: %0.2f ppm, "
-                    "measured temperature: %0.2f degreeCelsius, "
-                    "measured humidity: %0.2f %%RH\r\n",
-                    sensorData[0], sensorData[1], sensorData[2]);
-                    sensorTransmit = true;
+                    readTransfers = sensirion_i2c_get_transfer_count();
+                    err = scd30_read_measurement_submit(&readTxn, readData, sensor_read_done,
+                                                        NULL, i2cDev);
+                    if (err != NO_ERROR) {
+                        atomic_clear(&readPending);
+                        LOG_ERR("Error %d queueing measurement read", err);
+                    }
+                }
+
+                if (!useRdyPin) {
+                    // nothing new until the next interval - don't hammer the bus
+                    k_msleep(intervalSeconds * MSEC_PER_SEC - SENSOR_POLL_LEAD_MS);
                 }
             }
         } else {
-            k_msleep(5000);
+            k_msleep(SENSOR_IDLE_SLEEP_MS);
         }
         /*
         else if (state == SENSING_END) {
@@ -83,13 +256,13 @@ void thread_sensor_entry(void) {
             scd30_start_periodic_measurement(0, i2cDev);
             k_msleep(4000);
         }*/
-        
 
-        
+
+
 
     }
 
 
 
-    
-}
\ No newline at end of file
+
+}
@@ -10,10 +10,12 @@
 #ifndef SENSOR_H
 #define SENSOR_H
 
-void thread_sensor_entry(void);
+#include "sample_ring.h"
+
+// 1 - also queue every raw sample for the uplink, 0 - per-cycle flux only
+#define SENSOR_RAW_STREAMING    0
 
+void thread_sensor_entry(void);
 
-extern float sensorData[3];
-extern bool sensorTransmit;
 
 #endif
\ No newline at end of file
@@ -4,6 +4,10 @@
  * @author Thomas Salpietro 45822490
  * @date 02/04/2023
  * @brief Contains source code for the sockets driver for http
+ *
+ * The HTTP uplink transport: one HTTP/1.1 connection kept open between
+ * pushes and opened again only when a push needs it. Each POST carries one
+ * JSON array from the uplink thread, a batch of samples or a flux record.
  **********************************************************************
  * */
 
@@ -18,11 +22,13 @@ LOG_MODULE_DECLARE(soil_respiration, LOG_LEVEL_DBG);
 #include <zephyr/net/http/client.h>
 #include <zephyr/random/rand32.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <zephyr/kernel.h>
 
 #include "sockets.h"
 #include "wifi.h"
-#include "sensor.h"
+#include "dns_cache.h"
+#include "uplink.h"
 
 #define TAGOIO_SERVER 				"75.2.65.153"
 //#define TAGOIO_SERVER				"api.tago.io"
@@ -32,83 +38,70 @@ LOG_MODULE_DECLARE(soil_respiration, LOG_LEVEL_DBG);
 #define HTTP_PORT           		"80"
 #define DEVICE_TOKEN				"bed51d18-2744-4e8d-8959-232ab7ff5730"
 #define HTTP_CONN_TIMEOUT			10
-#define HTTP_PUSH_INTERVAL			10
 
-static struct tagoio_context ctx;
+static struct tagoio_context ctx = {
+	.sock = -1,
+};
+
+static K_SEM_DEFINE(httpWake, 0, 1);
+static struct http_uplink_stats stats;
+static struct uplink_status wire;
+// back off after a failed push, spooling to flash meanwhile
+static int64_t retryAt;
 
 static const char *tagoio_http_headers[] = {
 	"Device-Token: bed51d18-2744-4e8d-8959-232ab7ff5730\r\n",
 	"Content-Type: application/json\r\n",
+	"Connection: keep-alive\r\n",
 	"_ssl: false\r\n",
 	NULL
 };
 
 int tagoio_connect(struct tagoio_context *ctx)
 {
-	struct addrinfo *addr;
-	struct addrinfo hints;
-	char hr_addr[INET6_ADDRSTRLEN];
-	char *port;
-	int dns_attempts = 3;
-	int ret = -1;
-
-	memset(&hints, 0, sizeof(hints));
-
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
-	if (IS_ENABLED(CONFIG_NET_IPV6)) {
-		hints.ai_family = AF_INET6;
-	} else if (IS_ENABLED(CONFIG_NET_IPV4)) {
-		hints.ai_family = AF_INET;
-	}
-	port = HTTP_PORT;
-
-	while (dns_attempts--) {
-		ret = getaddrinfo(TAGOIO_SERVER, port, &hints, &addr);
-		if (ret == 0) {
-			break;
-		}
-		k_sleep(K_SECONDS(1));
-	}
+	struct sockaddr_in addr;
+	char hr_addr[INET_ADDRSTRLEN];
+	int ret;
 
+	// cached, the resolver is only asked again when the entry is stale
+	ret = dns_cache_lookup(TAGOIO_SERVER, atoi(HTTP_PORT), &addr);
 	if (ret < 0) {
 		LOG_ERR("Could not resolve dns, error: %d", ret);
 		return ret;
 	}
 
-	LOG_DBG("%s address: %s",
-		(addr->ai_family == AF_INET ? "IPv4" : "IPv6"),
-		net_addr_ntop(addr->ai_family,
-			      &net_sin(addr->ai_addr)->sin_addr,
-			      hr_addr, sizeof(hr_addr)));
+	LOG_DBG("IPv4 address: %s",
+		net_addr_ntop(AF_INET, &addr.sin_addr, hr_addr, sizeof(hr_addr)));
 
-	ctx->sock = socket(hints.ai_family,
-			   hints.ai_socktype,
-			   hints.ai_protocol);
+	ctx->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (ctx->sock < 0) {
-		LOG_ERR("Failed to create %s HTTP socket (%d)",
-			(addr->ai_family == AF_INET ? "IPv4" : "IPv6"),
-			-errno);
-
-		freeaddrinfo(addr);
+		LOG_ERR("Failed to create IPv4 HTTP socket (%d)", -errno);
 		return -errno;
 	}
 
-	if (connect(ctx->sock, addr->ai_addr, addr->ai_addrlen) < 0) {
-		LOG_ERR("Cannot connect to %s remote (%d)",
-			(addr->ai_family == AF_INET ? "IPv4" : "IPv6"),
-			-errno);
-
-		freeaddrinfo(addr);
-		return -errno;
+	if (connect(ctx->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ret = -errno;
+		LOG_ERR("Cannot connect to IPv4 remote (%d)", ret);
+		close(ctx->sock);
+		ctx->sock = -1;
+		dns_cache_invalidate(TAGOIO_SERVER);
+		return ret;
 	}
 
-	freeaddrinfo(addr);
+	stats.connects++;
 
 	return 0;
 }
 
-int tagoio_http_push(struct tagoio_context *ctx,
+void tagoio_close(struct tagoio_context *ctx)
+{
+	if (ctx->sock >= 0) {
+		close(ctx->sock);
+		ctx->sock = -1;
+	}
+}
+
+int tagoio_http_push(struct tagoio_context *ctx, const uint8_t *payload, size_t len,
 		     http_response_cb_t resp_cb)
 {
 	struct http_request req;
@@ -123,97 +116,207 @@ int tagoio_http_push(struct tagoio_context *ctx,
 	req.header_fields	= tagoio_http_headers;
 	req.protocol		= "HTTP/1.1";
 	req.response		= resp_cb;
-	req.payload		= ctx->payload;
-	req.payload_len		= strlen(ctx->payload);
+	req.payload		= payload;
+	req.payload_len		= len;
 	req.recv_buf		= ctx->resp;
 	req.recv_buf_len	= sizeof(ctx->resp);
 
+	ctx->status = 0;
+	ctx->received = 0;
 	ret = http_client_req(ctx->sock, &req,
 			      HTTP_CONN_TIMEOUT * MSEC_PER_SEC,
 			      ctx);
+	if (ret < 0) {
+		return ret;
+	}
 
-	close(ctx->sock);
-	ctx->sock = -1;
+	// the response ends with the message, the connection stays up
+	if (ctx->status < 200 || ctx->status >= 300) {
+		return -EBADMSG;
+	}
+	ctx->lastUsed = k_uptime_get();
 
-	return ret;
+	return 0;
 }
 
-
-
-
 static void response_cb(struct http_response *rsp,
 			enum http_final_call final_data,
 			void *user_data)
 {
+	struct tagoio_context *ctx = user_data;
+
+	ctx->received += rsp->data_len;
+
 	if (final_data == HTTP_DATA_MORE) {
 		LOG_DBG("Partial data received (%zd bytes)", rsp->data_len);
 	} else if (final_data == HTTP_DATA_FINAL) {
 		LOG_DBG("All the data received (%zd bytes)", rsp->data_len);
+		ctx->status = rsp->http_status_code;
 	}
 
 	LOG_DBG("Response status %s", rsp->http_status);
 }
 
-static int collect_data(void)
+/*
+    Request line and headers as http_client_req() sends them
+*/
+static size_t http_request_overhead(size_t len)
 {
-	#define lower 20000
-	#define upper 100000
-	#define base  1000.00f
+	size_t n = strlen("POST " TAGOIO_URL " HTTP/1.1\r\n") +
+		   strlen("Host: " TAGOIO_SERVER "\r\n") + strlen("\r\n");
+
+	for (int i = 0; tagoio_http_headers[i]; i++) {
+		n += strlen(tagoio_http_headers[i]);
+	}
 
-	float temp;
+	return n + snprintf(NULL, 0, "Content-Length: %zu\r\n", len);
+}
 
-	/* Generate a temperature between 20 and 100 celsius degree */
-	/* SWAP THESE TWO LINES WITH GET FROM QUEUE OR SOMETHING*/
-	//temp = ((sys_rand32_get() % (upper - lower + 1)) + lower);
-	//temp /= base;
+/*
+    POST one payload, on the open connection if there is one. A kept
+    connection the server has dropped since gets one more go on a new one.
+*/
+static int http_post(const uint8_t *payload, size_t len)
+{
+	bool reused;
+	int ret;
 
+	// most servers drop idle keep-alive connections, don't find out the slow way
+	if (ctx.sock >= 0 && k_uptime_get() - ctx.lastUsed > HTTP_IDLE_CLOSE_MS) {
+		tagoio_close(&ctx);
+	}
 
-	(void)snprintf(ctx.payload, sizeof(ctx.payload),
-		       "{\"variable\": \"co2\","
-		       "\"unit\": \"ppm\",\"value\": %f}",
-		       (double)sensorData[0]);
+	for (int attempt = 0; attempt < 2; attempt++) {
+		reused = (ctx.sock >= 0);
+		if (!reused) {
+			ret = tagoio_connect(&ctx);
+			if (ret < 0) {
+				return ret;
+			}
+		}
 
-	/* LOG doesn't print float #18351 */
-	LOG_INF("CO2: %d", (int) sensorData[0]);
+		ret = tagoio_http_push(&ctx, payload, len, response_cb);
+		wire.overheadBytes += http_request_overhead(len) + ctx.received;
+		if (ret == 0) {
+			stats.reused += reused;
+			return 0;
+		}
 
-	return 0;
+		LOG_WRN("HTTP push failed (%d, status %d)", ret, ctx.status);
+		tagoio_close(&ctx);
+		if (!reused || ret == -EBADMSG) {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/*
+    4xx other than timeout and rate limit won't get better by resending
+*/
+static bool http_rejected(int ret)
+{
+	return ret == -EBADMSG && ctx.status >= 400 && ctx.status < 500 &&
+	       ctx.status != 408 && ctx.status != 429;
+}
+
+static void http_wifi_changed(uint32_t events)
+{
+	k_sem_give(&httpWake);
+}
+
+static struct wifi_listener wifiListener = {
+	.handler = http_wifi_changed,
+};
+
+static void http_transport_init(void)
+{
+	LOG_INF("TagoIO IoT - HTTP Client - Soil Respiration");
+
+	wifi_add_listener(&wifiListener);
 }
 
-static void next_turn(void)
+// nothing to set up ahead of time, the first push opens the connection
+static void http_transport_connect(void)
 {
-	if (collect_data() < 0) {
-		LOG_INF("Error collecting data.");
-		return;
+}
+
+static int http_transport_send(enum uplink_payload kind, const uint8_t *payload, size_t len)
+{
+	int ret = http_post(payload, len);
+
+	if (ret == 0) {
+		wire.sends++;
+		wire.payloadBytes += len;
+		return 0;
 	}
 
-	if (tagoio_connect(&ctx) < 0) {
-		LOG_INF("No connection available.");
-		return;
+	if (http_rejected(ret)) {
+		LOG_ERR("Server rejected the %s payload (status %d), dropped",
+			kind == UPLINK_FLUX ? "flux" : "sample", ctx.status);
+		stats.rejected++;
+		return -EBADMSG;
 	}
 
-	if (tagoio_http_push(&ctx, response_cb) < 0) {
-		LOG_INF("Error pushing data.");
-		return;
+	stats.failures++;
+	retryAt = k_uptime_get() + HTTP_RETRY_MS;
+
+	return ret;
+}
+
+static int http_transport_poll(int64_t until)
+{
+	int64_t now = k_uptime_get();
+	int64_t deadline = until;
+
+	// the back off ends on its own, the uplink is waiting for it
+	if (retryAt > now && retryAt < deadline) {
+		deadline = retryAt;
+	}
+
+	if (k_sem_take(&httpWake, (deadline == INT64_MAX) ? K_FOREVER :
+		       K_MSEC(MAX(deadline - now, 0))) == 0) {
+		return 1;
 	}
+
+	return (k_uptime_get() >= until) ? 0 : 1;
 }
 
-void thread_http_entry(void)
+static void http_transport_wake(void)
 {
-	LOG_INF("TagoIO IoT - HTTP Client - Soil Respiration");
+	k_sem_give(&httpWake);
+}
 
-	
+static void http_transport_status(struct uplink_status *status)
+{
+	*status = wire;
+	status->connected = wifi_is_ready() && k_uptime_get() >= retryAt;
+	// a push is finished before send() returns
+	status->inFlight = 0;
+	status->connects = stats.connects;
+}
 
-	while (true) {
-		printk("SEMAPHORE COUNT: %d\r\n", k_sem_count_get(&wifiSem));
-		if (k_sem_count_get(&wifiSem) ==  0) {
-			//semaphore taken: wifi connected
-			next_turn();
-		} else {
-			continue;
-		}
-		
+static void http_transport_report(void)
+{
+	LOG_INF("HTTP: %u connects, %u reused, %u rejected, %u failures",
+		stats.connects, stats.reused, stats.rejected, stats.failures);
+}
 
-		k_sleep(K_SECONDS(HTTP_PUSH_INTERVAL));
-	}
+void http_get_stats(struct http_uplink_stats *out)
+{
+	*out = stats;
 }
 
+const struct uplink_transport_api http_transport = {
+	.name = "http",
+	.encoding = UPLINK_ENCODING_JSON,
+	.maxPayload = UPLINK_PAYLOAD_MAX,
+	.init = http_transport_init,
+	.connect = http_transport_connect,
+	.send = http_transport_send,
+	.poll = http_transport_poll,
+	.wake = http_transport_wake,
+	.status = http_transport_status,
+	.report = http_transport_report,
+};
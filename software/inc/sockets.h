@@ -11,18 +11,35 @@
 #ifndef HTTP_H
 #define HTTP_H
 
-#define TAGOIO_SOCKET_MAX_BUF_LEN 1280
+#include <zephyr/kernel.h>
+#include <zephyr/net/http/client.h>
+
+#define TAGOIO_RESP_MAX_BUF_LEN		1280
+// close the kept connection before the server would, most allow 60 s idle
+#define HTTP_IDLE_CLOSE_MS		50000
+// after a failed push
+#define HTTP_RETRY_MS			10000
 
 struct tagoio_context {
 	int sock;
-	uint8_t payload[TAGOIO_SOCKET_MAX_BUF_LEN];
-	uint8_t resp[TAGOIO_SOCKET_MAX_BUF_LEN];
+	int status;		// HTTP status of the last response
+	int64_t lastUsed;	// uptime of the last good response
+	size_t received;	// response bytes, headers included
+	uint8_t resp[TAGOIO_RESP_MAX_BUF_LEN];
+};
+
+struct http_uplink_stats {
+	uint32_t connects;	// TCP handshakes
+	uint32_t reused;	// pushes on a kept connection
+	uint32_t rejected;	// 4xx, dropped
+	uint32_t failures;
 };
 
 int tagoio_connect(struct tagoio_context *ctx);
-int tagoio_http_push(struct tagoio_context *ctx,
+void tagoio_close(struct tagoio_context *ctx);
+int tagoio_http_push(struct tagoio_context *ctx, const uint8_t *payload, size_t len,
 		     http_response_cb_t resp_cb);
 
-void thread_http_entry(void);
+void http_get_stats(struct http_uplink_stats *stats);
 
 #endif
@@ -0,0 +1,225 @@
+/**
+ ************************************************************************
+ * @file inc/timesync.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for SNTP time synchronisation
+ *
+ * Queries run on their own work queue, started by the wifi listener and
+ * repeated every TIMESYNC_INTERVAL_MS. Each answer becomes the reference
+ * point of the uptime -> UTC mapping; the correction it needed over the
+ * time since the previous one gives the drift of the uptime clock.
+ **********************************************************************
+ * */
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/net/sntp.h>
+#include <zephyr/logging/log.h>
+#include "timesync.h"
+#include "dns_cache.h"
+#include "wifi.h"
+
+LOG_MODULE_REGISTER(timesync);
+
+// one SNTP answer, utcMs 0 = none yet
+static struct timesync_ref {
+    int64_t uptimeMs;
+    int64_t utcMs;
+} ref;
+
+static int32_t driftPpb;
+static int64_t nextSyncAt;
+static struct timesync_stats stats;
+static K_MUTEX_DEFINE(timeLock);
+
+static K_THREAD_STACK_DEFINE(timeStack, TIMESYNC_STACK_SIZE);
+static struct k_work_q timeQueue;
+
+static void timesync_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(syncWork, timesync_handler);
+
+// UTC at uptimeMs from the reference. Call with timeLock held.
+static int64_t timesync_map(int64_t uptimeMs) {
+
+    int64_t elapsed = uptimeMs - ref.uptimeMs;
+
+    return ref.utcMs + elapsed + elapsed * driftPpb / 1000000000;
+}
+
+/*
+    One SNTP exchange. The server read its clock somewhere in the round
+    trip; the middle of it is taken as the matching uptime.
+*/
+static int timesync_query(int64_t *uptimeMs, int64_t *utcMs, uint32_t *rttMs) {
+
+    struct sockaddr_in addr;
+    struct sntp_ctx ctx;
+    struct sntp_time time;
+    int64_t sentAt, answeredAt;
+    int rc;
+
+    rc = dns_cache_lookup(TIMESYNC_SERVER, TIMESYNC_PORT, &addr);
+    if (rc) {
+        return rc;
+    }
+
+    rc = sntp_init(&ctx, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc) {
+        return rc;
+    }
+    sentAt = k_uptime_get();
+    rc = sntp_query(&ctx, TIMESYNC_TIMEOUT_MS, &time);
+    answeredAt = k_uptime_get();
+    sntp_close(&ctx);
+
+    if (rc) {
+        // the pool hands out another server on the next lookup
+        dns_cache_invalidate(TIMESYNC_SERVER);
+        return rc;
+    }
+
+    *rttMs = answeredAt - sentAt;
+    *uptimeMs = sentAt + *rttMs / 2;
+    *utcMs = (int64_t)time.seconds * MSEC_PER_SEC +
+             (int64_t)(((uint64_t)time.fraction * MSEC_PER_SEC) >> 32);
+
+    return 0;
+}
+
+/*
+    Take an answer as the new reference, learning the drift from the
+    previous one. Call with timeLock held.
+*/
+static void timesync_apply(int64_t uptimeMs, int64_t utcMs, uint32_t rttMs) {
+
+    int64_t step, span, measured;
+
+    if (ref.utcMs != 0) {
+        step = utcMs - timesync_map(uptimeMs);
+        span = uptimeMs - ref.uptimeMs;
+        if (span >= TIMESYNC_DRIFT_MIN_SPAN_MS) {
+            // the rate error left over the span, on top of what was corrected
+            measured = driftPpb + step * 1000000000 / span;
+            measured = CLAMP(measured, -TIMESYNC_DRIFT_MAX_PPB, TIMESYNC_DRIFT_MAX_PPB);
+            // the first estimate stands alone, later ones are averaged in
+            driftPpb = (stats.syncs == 1) ? measured : (driftPpb + measured) / 2;
+        }
+        stats.lastStepMs = step;
+        if (llabs(step) > abs(stats.maxStepMs)) {
+            stats.maxStepMs = step;
+        }
+        LOG_INF("Resync: %lld ms step over %lld s, drift %d ppb, rtt %u ms",
+                step, span / MSEC_PER_SEC, driftPpb, rttMs);
+    } else {
+        stats.firstSyncMs = uptimeMs;
+        LOG_INF("Synced: UTC %lld ms at uptime %lld ms, rtt %u ms", utcMs, uptimeMs, rttMs);
+    }
+
+    ref.uptimeMs = uptimeMs;
+    ref.utcMs = utcMs;
+    stats.syncs++;
+    stats.lastRttMs = rttMs;
+    stats.driftPpb = driftPpb;
+}
+
+static void timesync_handler(struct k_work *work) {
+
+    int64_t uptimeMs, utcMs;
+    uint32_t rttMs = 0;
+    int64_t delay;
+    int rc;
+
+    // the wifi listener kicks us again once the network is back
+    if (!wifi_is_ready()) {
+        return;
+    }
+
+    rc = timesync_query(&uptimeMs, &utcMs, &rttMs);
+    if (rc == 0 && rttMs > TIMESYNC_MAX_RTT_MS) {
+        rc = -ETIMEDOUT;
+    }
+
+    k_mutex_lock(&timeLock, K_FOREVER);
+    if (rc == 0) {
+        timesync_apply(uptimeMs, utcMs, rttMs);
+        delay = TIMESYNC_INTERVAL_MS;
+    } else {
+        stats.failures++;
+        delay = TIMESYNC_RETRY_MS;
+    }
+    nextSyncAt = k_uptime_get() + delay;
+    k_mutex_unlock(&timeLock);
+
+    if (rc) {
+        LOG_WRN("Error %d: no time from %s, rtt %u ms", rc, TIMESYNC_SERVER, rttMs);
+    }
+
+    k_work_reschedule_for_queue(&timeQueue, &syncWork, K_MSEC(delay));
+}
+
+static void timesync_wifi_changed(uint32_t events) {
+
+    bool due;
+
+    if ((events & WIFI_EVT_READY) != WIFI_EVT_READY) {
+        return;
+    }
+
+    // the radio comes and goes with the chamber, only query when one is due
+    k_mutex_lock(&timeLock, K_FOREVER);
+    due = k_uptime_get() >= nextSyncAt;
+    k_mutex_unlock(&timeLock);
+
+    if (due) {
+        k_work_reschedule_for_queue(&timeQueue, &syncWork, K_NO_WAIT);
+    }
+}
+
+static struct wifi_listener wifiListener = {
+    .handler = timesync_wifi_changed,
+};
+
+bool timesync_synced(void) {
+
+    bool synced;
+
+    k_mutex_lock(&timeLock, K_FOREVER);
+    synced = ref.utcMs != 0;
+    k_mutex_unlock(&timeLock);
+
+    return synced;
+}
+
+int64_t timesync_utc(int64_t uptimeMs) {
+
+    int64_t utcMs = 0;
+
+    k_mutex_lock(&timeLock, K_FOREVER);
+    if (ref.utcMs != 0) {
+        utcMs = timesync_map(uptimeMs);
+    }
+    k_mutex_unlock(&timeLock);
+
+    return utcMs;
+}
+
+void timesync_get_stats(struct timesync_stats *out) {
+
+    k_mutex_lock(&timeLock, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&timeLock);
+}
+
+static int timesync_init(void) {
+
+    k_work_queue_start(&timeQueue, timeStack, K_THREAD_STACK_SIZEOF(timeStack),
+                       TIMESYNC_PRIORITY, NULL);
+    k_thread_name_set(&timeQueue.thread, "timesync");
+    wifi_add_listener(&wifiListener);
+
+    return 0;
+}
+
+SYS_INIT(timesync_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,56 @@
+/**
+ ************************************************************************
+ * @file inc/timesync.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for SNTP time synchronisation
+ *
+ * Maps uptime to UTC. Samples are stamped with uptime at read-out as
+ * before; the UTC mapping is applied as soon as one SNTP answer is in,
+ * including to samples taken before it, so the device runs the same with
+ * or without a time server.
+ **********************************************************************
+ * */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <zephyr/kernel.h>
+
+#define TIMESYNC_SERVER             "pool.ntp.org"
+#define TIMESYNC_PORT               123
+#define TIMESYNC_TIMEOUT_MS         3000
+// answers slower than this are too uncertain to use
+#define TIMESYNC_MAX_RTT_MS         1000
+// resync period once synced, and retry after a failed query
+#define TIMESYNC_INTERVAL_MS        (6 * 60 * 60 * MSEC_PER_SEC)
+#define TIMESYNC_RETRY_MS           (60 * MSEC_PER_SEC)
+// syncs closer together than this say too little about the drift
+#define TIMESYNC_DRIFT_MIN_SPAN_MS  (60 * 60 * MSEC_PER_SEC)
+// beyond any crystal, a larger estimate means a bad answer
+#define TIMESYNC_DRIFT_MAX_PPB      500000
+#define TIMESYNC_STACK_SIZE         2048
+#define TIMESYNC_PRIORITY           5
+
+struct timesync_stats {
+    uint32_t syncs;         // answers applied
+    uint32_t failures;      // no answer, or too slow
+    uint32_t lastRttMs;
+    int32_t lastStepMs;     // correction at the last resync, measured - predicted
+    int32_t maxStepMs;      // largest correction, either way
+    int32_t driftPpb;       // uptime clock rate error being corrected for
+    int64_t firstSyncMs;    // uptime of the first sync, 0 = not synced
+};
+
+// an SNTP answer has been applied since boot
+bool timesync_synced(void);
+
+/*
+    UTC (ms since the Unix epoch) at uptime uptimeMs, drift corrected.
+    Works for uptimes before the first sync too. Returns 0 until synced.
+*/
+int64_t timesync_utc(int64_t uptimeMs);
+
+void timesync_get_stats(struct timesync_stats *stats);
+
+#endif
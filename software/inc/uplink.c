@@ -0,0 +1,618 @@
+/**
+ ************************************************************************
+ * @file inc/uplink.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains source code for the uplink thread and transport selection
+ *
+ * The thread drains the flux queue, the sample ring and the flash sample
+ * log, in that order, through the transport this boot selected. While the
+ * transport is down the flux queue and the ring are spooled to the log. Only one
+ * transport runs per boot; switching saves the choice and reboots.
+ **********************************************************************
+ * */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/reboot.h>
+#include <zephyr/logging/log.h>
+#include "uplink.h"
+#include "batch.h"
+#include "flux.h"
+#include "sample_ring.h"
+#include "sample_log.h"
+#include "wifi.h"
+#include "dns_cache.h"
+#include "radio.h"
+#include "timesync.h"
+
+LOG_MODULE_REGISTER(uplink);
+
+#define UPLINK_REBOOT_DELAY_MS  1000
+
+static const char *const transportNames[UPLINK_TRANSPORTS] = {
+    [UPLINK_MQTT] = "mqtt",
+    [UPLINK_HTTP] = "http",
+    [UPLINK_LOOPBACK] = "loopback",
+    [UPLINK_MQTT_SN] = "mqtt-sn",
+};
+
+static const struct uplink_transport_api *const transports[UPLINK_TRANSPORTS] = {
+    [UPLINK_MQTT] = &mqtt_transport,
+    [UPLINK_HTTP] = &http_transport,
+    [UPLINK_LOOPBACK] = &loopback_transport,
+    [UPLINK_MQTT_SN] = &mqtt_sn_transport,
+};
+
+static uint8_t transport = UPLINK_TRANSPORT_DEFAULT;
+
+// what the next poll deadline stands for
+enum uplink_wake {
+    WAKE_NONE,
+    WAKE_BATCH_AGE,
+    WAKE_RETRY,
+    WAKE_REPLAY,
+    WAKE_REPORT,
+};
+
+static uint8_t payload[UPLINK_PAYLOAD_MAX];
+static struct uplink_stats stats;
+static int64_t retryAt;
+// next flash log batch may go out, and when the current replay run started
+static int64_t replayAt;
+static int64_t replayStart = -1;
+// the transport said -EBUSY, nothing more goes until its next poll()
+static bool blocked;
+// chamber state change not handed to api->sleep() yet, and when SLEEP ends (0 = awake)
+static bool sleepChanged;
+static int64_t sleepUntil;
+static K_MUTEX_DEFINE(sleepLock);
+
+static int uplink_settings_set(const char *name, size_t len,
+                               settings_read_cb read_cb, void *cb_arg) {
+
+    uint8_t value;
+
+    if (!settings_name_steq(name, "transport", NULL)) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(value) || read_cb(cb_arg, &value, sizeof(value)) != sizeof(value) ||
+        value >= UPLINK_TRANSPORTS) {
+        return -EINVAL;
+    }
+    transport = value;
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(uplink, "uplink", NULL, uplink_settings_set, NULL, NULL);
+
+enum uplink_transport uplink_transport(void) {
+
+    return transport;
+}
+
+const char *uplink_transport_name(enum uplink_transport t) {
+
+    return (t < UPLINK_TRANSPORTS) ? transportNames[t] : "?";
+}
+
+int uplink_transport_parse(const char *name) {
+
+    for (int i = 0; name && i < UPLINK_TRANSPORTS; i++) {
+        if (!strcmp(name, transportNames[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int uplink_select(enum uplink_transport t) {
+
+    uint8_t value = t;
+    int rc;
+
+    if (t >= UPLINK_TRANSPORTS) {
+        return -EINVAL;
+    }
+    if (t == transport) {
+        return 0;
+    }
+
+    rc = settings_save_one("uplink/transport", &value, sizeof(value));
+    if (rc) {
+        LOG_ERR("Error %d: transport not saved", rc);
+        return rc;
+    }
+
+    LOG_WRN("Uplink switching to %s, rebooting", transportNames[t]);
+    k_msleep(UPLINK_REBOOT_DELAY_MS);
+    sys_reboot(SYS_REBOOT_COLD);
+
+    return 0;
+}
+
+void uplink_notify(void) {
+
+    transports[transport]->wake();
+}
+
+static bool uplink_drained(const struct uplink_transport_api *api) {
+
+    struct uplink_status status;
+    struct flux_record record;
+
+    api->status(&status);
+
+    return !batch_ready() && flux_peek(&record) != 0 && sample_log_empty() &&
+           status.inFlight == 0;
+}
+
+bool uplink_idle(void) {
+
+    const struct uplink_transport_api *api = transports[transport];
+    bool parked;
+
+    k_mutex_lock(&sleepLock, K_FOREVER);
+    parked = !api->sleep || !sleepChanged;
+    k_mutex_unlock(&sleepLock);
+
+    return parked && uplink_drained(api);
+}
+
+void uplink_motor_state(States state, int64_t durationMs) {
+
+    const struct uplink_transport_api *api = transports[transport];
+
+    if (!api->sleep) {
+        return;
+    }
+
+    k_mutex_lock(&sleepLock, K_FOREVER);
+    sleepUntil = (state == SLEEP) ? k_uptime_get() + durationMs : 0;
+    sleepChanged = true;
+    k_mutex_unlock(&sleepLock);
+
+    api->wake();
+}
+
+/*
+    Pass a chamber state change on to the transport, a SLEEP only once
+    everything queued has gone
+*/
+static void uplink_sleep_check(const struct uplink_transport_api *api) {
+
+    int64_t until;
+    bool changed;
+
+    k_mutex_lock(&sleepLock, K_FOREVER);
+    changed = sleepChanged;
+    until = sleepUntil;
+    k_mutex_unlock(&sleepLock);
+
+    if (!changed || (until != 0 && !uplink_drained(api))) {
+        return;
+    }
+
+    k_mutex_lock(&sleepLock, K_FOREVER);
+    // a newer change waits for the next pass
+    if (sleepUntil == until) {
+        sleepChanged = false;
+    }
+    k_mutex_unlock(&sleepLock);
+
+    api->sleep(until ? MAX(until - k_uptime_get(), 1) : 0);
+}
+
+static void uplink_encode_timed(uint32_t start) {
+
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    stats.encodeMaxUs = MAX(stats.encodeMaxUs, us);
+    stats.encodeTotalUs += us;
+}
+
+int uplink_encode_samples(enum uplink_encoding encoding, uint8_t *buf, size_t len,
+                          const struct sensor_sample *samples, size_t n, size_t *count) {
+
+    if (encoding == UPLINK_ENCODING_JSON) {
+        return encode_samples_json(buf, len, samples, n, count);
+    }
+
+    return batch_encode_samples(buf, len, samples, n, count);
+}
+
+int uplink_encode_flux(enum uplink_encoding encoding, uint8_t *buf, size_t len,
+                       const struct flux_record *record) {
+
+    if (encoding == UPLINK_ENCODING_JSON) {
+        return encode_flux_json(buf, len, record);
+    }
+
+    return encode_flux_text(buf, len, record);
+}
+
+/*
+    Samples taken before the first sync get their UTC time once there is
+    one. Only those of this boot: uptime from before a reboot maps to nothing.
+*/
+static void uplink_stamp_samples(struct sensor_sample *samples, size_t n) {
+
+    uint32_t bootSeq = sample_log_boot_seq();
+
+    for (size_t i = 0; i < n; i++) {
+        if (samples[i].utc == 0 && samples[i].seq >= bootSeq) {
+            samples[i].utc = timesync_utc(samples[i].timestamp);
+        }
+    }
+}
+
+static void uplink_stamp_flux(struct flux_record *record) {
+
+    if (record->startUtc == 0 && record->seq >= sample_log_boot_seq()) {
+        record->startUtc = timesync_utc(record->start);
+    }
+}
+
+/*
+    Hand one payload to the transport. Returns 0 once it is gone, for good
+    or refused, otherwise it stays queued.
+*/
+static int uplink_send(const struct uplink_transport_api *api, enum uplink_payload kind,
+                       size_t len) {
+
+    int rc = api->send(kind, payload, len);
+
+    if (rc == -EBUSY) {
+        blocked = true;
+    } else if (rc == -EBADMSG) {
+        stats.rejected++;
+        return 0;
+    } else if (rc != 0) {
+        LOG_WRN("%s send failed: %d", api->name, rc);
+        stats.failures++;
+        retryAt = k_uptime_get() + UPLINK_RETRY_MS;
+    }
+
+    return rc;
+}
+
+static bool uplink_may_send(void) {
+
+    return !blocked && k_uptime_get() >= retryAt;
+}
+
+static void send_flux(const struct uplink_transport_api *api) {
+
+    struct flux_record record;
+    uint32_t start;
+    int len;
+
+    while (uplink_may_send() && flux_peek(&record) == 0) {
+        uplink_stamp_flux(&record);
+        start = k_cycle_get_32();
+        len = uplink_encode_flux(api->encoding, payload, MIN(sizeof(payload), api->maxPayload),
+                                 &record);
+        uplink_encode_timed(start);
+        if (len < 0) {
+            LOG_ERR("Flux record not encoded: %d, dropped", len);
+            flux_consume();
+            continue;
+        }
+
+        if (uplink_send(api, UPLINK_FLUX, len) != 0) {
+            break;
+        }
+        flux_consume();
+        stats.fluxRecords++;
+    }
+}
+
+static void send_batches(const struct uplink_transport_api *api) {
+
+    struct sensor_sample samples[UPLINK_BATCH_MAX_SAMPLES];
+    size_t n, count;
+    uint32_t start;
+    int len;
+
+    while (uplink_may_send() && batch_ready()) {
+        n = sample_ring_peek(samples, ARRAY_SIZE(samples));
+        uplink_stamp_samples(samples, n);
+        start = k_cycle_get_32();
+        len = uplink_encode_samples(api->encoding, payload,
+                                    MIN(sizeof(payload), api->maxPayload), samples, n, &count);
+        uplink_encode_timed(start);
+        if (len <= 0) {
+            // stays unencodable, drop the oldest so the ring moves on
+            LOG_ERR("Batch not encoded: %d, sample %u dropped", len, samples[0].seq);
+            sample_ring_consume(1);
+            stats.dropped++;
+            continue;
+        }
+
+        if (uplink_send(api, UPLINK_SAMPLES, len) != 0) {
+            break;
+        }
+        batch_sent(count, len);
+        stats.batches++;
+        stats.samples += count;
+    }
+}
+
+/*
+    Uplink back: send one batch or flux record from the flash log, in log
+    order, paced so the backlog doesn't crowd out live data
+*/
+static void replay_log(const struct uplink_transport_api *api) {
+
+    struct sensor_sample samples[UPLINK_BATCH_MAX_SAMPLES];
+    struct flux_record record;
+    struct sample_log_stats logStats;
+    bool flux;
+    size_t n = 0;
+    size_t count = 1;
+    int len;
+
+    if (!uplink_may_send() || k_uptime_get() < replayAt) {
+        return;
+    }
+
+    flux = sample_log_peek_flux(&record) == 0;
+    if (!flux) {
+        n = sample_log_peek(samples, ARRAY_SIZE(samples));
+        if (n == 0) {
+            return;
+        }
+    }
+    if (replayStart < 0) {
+        replayStart = k_uptime_get();
+    }
+
+    if (flux) {
+        uplink_stamp_flux(&record);
+        len = uplink_encode_flux(api->encoding, payload, MIN(sizeof(payload), api->maxPayload),
+                                 &record);
+    } else {
+        uplink_stamp_samples(samples, n);
+        len = uplink_encode_samples(api->encoding, payload,
+                                    MIN(sizeof(payload), api->maxPayload), samples, n, &count);
+    }
+    if (len <= 0) {
+        LOG_ERR("Logged entry not encoded: %d, seq %u dropped", len,
+                flux ? record.seq : samples[0].seq);
+        sample_log_consume(1);
+        stats.dropped++;
+        replayAt = k_uptime_get() + SAMPLE_LOG_REPLAY_INTERVAL_MS;
+        return;
+    }
+    if (uplink_send(api, flux ? UPLINK_FLUX : UPLINK_SAMPLES, len) != 0) {
+        return;
+    }
+
+    sample_log_consume(count);
+    if (flux) {
+        stats.fluxRecords++;
+    } else {
+        stats.batches++;
+        stats.samples += count;
+    }
+    replayAt = k_uptime_get() + SAMPLE_LOG_REPLAY_INTERVAL_MS;
+
+    if (sample_log_empty()) {
+        sample_log_get_stats(&logStats);
+        LOG_INF("Sample log replayed in %lld ms (%u replayed, %u dropped in total)",
+                k_uptime_get() - replayStart, logStats.replayed, logStats.dropped);
+        replayStart = -1;
+    }
+}
+
+/*
+    Uplink down: move queued flux records and samples out of RAM into the
+    flash log, before the queues overflow or a reboot loses them. Both are
+    merged by sequence number, the order the log replays them in.
+*/
+static void spool_queued(void) {
+
+    struct sensor_sample sample;
+    struct flux_record record;
+    bool haveSample, haveFlux;
+
+    while (1) {
+        haveFlux = flux_peek(&record) == 0;
+        haveSample = sample_ring_peek(&sample, 1) == 1;
+
+        if (haveFlux && (!haveSample || record.seq < sample.seq)) {
+            uplink_stamp_flux(&record);
+            if (sample_log_append_flux(&record) != 0) {
+                // no log, leave the rest in RAM
+                break;
+            }
+            flux_consume();
+        } else if (haveSample) {
+            uplink_stamp_samples(&sample, 1);
+            if (sample_log_append(&sample) != 0) {
+                break;
+            }
+            sample_ring_consume(1);
+        } else {
+            break;
+        }
+        stats.spooled++;
+    }
+}
+
+/*
+    Earliest uptime (ms) the thread has to act without being woken, and
+    why. Queued data only counts while the transport has room.
+*/
+static int64_t next_deadline(bool connected, int64_t reportAt, enum uplink_wake *why) {
+
+    struct flux_record record;
+    int64_t deadline = reportAt;
+    int64_t t;
+
+    *why = WAKE_REPORT;
+
+    if (!connected || blocked) {
+        return deadline;
+    }
+
+    t = batch_ready() ? k_uptime_get() : batch_deadline();
+    if (t != INT64_MAX && MAX(t, retryAt) < deadline) {
+        deadline = MAX(t, retryAt);
+        *why = (t >= retryAt) ? WAKE_BATCH_AGE : WAKE_RETRY;
+    }
+    if (flux_peek(&record) == 0 && retryAt < deadline) {
+        deadline = retryAt;
+        *why = WAKE_RETRY;
+    }
+    if (!sample_log_empty() && MAX(replayAt, retryAt) < deadline) {
+        deadline = MAX(replayAt, retryAt);
+        *why = WAKE_REPLAY;
+    }
+
+    return deadline;
+}
+
+static void count_timeout(enum uplink_wake why) {
+
+    switch (why) {
+        case WAKE_BATCH_AGE:
+            stats.batchAge++;
+            break;
+        case WAKE_RETRY:
+            stats.retry++;
+            break;
+        case WAKE_REPLAY:
+            stats.replay++;
+            break;
+        default:
+            break;
+    }
+}
+
+static void uplink_report(const struct uplink_transport_api *api) {
+
+    struct uplink_status status;
+    struct wifi_conn_stats wifiReport;
+    struct dns_cache_stats dnsReport;
+    struct radio_stats radioReport;
+    struct sample_log_stats logReport;
+    struct timesync_stats timeReport;
+    struct motor_stats motorReport;
+    int64_t uptime = k_uptime_get();
+    uint32_t encodes = stats.batches + stats.fluxRecords;
+
+    api->status(&status);
+    LOG_INF("Uplink %s: %u batches, %u samples, %u flux, %u rejected, %u failures, "
+            "%u spooled, %u not encodable, encode max %u us mean %u us",
+            api->name, stats.batches, stats.samples, stats.fluxRecords, stats.rejected,
+            stats.failures, stats.spooled, stats.dropped, stats.encodeMaxUs,
+            encodes ? (uint32_t)(stats.encodeTotalUs / encodes) : 0);
+    LOG_INF("Uplink wire: %u connects, %u sends, payload %u B, overhead %u B, "
+            "%u B per sample; timeouts: batch age %u, retry %u, replay %u",
+            status.connects, status.sends, status.payloadBytes, status.overheadBytes,
+            stats.samples ? (status.payloadBytes + status.overheadBytes) / stats.samples : 0,
+            stats.batchAge, stats.retry, stats.replay);
+    if (api->report) {
+        api->report();
+    }
+
+    wifi_get_stats(&wifiReport);
+    LOG_INF("WiFi: %u connects (%u on cached channel, %u fell back to a scan), "
+            "%u failures, last connect %u ms ready %u ms, max ready %u ms, "
+            "first ready %lld ms after boot",
+            wifiReport.connects, wifiReport.cachedHits, wifiReport.cachedMisses,
+            wifiReport.failures, wifiReport.lastConnectMs, wifiReport.lastReadyMs,
+            wifiReport.maxReadyMs, wifiReport.firstReadyMs);
+    dns_cache_get_stats(&dnsReport);
+    LOG_INF("DNS: %u hits, %u stale, %u misses, %u refreshes, %u failures, "
+            "resolve last %u ms max %u ms",
+            dnsReport.hits, dnsReport.stale, dnsReport.misses, dnsReport.refreshes,
+            dnsReport.failures, dnsReport.lastResolveMs, dnsReport.maxResolveMs);
+    timesync_get_stats(&timeReport);
+    LOG_INF("Time: %u syncs, %u failures, first at %lld ms, last step %d ms max %d ms, "
+            "drift %d ppb, rtt %u ms",
+            timeReport.syncs, timeReport.failures, timeReport.firstSyncMs,
+            timeReport.lastStepMs, timeReport.maxStepMs, timeReport.driftPpb,
+            timeReport.lastRttMs);
+    motor_get_stats(&motorReport);
+    LOG_INF("Chamber: %u cycles, %u steps (%u per hour), latest step %u ms, "
+            "%u starts held for the network",
+            motorReport.cycles, motorReport.wakeups,
+            (uint32_t)(motorReport.wakeups * (int64_t)(60 * 60 * MSEC_PER_SEC) / MAX(uptime, 1)),
+            motorReport.maxLateMs, motorReport.networkWaits);
+    radio_get_stats(&radioReport);
+    for (int s = 0; s < RADIO_MOTOR_STATES; s++) {
+        LOG_INF("Radio in %s: on %lld s, power save %lld s, off %lld s",
+                radio_state_name(s), radioReport.ms[RADIO_ON][s] / 1000,
+                radioReport.ms[RADIO_POWER_SAVE][s] / 1000,
+                radioReport.ms[RADIO_OFF][s] / 1000);
+    }
+    LOG_INF("Radio: %u sleeps, %u drain timeouts, %u power save refusals",
+            radioReport.sleeps, radioReport.drainTimeouts, radioReport.psFailures);
+    sample_log_get_stats(&logReport);
+    LOG_INF("Sample log: %u pending, %u appended (%u flux), %u replayed, %u dropped, "
+            "append max %u us mean %u us",
+            logReport.pending, logReport.appended, logReport.fluxAppended, logReport.replayed,
+            logReport.dropped, logReport.appendMaxUs,
+            logReport.appended ? (uint32_t)(logReport.appendTotalUs / logReport.appended) : 0);
+}
+
+void uplink_get_stats(struct uplink_stats *out) {
+
+    *out = stats;
+}
+
+void thread_uplink_entry(void) {
+
+    const struct uplink_transport_api *api = transports[transport];
+    struct uplink_status status;
+    struct sample_ring_stats ringStats;
+    uint32_t lastOverflows = 0;
+    int64_t reportAt = k_uptime_get() + UPLINK_REPORT_MS;
+    int64_t deadline;
+    enum uplink_wake why;
+
+    LOG_INF("Uplink over %s", api->name);
+    api->init();
+
+    while (1) {
+        api->connect();
+        api->status(&status);
+
+        if (status.connected) {
+            // finished cycles first, they are what the dashboard plots
+            send_flux(api);
+            send_batches(api);
+            replay_log(api);
+        } else {
+            spool_queued();
+        }
+        if (api->sleep) {
+            uplink_sleep_check(api);
+        }
+
+        sample_ring_get_stats(&ringStats);
+        if (ringStats.overflows != lastOverflows) {
+            LOG_WRN("Uplink behind: %u samples dropped, high water %u/%u",
+                    ringStats.overflows - lastOverflows, ringStats.highWater,
+                    SAMPLE_RING_SIZE);
+            lastOverflows = ringStats.overflows;
+        }
+
+        if (k_uptime_get() >= reportAt) {
+            uplink_report(api);
+            reportAt += UPLINK_REPORT_MS;
+        }
+
+        deadline = next_deadline(status.connected, reportAt, &why);
+        if (api->poll(deadline) == 0) {
+            count_timeout(why);
+        }
+        blocked = false;
+    }
+}
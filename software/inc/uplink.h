@@ -0,0 +1,164 @@
+/**
+ ************************************************************************
+ * @file inc/uplink.h
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains definitions for the uplink pipeline and its transports
+ *
+ * One uplink thread owns everything between the sample ring and the
+ * network: batching, encoding, spooling to the flash sample log while the
+ * transport is down and pacing the replay once it is back. A transport
+ * only moves finished payloads, so a new one needs nothing from the
+ * acquisition side.
+ **********************************************************************
+ * */
+
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <zephyr/kernel.h>
+#include "encode.h"
+#include "motor.h"
+
+enum uplink_transport {
+    UPLINK_MQTT,        // mqtt.tago.io:1883, commands and OTA included
+    UPLINK_HTTP,        // api.tago.io:80, for sites that block 1883, data only
+    UPLINK_LOOPBACK,    // no network, counts payloads, for benchmarking
+    UPLINK_MQTT_SN,     // MQTT-SN over UDP to a site gateway, sleeps with the chamber
+    UPLINK_TRANSPORTS
+};
+
+// until "uplink/transport" is saved, e.g. from the uplink/ MQTT topic
+#define UPLINK_TRANSPORT_DEFAULT    UPLINK_MQTT
+
+// samples peeked per payload, the transport's payload limit decides how many fit
+#define UPLINK_BATCH_MAX_SAMPLES    16
+#define UPLINK_PAYLOAD_MAX          (UPLINK_BATCH_MAX_SAMPLES * ENCODE_JSON_SAMPLE_MAX + 2)
+// back off after a failed send
+#define UPLINK_RETRY_MS             1000
+// how often the uplink counters are logged
+#define UPLINK_REPORT_MS            (60 * 60 * MSEC_PER_SEC)
+#define UPLINK_STACK_SIZE           8192
+#define UPLINK_PRIORITY             -3
+// what the loopback transport packs, and how many times it encodes each way at boot
+#define UPLINK_LOOPBACK_ENCODING    UPLINK_ENCODING_BATCH
+#define UPLINK_LOOPBACK_BENCH_RUNS  100
+
+enum uplink_payload {
+    UPLINK_SAMPLES,
+    UPLINK_FLUX,
+};
+
+// how the shared stage packs payloads for a transport
+enum uplink_encoding {
+    UPLINK_ENCODING_BATCH,  // BATCH_ENCODING samples, text flux records
+    UPLINK_ENCODING_JSON,   // TagoIO JSON arrays for both
+};
+
+struct uplink_status {
+    bool connected;         // send() may succeed now
+    uint32_t inFlight;      // sent but not acknowledged yet
+    uint32_t connects;
+    uint32_t sends;         // payloads accepted
+    uint32_t payloadBytes;
+    uint32_t overheadBytes; // protocol framing around the payloads, headers included
+};
+
+/*
+    Operations of one transport. All of them run on the uplink thread,
+    except wake().
+*/
+struct uplink_transport_api {
+    const char *name;
+    enum uplink_encoding encoding;
+    size_t maxPayload;
+
+    void (*init)(void);
+    /*
+        Work towards a usable link: nothing while connected or backing
+        off, otherwise one attempt. Blocks for at most the attempt's own
+        timeouts.
+    */
+    void (*connect)(void);
+    /*
+        Hand over one payload, copied or sent before returning.
+        0: accepted; -EBUSY: no room now, try again after poll();
+        -EBADMSG: refused for good, drop it; other: failed, back off.
+    */
+    int (*send)(enum uplink_payload kind, const uint8_t *payload, size_t len);
+    /*
+        Service the protocol until deadline (uptime ms, INT64_MAX for none),
+        its own timers, I/O or wake(). Returns 0 if the deadline passed,
+        1 if woken earlier.
+    */
+    int (*poll)(int64_t deadline);
+    // any thread: cut the current poll() short
+    void (*wake)(void);
+    void (*status)(struct uplink_status *status);
+    // log transport specific counters, optional
+    void (*report)(void);
+    /*
+        The chamber sleeps for durationMs, or woke up (0). Called once the
+        queue has drained, so the transport can park its session. Optional.
+    */
+    void (*sleep)(int64_t durationMs);
+};
+
+extern const struct uplink_transport_api mqtt_transport;
+extern const struct uplink_transport_api http_transport;
+extern const struct uplink_transport_api loopback_transport;
+extern const struct uplink_transport_api mqtt_sn_transport;
+
+struct uplink_stats {
+    uint32_t batches;       // sample payloads accepted
+    uint32_t samples;
+    uint32_t fluxRecords;
+    uint32_t rejected;      // payloads the backend refused, dropped
+    uint32_t failures;
+    uint32_t spooled;       // samples and flux records moved to the flash log while down
+    uint32_t dropped;       // samples no encoder could fit, dropped
+    uint32_t encodeMaxUs;   // slowest payload encode
+    uint64_t encodeTotalUs;
+    // poll timeouts by reason
+    uint32_t batchAge;
+    uint32_t retry;
+    uint32_t replay;
+};
+
+// transport this boot runs, settings must be loaded
+enum uplink_transport uplink_transport(void);
+
+const char *uplink_transport_name(enum uplink_transport transport);
+
+// by name, "mqtt", "http", "loopback" or "mqtt-sn", -1 if unknown
+int uplink_transport_parse(const char *name);
+
+/*
+    Save the transport for the next boot and reboot into it. Returns
+    -EINVAL for an unknown transport, 0 if it is already running.
+*/
+int uplink_select(enum uplink_transport transport);
+
+// any thread: something is queued, wake the uplink
+void uplink_notify(void);
+
+// nothing queued, spooled or in flight, and the transport parked if asked to
+bool uplink_idle(void);
+
+// chamber state machine: new state, for transports that sleep along with it
+void uplink_motor_state(States state, int64_t durationMs);
+
+/*
+    The shared encode stage: pack as many samples as fit in len for
+    encoding, the number in *count. Returns the payload length.
+*/
+int uplink_encode_samples(enum uplink_encoding encoding, uint8_t *buf, size_t len,
+                          const struct sensor_sample *samples, size_t n, size_t *count);
+int uplink_encode_flux(enum uplink_encoding encoding, uint8_t *buf, size_t len,
+                       const struct flux_record *record);
+
+void uplink_get_stats(struct uplink_stats *stats);
+
+void thread_uplink_entry(void);
+
+#endif
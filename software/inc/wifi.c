@@ -14,11 +14,15 @@
 #include <zephyr/net/wifi_mgmt.h>
 #include <zephyr/net/net_event.h>
 #include <zephyr/net/net_mgmt.h>
+#include <zephyr/net/dns_resolve.h>
+#include <zephyr/settings/settings.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <zephyr/logging/log.h>
 #include "ota.h"
+#include "wifi.h"
+#include "radio.h"
 LOG_MODULE_DECLARE(soil_respiration, LOG_LEVEL_DBG);
 
 //#define NET_SSID        "fbgateway"
@@ -27,19 +31,115 @@ LOG_MODULE_DECLARE(soil_respiration, LOG_LEVEL_DBG);
 #define PSK                 "tomsalpietro"
 
 
-static struct net_mgmt_event_callback wifiCallback;
-//static struct net_mgmt_event_callback ipv4Callback;
+// connect request answered, success or not - private to the wifi thread
+#define WIFI_EVT_CONNECT_RESULT BIT(8)
+// radio allowed on, cleared by wifi_set_radio(false)
+#define WIFI_EVT_RADIO_ON       BIT(9)
 
-//static K_SEM_DEFINE(wifiSem, 0, 1);
-//static K_SEM_DEFINE(ipv4Sem, 0, 1);
+K_EVENT_DEFINE(wifiEvents);
 
-struct k_sem wifiSem;
-//struct k_sem ipv4Sem;
-bool wifiConnected = false;
+static sys_slist_t listeners = SYS_SLIST_STATIC_INIT(&listeners);
+
+// last AP joined, persisted as "wifi/ap"; channel 0 = nothing cached
+struct wifi_ap_cache {
+    uint8_t bssid[WIFI_MAC_ADDR_LEN];
+    uint8_t channel;
+};
+
+static struct wifi_ap_cache apCache;
+// the cached channel failed, scan until the next successful connect
+static bool cacheFailed;
+
+static struct wifi_conn_stats stats;
+static K_MUTEX_DEFINE(statsLock);
+static int64_t connectStartedAt;
 
 
 static struct net_mgmt_event_callback wifi_cb;
-//static struct net_mgmt_event_callback ipv4_cb;
+static struct net_mgmt_event_callback ipv4_cb;
+
+static void wifi_dns_check(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(dnsCheckWork, wifi_dns_check);
+// warn if still no server by then, 0 once warned
+static int64_t dnsCheckUntil;
+
+
+static int wifi_settings_set(const char *name, size_t len,
+                             settings_read_cb read_cb, void *cb_arg) {
+
+    if (!settings_name_steq(name, "ap", NULL)) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(apCache) ||
+        read_cb(cb_arg, &apCache, sizeof(apCache)) != sizeof(apCache)) {
+        memset(&apCache, 0, sizeof(apCache));
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(wifi, "wifi", NULL, wifi_settings_set, NULL, NULL);
+
+/*
+    Remember where the AP was, only written when it moved
+*/
+static void wifi_cache_update(const struct wifi_iface_status *status) {
+
+    if (status->channel == 0 || status->channel == WIFI_CHANNEL_ANY ||
+        (status->channel == apCache.channel &&
+         !memcmp(status->bssid, apCache.bssid, sizeof(apCache.bssid)))) {
+        return;
+    }
+
+    LOG_INF("AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d cached",
+            status->bssid[0], status->bssid[1], status->bssid[2],
+            status->bssid[3], status->bssid[4], status->bssid[5], status->channel);
+    memcpy(apCache.bssid, status->bssid, sizeof(apCache.bssid));
+    apCache.channel = status->channel;
+    if (settings_save_one("wifi/ap", &apCache, sizeof(apCache))) {
+        LOG_WRN("Could not save the AP cache");
+    }
+}
+
+void wifi_get_stats(struct wifi_conn_stats *out) {
+
+    k_mutex_lock(&statsLock, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&statsLock);
+}
+
+/*
+    Update the state bits under mask and tell the listeners
+*/
+static void wifi_set_state(uint32_t events, uint32_t mask) {
+
+    struct wifi_listener *listener;
+    uint32_t state;
+
+    k_event_set_masked(&wifiEvents, events, mask);
+    state = k_event_wait(&wifiEvents, WIFI_EVT_READY | WIFI_EVT_LINK_DOWN, false, K_NO_WAIT);
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&listeners, listener, node) {
+        listener->handler(state);
+    }
+}
+
+void wifi_add_listener(struct wifi_listener *listener) {
+
+    sys_slist_append(&listeners, &listener->node);
+}
+
+bool wifi_is_ready(void) {
+
+    return k_event_wait_all(&wifiEvents, WIFI_EVT_READY, false, K_NO_WAIT) != 0;
+}
+
+int wifi_wait_ready(k_timeout_t timeout) {
+
+    return k_event_wait_all(&wifiEvents, WIFI_EVT_READY, false, timeout) ? 0 : -EAGAIN;
+}
 
 
 /*
@@ -56,9 +156,13 @@ static void handle_wifi_connect_cb(struct net_mgmt_event_callback *cb) {
     else
     {
         LOG_INF("Connected\n");
-        k_sem_give(&wifiSem);
-        wifiConnected = true;
+        k_mutex_lock(&statsLock, K_FOREVER);
+        stats.connects++;
+        stats.lastConnectMs = k_uptime_get() - connectStartedAt;
+        k_mutex_unlock(&statsLock);
+        wifi_set_state(WIFI_EVT_LINK_UP, WIFI_EVT_LINK_UP | WIFI_EVT_LINK_DOWN);
     }
+    k_event_post(&wifiEvents, WIFI_EVT_CONNECT_RESULT);
 }
 
 /*
@@ -75,72 +179,113 @@ static void handle_wifi_disconnect_cb(struct net_mgmt_event_callback *cb) {
     else
     {
         printk("Disconnected\n");
-        k_sem_take(&wifiSem, K_NO_WAIT);
-        wifiConnected = false;
     }
+    // the lease goes with the link, DHCP rebinds after the next connect
+    wifi_set_state(WIFI_EVT_LINK_DOWN, WIFI_EVT_READY | WIFI_EVT_LINK_DOWN);
 }
 
 /*
-    IPv4 handler for assigning IP adress callback
+    The default resolver is up and has at least one server, from the
+    lease or configured
 */
-/*static void handle_ipv4_cb(struct net_if *iface) {
+static bool wifi_dns_has_server(void) {
 
-    int i = 0;
+    struct dns_resolve_context *ctx = dns_resolve_get_default();
 
-    for (i = 0; i < NET_IF_MAX_IPV4_ADDR; i++) {
+    if (!ctx || ctx->state != DNS_RESOLVE_CONTEXT_ACTIVE) {
+        return false;
+    }
+    for (int i = 0; i < ARRAY_SIZE(ctx->servers); i++) {
+        if (ctx->servers[i].dns_server.sa_family == AF_INET) {
+            return true;
+        }
+    }
 
-        char buf[NET_IPV4_ADDR_LEN];
+    return false;
+}
 
-        if (iface->config.ip.ipv4->unicast[i].addr_type != NET_ADDR_DHCP) {
-            continue;
-        }
+/*
+    Set DNS_READY once the resolver has a server, rechecked while the
+    address is up. Warns once if that takes over WIFI_DNS_WAIT_MS.
+*/
+static void wifi_dns_check(struct k_work *work) {
 
-        printk("IPv4 address: %s\n",
-                net_addr_ntop(AF_INET,
-                                &iface->config.ip.ipv4->unicast[i].address.in_addr,
-                                buf, sizeof(buf)));
-        printk("Subnet: %s\n",
-                net_addr_ntop(AF_INET,
-                                &iface->config.ip.ipv4->netmask,
-                                buf, sizeof(buf)));
-        printk("Router: %s\n",
-                net_addr_ntop(AF_INET,
-                                &iface->config.ip.ipv4->gw,
-                                buf, sizeof(buf)));
-        }
+    if (!k_event_wait(&wifiEvents, WIFI_EVT_IPV4_READY, false, K_NO_WAIT)) {
+        return;
+    }
+
+    if (wifi_dns_has_server()) {
+        wifi_set_state(WIFI_EVT_DNS_READY, WIFI_EVT_DNS_READY);
+        return;
+    }
 
-        k_sem_give(&ipv4Sem);
-}*/
+    if (dnsCheckUntil != 0 && k_uptime_get() >= dnsCheckUntil) {
+        LOG_WRN("No DNS server %d ms after the address, uplink held back",
+                WIFI_DNS_WAIT_MS);
+        dnsCheckUntil = 0;
+    }
+    k_work_reschedule(&dnsCheckWork, K_MSEC(WIFI_DNS_POLL_MS));
+}
+
+/*
+    IPv4 handler for assigning IP adress callback. DHCP usually configures
+    the resolver from the same lease before the address is added; DNS is
+    only ready once a server is actually there
+*/
+static void handle_ipv4_cb(uint32_t mgmt_event) {
+
+    int64_t now = k_uptime_get();
+
+    if (mgmt_event == NET_EVENT_IPV4_ADDR_ADD) {
+        k_mutex_lock(&statsLock, K_FOREVER);
+        stats.lastReadyMs = now - connectStartedAt;
+        stats.maxReadyMs = MAX(stats.maxReadyMs, stats.lastReadyMs);
+        if (stats.firstReadyMs == 0) {
+            stats.firstReadyMs = now;
+        }
+        k_mutex_unlock(&statsLock);
+        LOG_INF("IPv4 address assigned, network ready %u ms after the connect request",
+                stats.lastReadyMs);
+        wifi_set_state(WIFI_EVT_IPV4_READY, WIFI_EVT_IPV4_READY);
+        dnsCheckUntil = now + WIFI_DNS_WAIT_MS;
+        k_work_reschedule(&dnsCheckWork, K_NO_WAIT);
+    } else {
+        LOG_WRN("IPv4 address removed");
+        wifi_set_state(0, WIFI_EVT_IPV4_READY | WIFI_EVT_DNS_READY);
+    }
+}
 
 /*
     request wifi status
 */
-void wifi_status(void) {
+int wifi_status(struct wifi_iface_status *status) {
 
     struct net_if *iFace = net_if_get_default();
-    
-    struct wifi_iface_status status = {0};
 
-    if (net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iFace, &status,	sizeof(struct wifi_iface_status)))
+    memset(status, 0, sizeof(*status));
+    if (net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iFace, status, sizeof(struct wifi_iface_status)))
     {
         printk("WiFi Status Request Failed\n");
+        return -EIO;
     }
 
     printk("\n");
 
-    if (status.state >= WIFI_STATE_ASSOCIATED) {
-        printk("SSID: %-32s\n", status.ssid);
-        printk("Band: %s\n", wifi_band_txt(status.band));
-        printk("Channel: %d\n", status.channel);
-        printk("Security: %s\n", wifi_security_txt(status.security));
-        printk("RSSI: %d\n", status.rssi);
+    if (status->state >= WIFI_STATE_ASSOCIATED) {
+        printk("SSID: %-32s\n", status->ssid);
+        printk("Band: %s\n", wifi_band_txt(status->band));
+        printk("Channel: %d\n", status->channel);
+        printk("Security: %s\n", wifi_security_txt(status->security));
+        printk("RSSI: %d\n", status->rssi);
     }
+
+    return 0;
 }
 
 /*
-    Connect to wifi network
+    Connect to wifi network, on one channel or WIFI_CHANNEL_ANY to scan
 */
-void wifi_connect(void) {
+void wifi_connect(uint8_t channel) {
 
     struct net_if *iface = net_if_get_first_wifi();
 
@@ -150,12 +295,13 @@ void wifi_connect(void) {
     wifi_params.psk = PSK;
     wifi_params.ssid_length = strlen(NET_SSID);
     wifi_params.psk_length = strlen(PSK);
-    wifi_params.channel = WIFI_CHANNEL_ANY;
+    wifi_params.channel = channel;
     wifi_params.security = WIFI_SECURITY_TYPE_PSK;
     wifi_params.band = WIFI_FREQ_BAND_2_4_GHZ; 
     wifi_params.mfp = WIFI_MFP_OPTIONAL;
 
-    printk("Connecting to SSID: %s\n", wifi_params.ssid);
+    printk("Connecting to SSID: %s (channel %s)\n", wifi_params.ssid,
+           channel == WIFI_CHANNEL_ANY ? "scan" : "cached");
 
     if (net_mgmt(NET_REQUEST_WIFI_CONNECT, iface, &wifi_params, sizeof(struct wifi_connect_req_params)))
     {
@@ -178,6 +324,39 @@ void wifi_disconnect(void)
     }
 }
 
+void wifi_set_radio(bool on) {
+
+    if (on) {
+        k_event_post(&wifiEvents, WIFI_EVT_RADIO_ON);
+    } else {
+        k_event_set_masked(&wifiEvents, 0, WIFI_EVT_RADIO_ON);
+        wifi_disconnect();
+    }
+}
+
+int wifi_power_save(bool on) {
+
+    struct net_if *iFace = net_if_get_default();
+    struct wifi_ps_params params = {0};
+    int ret;
+
+    params.type = WIFI_PS_PARAM_STATE;
+    params.enabled = on ? WIFI_PS_ENABLED : WIFI_PS_DISABLED;
+    ret = net_mgmt(NET_REQUEST_WIFI_PS, iFace, &params, sizeof(params));
+    if (ret != 0 || !on) {
+        return ret;
+    }
+
+    // power save works without it, just wakes more often
+    params.type = WIFI_PS_PARAM_LISTEN_INTERVAL;
+    params.listen_interval = RADIO_PS_LISTEN_INTERVAL;
+    if (net_mgmt(NET_REQUEST_WIFI_PS, iFace, &params, sizeof(params))) {
+        LOG_WRN("Listen interval %d refused", RADIO_PS_LISTEN_INTERVAL);
+    }
+
+    return 0;
+}
+
 /*
     handler for wifi events
 */
@@ -191,10 +370,11 @@ static void wifi_mgmt_event_handler(struct net_mgmt_event_callback *cb, uint32_t
         case NET_EVENT_WIFI_DISCONNECT_RESULT:
             handle_wifi_disconnect_cb(cb);
             break;
-/*
+
         case NET_EVENT_IPV4_ADDR_ADD:
-            handle_ipv4_cb(iface);
-            break;*/
+        case NET_EVENT_IPV4_ADDR_DEL:
+            handle_ipv4_cb(mgmt_event);
+            break;
 
         default:
             break;
@@ -204,49 +384,80 @@ static void wifi_mgmt_event_handler(struct net_mgmt_event_callback *cb, uint32_t
 
 
 /*
-    Thread Entry for wifi functionality
+    Thread Entry for wifi functionality: connect, then sleep until the link
+    drops and reconnect with a back off
 */
 void thread_wifi_entry(void) {
-    
+
+    uint32_t retryMs = WIFI_RETRY_MIN_MS;
+    struct wifi_iface_status status;
+    bool useCache;
+
     printk("--START UP--\r\n");
-    
-    simple_http_ota_init();
 
-    //initialise semaphores
-    k_sem_init(&wifiSem, 0, 1);
-    //k_sem_init(&ipv4Sem, 0, 1);
+    simple_http_ota_init();
 
     //initialise callbacks
-    //net_mgmt_init_event_callback(&ipv4_cb, wifi_mgmt_event_handler, NET_EVENT_IPV4_ADDR_ADD);
+    net_mgmt_init_event_callback(&ipv4_cb, wifi_mgmt_event_handler,
+                                 NET_EVENT_IPV4_ADDR_ADD | NET_EVENT_IPV4_ADDR_DEL);
     net_mgmt_init_event_callback(&wifi_cb, wifi_mgmt_event_handler,
                                  NET_EVENT_WIFI_CONNECT_RESULT | NET_EVENT_WIFI_DISCONNECT_RESULT);
 
     net_mgmt_add_event_callback(&wifi_cb);
-    //net_mgmt_add_event_callback(&ipv4_cb);
-
-    //connect to network
-    wifi_connect();
-    k_sem_take(&wifiSem, K_FOREVER);
-    //k_sleep(K_SECONDS(5));
+    net_mgmt_add_event_callback(&ipv4_cb);
 
-    //k_sem_take(&ipv4Sem, K_FOREVER);
+    wifi_set_state(WIFI_EVT_LINK_DOWN, WIFI_EVT_LINK_DOWN);
+    k_event_post(&wifiEvents, WIFI_EVT_RADIO_ON);
 
-    printk("Ready...\n\n");
-    wifi_status();
-    //uint8_t i = 0;
     while (1) {
-        //printk("running: %d\r\n", i);
-        //i++;
-        if (!wifiConnected) {
-            wifi_connect();
-            k_sem_take(&wifiSem, K_FOREVER);
-            wifi_status();
+        // radio scheduled off, nothing to do until it is back
+        k_event_wait(&wifiEvents, WIFI_EVT_RADIO_ON, false, K_FOREVER);
+
+        //connect to network
+        useCache = apCache.channel != 0 && !cacheFailed;
+        k_event_set_masked(&wifiEvents, 0, WIFI_EVT_CONNECT_RESULT);
+        connectStartedAt = k_uptime_get();
+        wifi_connect(useCache ? apCache.channel : WIFI_CHANNEL_ANY);
+        if (!k_event_wait(&wifiEvents, WIFI_EVT_CONNECT_RESULT, false,
+                          K_MSEC(useCache ? WIFI_CACHED_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS))) {
+            // no answer, stop the attempt before starting another
+            wifi_disconnect();
         }
-        k_msleep(1000);
-    }
 
-    k_sleep(K_SECONDS(15));
+        if (!k_event_wait(&wifiEvents, WIFI_EVT_RADIO_ON, false, K_NO_WAIT)) {
+            // turned off while connecting
+            wifi_disconnect();
+            continue;
+        }
 
-    wifi_disconnect();
-    
-}
\ No newline at end of file
+        if (k_event_wait(&wifiEvents, WIFI_EVT_LINK_UP, false, K_NO_WAIT)) {
+            printk("Ready...\n\n");
+            k_mutex_lock(&statsLock, K_FOREVER);
+            stats.cachedHits += useCache;
+            k_mutex_unlock(&statsLock);
+            cacheFailed = false;
+            if (wifi_status(&status) == 0) {
+                wifi_cache_update(&status);
+            }
+            retryMs = WIFI_RETRY_MIN_MS;
+
+            // nothing to do until the link drops
+            k_event_wait(&wifiEvents, WIFI_EVT_LINK_DOWN, false, K_FOREVER);
+        } else if (useCache) {
+            // AP moved or gone, scan straight away
+            LOG_WRN("No AP on cached channel %d, scanning", apCache.channel);
+            k_mutex_lock(&statsLock, K_FOREVER);
+            stats.failures++;
+            stats.cachedMisses++;
+            k_mutex_unlock(&statsLock);
+            cacheFailed = true;
+        } else {
+            k_mutex_lock(&statsLock, K_FOREVER);
+            stats.failures++;
+            k_mutex_unlock(&statsLock);
+            LOG_WRN("WiFi connect failed, retrying in %u ms", retryMs);
+            k_msleep(retryMs);
+            retryMs = MIN(retryMs * 2, WIFI_RETRY_MAX_MS);
+        }
+    }
+}
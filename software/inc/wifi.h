@@ -11,12 +11,77 @@
 #define WIFI_H
 
 #include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
 
-//extern struct k_sem wifiSem;
-//extern struct k_sem ipv4Sem;
+/*
+    Connectivity state, as level bits in wifiEvents: each is set while the
+    condition holds and cleared when it stops
+*/
+#define WIFI_EVT_LINK_UP        BIT(0)  // associated with the AP
+#define WIFI_EVT_LINK_DOWN      BIT(1)  // not associated, set at boot
+#define WIFI_EVT_IPV4_READY     BIT(2)  // DHCP lease bound
+#define WIFI_EVT_DNS_READY      BIT(3)  // default resolver active with a server
+// everything the uplink needs
+#define WIFI_EVT_READY          (WIFI_EVT_LINK_UP | WIFI_EVT_IPV4_READY | WIFI_EVT_DNS_READY)
 
-extern bool wifiConnected;
+// give up on a connect request with no result after this long
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+// back off between failed connects, doubling up to the max
+#define WIFI_RETRY_MIN_MS       1000
+#define WIFI_RETRY_MAX_MS       30000
+// connect on the last AP's channel first, no scan; a scan only if that fails
+#define WIFI_CACHED_TIMEOUT_MS  5000
+// after the lease, how often to look for a DNS server, and warn after how long
+#define WIFI_DNS_WAIT_MS        10000
+#define WIFI_DNS_POLL_MS        250
+
+struct wifi_conn_stats {
+    uint32_t connects;
+    uint32_t failures;      // requests that failed or timed out
+    uint32_t cachedHits;    // connected on the cached channel, no scan
+    uint32_t cachedMisses;  // cached channel failed, fell back to a scan
+    uint32_t lastConnectMs; // request to associated
+    uint32_t lastReadyMs;   // request to IP and DNS ready
+    uint32_t maxReadyMs;
+    int64_t firstReadyMs;   // uptime when the network was first ready
+};
+
+extern struct k_event wifiEvents;
+
+/*
+    Called from the network management thread on every state change, with
+    the new state bits. Must not block.
+*/
+struct wifi_listener {
+    sys_snode_t node;
+    void (*handler)(uint32_t events);
+};
+
+void wifi_add_listener(struct wifi_listener *listener);
+
+bool wifi_is_ready(void);
+
+/*
+    Block until link, IP and DNS are all up. Returns 0, or -EAGAIN on
+    timeout.
+*/
+int wifi_wait_ready(k_timeout_t timeout);
+
+void wifi_get_stats(struct wifi_conn_stats *stats);
+
+/*
+    Radio scheduler: off disconnects and keeps the thread from reconnecting
+    until it is turned on again (on the cached channel, no scan).
+*/
+void wifi_set_radio(bool on);
+
+/*
+    WiFi power save with a RADIO_PS_LISTEN_INTERVAL listen interval, or back
+    to always awake. Returns the net_mgmt error, -ENOTSUP without driver
+    support.
+*/
+int wifi_power_save(bool on);
 
 void thread_wifi_entry(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -38,13 +38,9 @@ int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
     int16_t error;
     uint8_t data[3][4];
 
-    error =
-        sensirion_i2c_write_cmd(SCD30_I2C_ADDRESS, SCD30_CMD_READ_MEASUREMENT, dev);
-    if (error != NO_ERROR)
-        return error;
-
-    error = sensirion_i2c_read_words_as_bytes(SCD30_I2C_ADDRESS, &data[0][0],
-                                              SENSIRION_NUM_WORDS(data), dev);
+    error = sensirion_i2c_delayed_read_cmd_as_bytes(
+        SCD30_I2C_ADDRESS, SCD30_CMD_READ_MEASUREMENT, 0, &data[0][0],
+        SENSIRION_NUM_WORDS(data), dev);
     if (error != NO_ERROR)
         return error;
 
@@ -55,6 +51,52 @@ int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
     return NO_ERROR;
 }
 
+int16_t scd30_read_measurement_fixed(int32_t* co2_centi_ppm,
+                                     int32_t* temperature_milli_c,
+                                     int32_t* humidity_milli_rh,
+                                     const struct device* dev) {
+    int16_t error;
+    uint8_t data[SCD30_MEASUREMENT_BYTES];
+
+    error = sensirion_i2c_delayed_read_cmd_as_bytes(
+        SCD30_I2C_ADDRESS, SCD30_CMD_READ_MEASUREMENT, 0, data,
+        SENSIRION_NUM_WORDS(data), dev);
+    if (error != NO_ERROR)
+        return error;
+
+    scd30_measurement_fixed(data, co2_centi_ppm, temperature_milli_c,
+                            humidity_milli_rh);
+
+    return NO_ERROR;
+}
+
+int16_t scd30_read_measurement_submit(struct sensirion_i2c_txn* txn, uint8_t* data,
+                                      sensirion_i2c_cb_t cb, void* user_data,
+                                      const struct device* dev) {
+    *txn = (struct sensirion_i2c_txn){
+        .dev = dev,
+        .address = SCD30_I2C_ADDRESS,
+        .rx_data = data,
+        .rx_num_words = SCD30_MEASUREMENT_BYTES / SENSIRION_WORD_SIZE,
+        .rx_as_bytes = true,
+        .cb = cb,
+        .user_data = user_data,
+    };
+    txn->tx_len = sensirion_fill_cmd_send_buf(txn->tx_buf, SCD30_CMD_READ_MEASUREMENT,
+                                              NULL, 0);
+
+    return sensirion_i2c_submit(txn);
+}
+
+void scd30_measurement_fixed(const uint8_t* data, int32_t* co2_centi_ppm,
+                             int32_t* temperature_milli_c, int32_t* humidity_milli_rh) {
+    *co2_centi_ppm = sensirion_bytes_to_scaled_int32_t(&data[0], SCD30_CO2_SCALE);
+    *temperature_milli_c =
+        sensirion_bytes_to_scaled_int32_t(&data[4], SCD30_TEMPERATURE_SCALE);
+    *humidity_milli_rh =
+        sensirion_bytes_to_scaled_int32_t(&data[8], SCD30_HUMIDITY_SCALE);
+}
+
 int16_t scd30_set_measurement_interval(uint16_t interval_sec, const struct device* dev) {
     int16_t error;
 
@@ -63,10 +105,9 @@ int16_t scd30_set_measurement_interval(uint16_t interval_sec, const struct devic
         return STATUS_FAIL;
     }
 
-    error = sensirion_i2c_write_cmd_with_args(
+    error = sensirion_i2c_write_cmd_with_args_hold(
         SCD30_I2C_ADDRESS, SCD30_CMD_SET_MEASUREMENT_INTERVAL, &interval_sec,
-        SENSIRION_NUM_WORDS(interval_sec), dev);
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
+        SENSIRION_NUM_WORDS(interval_sec), SCD30_WRITE_DELAY_US, dev);
 
     return error;
 }
@@ -80,10 +121,10 @@ int16_t scd30_get_data_ready(uint16_t* data_ready, const struct device* dev) {
 int16_t scd30_set_temperature_offset(uint16_t temperature_offset, const struct device* dev) {
     int16_t error;
 
-    error = sensirion_i2c_write_cmd_with_args(
+    error = sensirion_i2c_write_cmd_with_args_hold(
         SCD30_I2C_ADDRESS, SCD30_CMD_SET_TEMPERATURE_OFFSET,
-        &temperature_offset, SENSIRION_NUM_WORDS(temperature_offset), dev);
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
+        &temperature_offset, SENSIRION_NUM_WORDS(temperature_offset),
+        SCD30_WRITE_DELAY_US, dev);
 
     return error;
 }
@@ -91,10 +132,9 @@ int16_t scd30_set_temperature_offset(uint16_t temperature_offset, const struct d
 int16_t scd30_set_altitude(uint16_t altitude, const struct device* dev) {
     int16_t error;
 
-    error = sensirion_i2c_write_cmd_with_args(SCD30_I2C_ADDRESS,
-                                              SCD30_CMD_SET_ALTITUDE, &altitude,
-                                              SENSIRION_NUM_WORDS(altitude), dev);
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
+    error = sensirion_i2c_write_cmd_with_args_hold(
+        SCD30_I2C_ADDRESS, SCD30_CMD_SET_ALTITUDE, &altitude,
+        SENSIRION_NUM_WORDS(altitude), SCD30_WRITE_DELAY_US, dev);
 
     return error;
 }
@@ -118,10 +158,9 @@ int16_t scd30_enable_automatic_self_calibration(uint8_t enable_asc, const struct
     int16_t error;
     uint16_t asc = !!enable_asc;
 
-    error = sensirion_i2c_write_cmd_with_args(SCD30_I2C_ADDRESS,
-                                              SCD30_CMD_AUTO_SELF_CALIBRATION,
-                                              &asc, SENSIRION_NUM_WORDS(asc), dev);
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
+    error = sensirion_i2c_write_cmd_with_args_hold(
+        SCD30_I2C_ADDRESS, SCD30_CMD_AUTO_SELF_CALIBRATION, &asc,
+        SENSIRION_NUM_WORDS(asc), SCD30_WRITE_DELAY_US, dev);
 
     return error;
 }
@@ -129,10 +168,9 @@ int16_t scd30_enable_automatic_self_calibration(uint8_t enable_asc, const struct
 int16_t scd30_set_forced_recalibration(uint16_t co2_ppm, const struct device* dev) {
     int16_t error;
 
-    error = sensirion_i2c_write_cmd_with_args(
+    error = sensirion_i2c_write_cmd_with_args_hold(
         SCD30_I2C_ADDRESS, SCD30_CMD_SET_FORCED_RECALIBRATION, &co2_ppm,
-        SENSIRION_NUM_WORDS(co2_ppm), dev);
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
+        SENSIRION_NUM_WORDS(co2_ppm), SCD30_WRITE_DELAY_US, dev);
 
     return error;
 }
@@ -140,13 +178,9 @@ int16_t scd30_set_forced_recalibration(uint16_t co2_ppm, const struct device* de
 int16_t scd30_read_serial(char* serial, const struct device* dev) {
     int16_t error;
 
-    error = sensirion_i2c_write_cmd(SCD30_I2C_ADDRESS, SCD30_CMD_READ_SERIAL, dev);
-    if (error)
-        return error;
-
-    sensirion_sleep_usec(SCD30_WRITE_DELAY_US);
-    error = sensirion_i2c_read_words_as_bytes(
-        SCD30_I2C_ADDRESS, (uint8_t*)serial, SCD30_SERIAL_NUM_WORDS, dev);
+    error = sensirion_i2c_delayed_read_cmd_as_bytes(
+        SCD30_I2C_ADDRESS, SCD30_CMD_READ_SERIAL, SCD30_WRITE_DELAY_US,
+        (uint8_t*)serial, SCD30_SERIAL_NUM_WORDS, dev);
     serial[2 * SCD30_SERIAL_NUM_WORDS] = '\0';
     return error;
 }
@@ -10,6 +10,8 @@
 #ifndef SCD30_H
 #define SCD30_H
 
+#include "sensirion_async.h"
+
 // I2C COMMANDS
 #define SCD30_I2C_ADDRESS                       0x61    //I2C device address   
 #define SCD30_CMD_START_PERIODIC_MEASUREMENT    0x0010  //Start continuous measurement
@@ -27,6 +29,13 @@
 #define SCD30_SERIAL_NUM_WORDS                  16
 #define SCD30_WRITE_DELAY_US                    20000
 
+// fixed-point scales for scd30_read_measurement_fixed
+#define SCD30_CO2_SCALE                         100     //centi-ppm
+#define SCD30_TEMPERATURE_SCALE                 1000    //milli-degC
+#define SCD30_HUMIDITY_SCALE                    1000    //milli-%RH
+// co2, temperature, humidity as big-endian floats
+#define SCD30_MEASUREMENT_BYTES                 12
+
 
 #define SCD30_MAX_BUFFER_WORDS 24
 #define SCD30_CMD_SINGLE_WORD_BUF_LEN \
@@ -37,6 +46,20 @@ int16_t scd30_start_periodic_measurement(uint16_t ambient_pressure_mbar, const s
 int16_t scd30_stop_periodic_measurement(const struct device* dev);
 int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
                                float* humidity, const struct device* dev);
+int16_t scd30_read_measurement_fixed(int32_t* co2_centi_ppm,
+                                     int32_t* temperature_milli_c,
+                                     int32_t* humidity_milli_rh,
+                                     const struct device* dev);
+/*
+    Queue a measurement read on the I2C engine and return at once. cb runs
+    on the engine's work queue; decode data with scd30_measurement_fixed().
+    txn and data (SCD30_MEASUREMENT_BYTES) must stay valid until then.
+*/
+int16_t scd30_read_measurement_submit(struct sensirion_i2c_txn* txn, uint8_t* data,
+                                      sensirion_i2c_cb_t cb, void* user_data,
+                                      const struct device* dev);
+void scd30_measurement_fixed(const uint8_t* data, int32_t* co2_centi_ppm,
+                             int32_t* temperature_milli_c, int32_t* humidity_milli_rh);
 int16_t scd30_set_measurement_interval(uint16_t interval_sec, const struct device* dev);
 int16_t scd30_get_data_ready(uint16_t* data_ready, const struct device* dev);
 int16_t scd30_set_temperature_offset(uint16_t temperature_offset, const struct device* dev);
@@ -0,0 +1,140 @@
+/**
+ ************************************************************************
+ * @file lib/sensirion_async.c
+ * @brief Queued, non-blocking I2C transactions for Sensirion sensors
+ *
+ * A single delayable work item walks the queue: write the command, come back
+ * after the processing delay to read the answer, then come back after the
+ * hold time to start the next transaction. No thread sleeps on the bus.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/device.h>
+#include "sensirion_async.h"
+
+K_THREAD_STACK_DEFINE(asyncStack, SENSIRION_ASYNC_STACK_SIZE);
+
+static struct k_work_q asyncQueue;
+static struct k_work_delayable asyncWork;
+static struct k_spinlock asyncLock;
+static sys_slist_t asyncPending;
+static bool asyncStarted;
+// set from the first submit until the queue is found empty, covers holds
+static bool asyncBusy;
+// transaction waiting out its processing delay before the read
+static struct sensirion_i2c_txn* asyncCurrent;
+
+struct sensirion_i2c_waiter {
+    struct k_sem done;
+    int16_t result;
+};
+
+static void sensirion_async_complete(struct sensirion_i2c_txn* txn, int16_t result) {
+    uint32_t hold_us = txn->hold_us;
+    sensirion_i2c_cb_t cb = txn->cb;
+    void* user_data = txn->user_data;
+
+    asyncCurrent = NULL;
+    if (cb)
+        cb(result, user_data);
+
+    k_work_reschedule_for_queue(&asyncQueue, &asyncWork,
+                                hold_us ? K_USEC(hold_us) : K_NO_WAIT);
+}
+
+static void sensirion_async_handler(struct k_work* work) {
+    struct sensirion_i2c_txn* txn = asyncCurrent;
+    sys_snode_t* node;
+    k_spinlock_key_t key;
+    int16_t ret;
+
+    if (txn) {
+        /* processing delay elapsed, collect the answer */
+        if (txn->rx_as_bytes)
+            ret = sensirion_i2c_read_words_as_bytes(txn->address, txn->rx_data,
+                                                    txn->rx_num_words, txn->dev);
+        else
+            ret = sensirion_i2c_read_words(txn->address, txn->rx_data,
+                                           txn->rx_num_words, txn->dev);
+        sensirion_async_complete(txn, ret);
+        return;
+    }
+
+    key = k_spin_lock(&asyncLock);
+    node = sys_slist_get(&asyncPending);
+    if (!node)
+        asyncBusy = false;
+    k_spin_unlock(&asyncLock, key);
+
+    if (!node)
+        return;
+
+    txn = CONTAINER_OF(node, struct sensirion_i2c_txn, node);
+    ret = sensirion_i2c_write(txn->address, txn->tx_buf, txn->tx_len, txn->dev);
+    if (ret != NO_ERROR || !txn->rx_data || !txn->rx_num_words) {
+        sensirion_async_complete(txn, ret);
+        return;
+    }
+
+    asyncCurrent = txn;
+    k_work_reschedule_for_queue(&asyncQueue, &asyncWork,
+                                txn->delay_us ? K_USEC(txn->delay_us) : K_NO_WAIT);
+}
+
+int16_t sensirion_i2c_submit(struct sensirion_i2c_txn* txn) {
+    k_spinlock_key_t key;
+    bool kick;
+
+    if (!asyncStarted)
+        return STATUS_FAIL;
+
+    key = k_spin_lock(&asyncLock);
+    sys_slist_append(&asyncPending, &txn->node);
+    kick = !asyncBusy;
+    asyncBusy = true;
+    k_spin_unlock(&asyncLock, key);
+
+    /* only kick an idle engine, rescheduling would cut a delay short */
+    if (kick)
+        k_work_reschedule_for_queue(&asyncQueue, &asyncWork, K_NO_WAIT);
+
+    return NO_ERROR;
+}
+
+static void sensirion_i2c_wake_waiter(int16_t result, void* user_data) {
+    struct sensirion_i2c_waiter* waiter = user_data;
+
+    waiter->result = result;
+    k_sem_give(&waiter->done);
+}
+
+int16_t sensirion_i2c_submit_wait(struct sensirion_i2c_txn* txn) {
+    struct sensirion_i2c_waiter waiter;
+    int16_t ret;
+
+    k_sem_init(&waiter.done, 0, 1);
+    txn->cb = sensirion_i2c_wake_waiter;
+    txn->user_data = &waiter;
+
+    ret = sensirion_i2c_submit(txn);
+    if (ret != NO_ERROR)
+        return ret;
+
+    k_sem_take(&waiter.done, K_FOREVER);
+    return waiter.result;
+}
+
+static int sensirion_async_init(void) {
+    k_work_queue_start(&asyncQueue, asyncStack,
+                       K_THREAD_STACK_SIZEOF(asyncStack),
+                       SENSIRION_ASYNC_PRIORITY, NULL);
+    k_thread_name_set(&asyncQueue.thread, "sensirion_i2c");
+    k_work_init_delayable(&asyncWork, sensirion_async_handler);
+    asyncStarted = true;
+
+    return 0;
+}
+
+SYS_INIT(sensirion_async_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,84 @@
+/**
+ ************************************************************************
+ * @file lib/sensirion_async.h
+ * @brief Queued, non-blocking I2C transactions for Sensirion sensors
+ **********************************************************************
+ * */
+
+#ifndef SENSIRION_ASYNC_H
+#define SENSIRION_ASYNC_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/slist.h>
+
+#include "sensirion_common.h"
+
+// completion callbacks run here, the sensor takes its samples in one
+#define SENSIRION_ASYNC_STACK_SIZE  2048
+#define SENSIRION_ASYNC_PRIORITY    0
+
+/**
+ * sensirion_i2c_cb_t - transaction completion callback
+ *
+ * Runs on the transaction engine's work queue. The transaction may be reused
+ * or freed as soon as the callback is entered. Must not call the blocking
+ * sensirion_i2c_* helpers.
+ *
+ * @result:     NO_ERROR on success, an error code otherwise
+ * @user_data:  pointer given at submission
+ */
+typedef void (*sensirion_i2c_cb_t)(int16_t result, void* user_data);
+
+/**
+ * struct sensirion_i2c_txn - one command, its processing delay and read-back
+ *
+ * @tx_buf/@tx_len:     command (and argument words) as built by
+ *                      sensirion_fill_cmd_send_buf()
+ * @delay_us:           sensor processing time between the write and the read
+ * @rx_data:            buffer for the read-back, NULL for write-only commands
+ * @rx_num_words:       data words to read (without CRC bytes)
+ * @rx_as_bytes:        keep the sensor's byte order instead of host uint16_t
+ * @hold_us:            bus quiet time the sensor needs after this command;
+ *                      following transactions are held back, the submitter is
+ *                      not
+ */
+struct sensirion_i2c_txn {
+    sys_snode_t node;
+    const struct device* dev;
+    uint8_t address;
+    uint8_t tx_buf[SENSIRION_MAX_BUFFER_WORDS];
+    uint16_t tx_len;
+    uint32_t delay_us;
+    void* rx_data;
+    uint16_t rx_num_words;
+    bool rx_as_bytes;
+    uint32_t hold_us;
+    sensirion_i2c_cb_t cb;
+    void* user_data;
+};
+
+/**
+ * sensirion_i2c_submit() - queue a transaction on the bus
+ *
+ * Returns immediately. Transactions are issued in submission order; the
+ * write/read delay and the hold time are waited out on the engine's work
+ * queue, so several operations can be queued back to back.
+ *
+ * @txn:        transaction, must stay valid until its callback runs
+ *
+ * @return      NO_ERROR on success, STATUS_FAIL if the engine is not running
+ */
+int16_t sensirion_i2c_submit(struct sensirion_i2c_txn* txn);
+
+/**
+ * sensirion_i2c_submit_wait() - queue a transaction and wait for it
+ *
+ * Blocking wrapper over sensirion_i2c_submit(). The caller only waits for
+ * its own write/read, not for the hold time. Overrides txn->cb.
+ *
+ * @return      NO_ERROR on success, an error code otherwise
+ */
+int16_t sensirion_i2c_submit_wait(struct sensirion_i2c_txn* txn);
+
+#endif
@@ -3,8 +3,10 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/i2c.h>
 #include "sensirion_common.h"
+#include "sensirion_async.h"
 
-
+/* number of bus transfers issued, for measuring bus load per sample */
+static atomic_t i2cTransfers = ATOMIC_INIT(0);
 
 /**
  * sensirion_i2c_write() - write helper function
@@ -17,6 +19,7 @@
  */
 int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data,
                             uint16_t count, const struct device* dev) {
+    atomic_inc(&i2cTransfers);
     return i2c_write(dev, data, count, address);
 }
 
@@ -31,9 +34,14 @@ int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data,
  */
 int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count, 
                             const struct device* dev) {
+    atomic_inc(&i2cTransfers);
     return i2c_read(dev, data, count, address);
 }
 
+uint32_t sensirion_i2c_get_transfer_count(void) {
+    return (uint32_t)atomic_get(&i2cTransfers);
+}
+
 void sensirion_sleep_usec(uint32_t useconds) {
     int32_t remaining = useconds;
     while (remaining > 0) {
@@ -60,6 +68,42 @@ float sensirion_bytes_to_float(const uint8_t* bytes) {
     return tmp.float32;
 }
 
+int32_t sensirion_bytes_to_scaled_int32_t(const uint8_t* bytes, uint32_t scale) {
+    uint32_t bits = sensirion_bytes_to_uint32_t(bytes);
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF);
+    uint64_t scaled = (uint64_t)(bits & 0x7FFFFF);
+    bool negative = (bits >> 31) != 0;
+    int32_t shift;
+
+    if (exponent == 0xFF)
+        /* inf/nan - saturate */
+        return negative ? INT32_MIN : INT32_MAX;
+
+    if (exponent == 0)
+        exponent = 1; /* subnormal, no implicit bit */
+    else
+        scaled |= 0x800000;
+
+    /* value * scale = mantissa * scale * 2^(exponent - 127 - 23) */
+    scaled *= scale;
+    shift = exponent - 150;
+
+    if (shift >= 0) {
+        if (scaled && (shift > 31 || scaled > ((uint64_t)INT32_MAX >> shift)))
+            return negative ? INT32_MIN : INT32_MAX;
+        scaled <<= shift;
+    } else if (shift > -64) {
+        /* round half away from zero */
+        scaled = (scaled + (1ULL << (-shift - 1))) >> -shift;
+        if (scaled > INT32_MAX)
+            return negative ? INT32_MIN : INT32_MAX;
+    } else {
+        scaled = 0;
+    }
+
+    return negative ? -(int32_t)scaled : (int32_t)scaled;
+}
+
 uint8_t sensirion_common_generate_crc(const uint8_t* data, uint16_t count) {
     uint16_t current_byte;
     uint8_t crc = CRC8_INIT;
@@ -86,8 +130,15 @@ int8_t sensirion_common_check_crc(const uint8_t* data, uint16_t count,
 }
 
 int16_t sensirion_i2c_general_call_reset(const struct device* dev) {
-    const uint8_t data = 0x06;
-    return sensirion_i2c_write(0, &data, (uint16_t)sizeof(data), dev);
+    /* queued like any other transfer, never in the middle of one */
+    struct sensirion_i2c_txn txn = {
+        .dev = dev,
+        .address = 0,
+        .tx_buf = {0x06},
+        .tx_len = 1,
+    };
+
+    return sensirion_i2c_submit_wait(&txn);
 }
 
 uint16_t sensirion_fill_cmd_send_buf(uint8_t* buf, uint16_t cmd,
@@ -157,37 +208,61 @@ int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words,
 }
 
 int16_t sensirion_i2c_write_cmd(uint8_t address, uint16_t command, const struct device* dev) {
-    uint8_t buf[SENSIRION_COMMAND_SIZE];
-
-    sensirion_fill_cmd_send_buf(buf, command, NULL, 0);
-    return sensirion_i2c_write(address, buf, SENSIRION_COMMAND_SIZE, dev);
+    return sensirion_i2c_write_cmd_with_args(address, command, NULL, 0, dev);
 }
 
 int16_t sensirion_i2c_write_cmd_with_args(uint8_t address, uint16_t command,
                                           const uint16_t* data_words,
                                           uint16_t num_words, const struct device* dev) {
-    uint8_t buf[SENSIRION_MAX_BUFFER_WORDS];
-    uint16_t buf_size;
+    return sensirion_i2c_write_cmd_with_args_hold(address, command, data_words,
+                                                  num_words, 0, dev);
+}
 
-    buf_size = sensirion_fill_cmd_send_buf(buf, command, data_words, num_words);
-    return sensirion_i2c_write(address, buf, buf_size, dev);
+int16_t sensirion_i2c_write_cmd_with_args_hold(uint8_t address, uint16_t command,
+                                               const uint16_t* data_words,
+                                               uint16_t num_words, uint32_t hold_us,
+                                               const struct device* dev) {
+    struct sensirion_i2c_txn txn = {
+        .dev = dev,
+        .address = address,
+        .hold_us = hold_us,
+    };
+
+    txn.tx_len = sensirion_fill_cmd_send_buf(txn.tx_buf, command, data_words,
+                                             num_words);
+    return sensirion_i2c_submit_wait(&txn);
 }
 
 int16_t sensirion_i2c_delayed_read_cmd(uint8_t address, uint16_t cmd,
                                        uint32_t delay_us, uint16_t* data_words,
                                        uint16_t num_words, const struct device* dev) {
-    int16_t ret;
-    uint8_t buf[SENSIRION_COMMAND_SIZE];
-
-    sensirion_fill_cmd_send_buf(buf, cmd, NULL, 0);
-    ret = sensirion_i2c_write(address, buf, SENSIRION_COMMAND_SIZE, dev);
-    if (ret != NO_ERROR)
-        return ret;
-
-    if (delay_us)
-        sensirion_sleep_usec(delay_us);
+    struct sensirion_i2c_txn txn = {
+        .dev = dev,
+        .address = address,
+        .delay_us = delay_us,
+        .rx_data = data_words,
+        .rx_num_words = num_words,
+    };
+
+    txn.tx_len = sensirion_fill_cmd_send_buf(txn.tx_buf, cmd, NULL, 0);
+    return sensirion_i2c_submit_wait(&txn);
+}
 
-    return sensirion_i2c_read_words(address, data_words, num_words, dev);
+int16_t sensirion_i2c_delayed_read_cmd_as_bytes(uint8_t address, uint16_t cmd,
+                                                uint32_t delay_us, uint8_t* data,
+                                                uint16_t num_words,
+                                                const struct device* dev) {
+    struct sensirion_i2c_txn txn = {
+        .dev = dev,
+        .address = address,
+        .delay_us = delay_us,
+        .rx_data = data,
+        .rx_num_words = num_words,
+        .rx_as_bytes = true,
+    };
+
+    txn.tx_len = sensirion_fill_cmd_send_buf(txn.tx_buf, cmd, NULL, 0);
+    return sensirion_i2c_submit_wait(&txn);
 }
 
 int16_t sensirion_i2c_read_cmd(uint8_t address, uint16_t cmd,
@@ -29,6 +29,14 @@ int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count,
 
 void sensirion_sleep_usec(uint32_t useconds);
 
+/**
+ * sensirion_i2c_get_transfer_count() - number of I2C reads and writes issued
+ *                                      since boot
+ *
+ * @return      Running count of bus transfers
+ */
+uint32_t sensirion_i2c_get_transfer_count(void);
+
 int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data,
                             uint16_t count, const struct device* dev);
 
@@ -65,6 +73,19 @@ uint32_t sensirion_bytes_to_uint32_t(const uint8_t* bytes);
  */
 float sensirion_bytes_to_float(const uint8_t* bytes);
 
+/**
+ * sensirion_bytes_to_scaled_int32_t() - Convert an array of bytes holding a
+ *                                       float to a scaled integer
+ *
+ * Decodes the big-endian IEEE-754 single with integer operations only and
+ * returns round(value * scale), saturated to the int32_t range.
+ *
+ * @param bytes An array of at least four bytes (MSB first)
+ * @param scale Fixed-point scale, e.g. 100 for hundredths
+ * @return      The byte array represented as a scaled integer
+ */
+int32_t sensirion_bytes_to_scaled_int32_t(const uint8_t* bytes, uint32_t scale);
+
 uint8_t sensirion_common_generate_crc(const uint8_t* data, uint16_t count);
 
 int8_t sensirion_common_check_crc(const uint8_t* data, uint16_t count,
@@ -152,6 +173,23 @@ int16_t sensirion_i2c_write_cmd_with_args(uint8_t address, uint16_t command,
                                           const uint16_t* data_words,
                                           uint16_t num_words, const struct device* dev);
 
+/**
+ * sensirion_i2c_write_cmd_with_args_hold() - writes a command with arguments
+ *                                            and keeps the bus quiet after it
+ * @address:    Sensor i2c address
+ * @command:    Sensor command
+ * @data:       Argument buffer with words to send
+ * @num_words:  Number of data words to send (without CRC bytes)
+ * @hold_us:    Time in microseconds the sensor needs before the next command.
+ *              Later transactions wait, the caller returns after the write.
+ *
+ * @return      NO_ERROR on success, an error code otherwise
+ */
+int16_t sensirion_i2c_write_cmd_with_args_hold(uint8_t address, uint16_t command,
+                                               const uint16_t* data_words,
+                                               uint16_t num_words, uint32_t hold_us,
+                                               const struct device* dev);
+
 /**
  * sensirion_i2c_delayed_read_cmd() - send a command, wait for the sensor to
  *                                    process and read data back
@@ -166,6 +204,24 @@ int16_t sensirion_i2c_write_cmd_with_args(uint8_t address, uint16_t command,
 int16_t sensirion_i2c_delayed_read_cmd(uint8_t address, uint16_t cmd,
                                        uint32_t delay_us, uint16_t* data_words,
                                        uint16_t num_words, const struct device* dev);
+
+/**
+ * sensirion_i2c_delayed_read_cmd_as_bytes() - send a command, wait for the
+ *                                             sensor to process and read the
+ *                                             data back as a byte-stream
+ * @address:    Sensor i2c address
+ * @cmd:        Command
+ * @delay:      Time in microseconds to delay sending the read request
+ * @data:       Allocated buffer to store the read bytes
+ * @num_words:  Data words to read (without CRC bytes)
+ *
+ * @return      NO_ERROR on success, an error code otherwise
+ */
+int16_t sensirion_i2c_delayed_read_cmd_as_bytes(uint8_t address, uint16_t cmd,
+                                                uint32_t delay_us, uint8_t* data,
+                                                uint16_t num_words,
+                                                const struct device* dev);
+
 /**
  * sensirion_i2c_read_cmd() - reads data words from the sensor after a command
  *                            is issued
@@ -8,65 +8,73 @@
  */
 #include <zephyr/kernel.h>
 #include <zephyr/net/http/client.h>
+#include <zephyr/settings/settings.h>
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(soil_respiration, LOG_LEVEL_DBG);
 
 #include "wifi.h"
-#include "mqtt.h"
-#include "sockets.h"
 #include "motor.h"
 #include "sensor.h"
 #include "ble.h"
+#include "ota.h"
+#include "uplink.h"
 
 #define WIFI_STACK_SIZE     4096
 #define WIFI_PRIORITY       1
 
-#define MQTT_STACK_SIZE     8192   
-#define MQTT_PRIORITY       -3
-
-#define HTTP_STACK_SIZE 	4096
-#define HTTP_PRIORITY		-2	
-
 #define SENSOR_STACK_SIZE 	1024
 #define SENSOR_PRIORITY		1	
 
-#define MOTOR_STACK_SIZE 	2048
-#define MOTOR_PRIORITY		-1	
-
 #define BLE_STACK_SIZE		2048
 #define BLE_PRIORITY		-1
 
+#define OTA_STACK_SIZE		4096
+#define OTA_PRIORITY		4
+
+// threads only run once main() starts them, after the settings are loaded
+#define THREAD_DELAY_MANUAL	K_TICKS_FOREVER
+
 
 K_THREAD_DEFINE(wifi_tid, WIFI_STACK_SIZE,
 	thread_wifi_entry, NULL, NULL, NULL,
-	WIFI_PRIORITY, 0, 100);
+	WIFI_PRIORITY, 0, THREAD_DELAY_MANUAL);
 
 K_THREAD_DEFINE(sensor_tid, SENSOR_STACK_SIZE,
 	thread_sensor_entry, NULL, NULL, NULL,
-	SENSOR_PRIORITY, 0, 100);
-
+	SENSOR_PRIORITY, 0, THREAD_DELAY_MANUAL);
 
-K_THREAD_DEFINE(mqtt_tid, MQTT_STACK_SIZE,
-	thread_mqtt_entry, NULL, NULL, NULL,
-	MQTT_PRIORITY, 0, 100);
 
-K_THREAD_DEFINE(motor_tid, MOTOR_STACK_SIZE,
-	thread_entry_motor, NULL, NULL, NULL,
-	MOTOR_PRIORITY, 0, 100);
+K_THREAD_DEFINE(uplink_tid, UPLINK_STACK_SIZE,
+	thread_uplink_entry, NULL, NULL, NULL,
+	UPLINK_PRIORITY, 0, THREAD_DELAY_MANUAL);
 
 K_THREAD_DEFINE(ble_tid, BLE_STACK_SIZE,
 	ble_thread_entry, NULL, NULL, NULL,
-	BLE_PRIORITY, 0, 100);
+	BLE_PRIORITY, 0, THREAD_DELAY_MANUAL);
+
+K_THREAD_DEFINE(ota_tid, OTA_STACK_SIZE,
+	thread_ota_entry, NULL, NULL, NULL,
+	OTA_PRIORITY, 0, THREAD_DELAY_MANUAL);
 
 int main(void) {
 
+	// persisted state (OTA resume point) before anything uses it
+	if (settings_subsys_init() == 0) {
+		settings_load();
+	} else {
+		LOG_ERR("Settings unavailable");
+	}
+
     k_thread_start(wifi_tid);
-    k_thread_start(mqtt_tid);
+    // "uplink/transport" is loaded by now, the thread runs what is logged
+    LOG_INF("Uplink: %s", uplink_transport_name(uplink_transport()));
+    k_thread_start(uplink_tid);
 	k_thread_start(sensor_tid);
-	k_thread_start(motor_tid);
+	motor_start();
 
 	k_thread_start(ble_tid);
+	k_thread_start(ota_tid);
 
     return 0;
 }
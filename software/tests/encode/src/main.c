@@ -0,0 +1,212 @@
+/**
+ ************************************************************************
+ * @file tests/encode/src/main.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains tests for the fixed-point sample path
+ *
+ * Checks sensirion_bytes_to_scaled_int32_t() and the text encoders against
+ * the float decode and printf they replaced, and times both paths. The
+ * timing needs a real CPU: native_sim runs code in zero simulated time, so
+ * there the benchmark is skipped and only the checks run.
+ **********************************************************************
+ * */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+#include "sensirion_common.h"
+#include "encode.h"
+
+// readings per timed run, and the distinct readings cycled through
+#define BENCH_SAMPLES   10000
+#define BENCH_READINGS  64
+
+// big-endian IEEE 754, as the SCD30 sends it
+static void float_bytes(float value, uint8_t *bytes) {
+
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    sys_put_be32(bits, bytes);
+}
+
+/*
+    value * scale rounded half away from zero, saturated to int32. A float
+    times a scale up to 1000 is exact in a double, so is the rounding.
+*/
+static int32_t scaled_reference(float value, uint32_t scale) {
+
+    double scaled = (double)value * scale;
+
+    if (scaled >= INT32_MAX + 0.5) {
+        return INT32_MAX;
+    }
+    if (scaled <= -(INT32_MAX + 0.5)) {
+        return INT32_MIN;
+    }
+
+    return (int32_t)(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+static void check_scaled(float value, uint32_t scale) {
+
+    uint8_t bytes[4];
+
+    float_bytes(value, bytes);
+    zassert_equal(sensirion_bytes_to_scaled_int32_t(bytes, scale),
+                  scaled_reference(value, scale), "%e x %u", (double)value, scale);
+}
+
+ZTEST(encode, test_scaled_matches_float) {
+
+    static const uint32_t scales[] = {100, 1000};
+    static const float values[] = {
+        0.0f, -0.0f, 1e-45f, 0.004f, 0.005f, 0.015f, 21.5f, -1.25f, 55.25f,
+        412.34f, 40000.0f, 2147483.0f, -2147484.0f, 3e38f,
+    };
+    float value;
+
+    for (int s = 0; s < ARRAY_SIZE(scales); s++) {
+        for (int i = 0; i < ARRAY_SIZE(values); i++) {
+            check_scaled(values[i], scales[s]);
+        }
+        // every exponent, both signs, normal and subnormal
+        for (uint32_t bits = 0; bits < 0x7f800000; bits += 0x1357) {
+            memcpy(&value, &bits, sizeof(value));
+            check_scaled(value, scales[s]);
+            check_scaled(-value, scales[s]);
+        }
+    }
+}
+
+ZTEST(encode, test_scaled_saturates) {
+
+    uint8_t bytes[4];
+
+    float_bytes(INFINITY, bytes);
+    zassert_equal(sensirion_bytes_to_scaled_int32_t(bytes, 100), INT32_MAX);
+    float_bytes(-INFINITY, bytes);
+    zassert_equal(sensirion_bytes_to_scaled_int32_t(bytes, 100), INT32_MIN);
+    float_bytes(NAN, bytes);
+    zassert_equal(sensirion_bytes_to_scaled_int32_t(bytes, 100), INT32_MAX);
+}
+
+/*
+    The sensor/ text a reading gave before and after the fixed-point change
+    must match, for readings that don't sit exactly on a rounding tie
+*/
+ZTEST(encode, test_sample_text_matches_float) {
+
+    static const float readings[][3] = {
+        {412.34f, 21.5f, 55.25f},
+        {0.0f, -10.0f, 0.0f},
+        {40000.0f, 69.999f, 100.0f},
+        {1234.5678f, -0.3f, 12.3456f},
+        {399.99f, 4.0004f, 0.01f},
+    };
+    struct sensor_sample sample = {.seq = 7};
+    uint8_t bytes[12];
+    char expected[64];
+    uint8_t text[64];
+    int len;
+
+    for (int i = 0; i < ARRAY_SIZE(readings); i++) {
+        for (int k = 0; k < 3; k++) {
+            float_bytes(readings[i][k], &bytes[4 * k]);
+        }
+        sample.co2 = sensirion_bytes_to_scaled_int32_t(&bytes[0], 100);
+        sample.temperature = sensirion_bytes_to_scaled_int32_t(&bytes[4], 1000);
+        sample.humidity = sensirion_bytes_to_scaled_int32_t(&bytes[8], 1000);
+
+        snprintf(expected, sizeof(expected), "7:%.2f,%.3f,%.3f,",
+                 (double)sensirion_bytes_to_float(&bytes[0]),
+                 (double)sensirion_bytes_to_float(&bytes[4]),
+                 (double)sensirion_bytes_to_float(&bytes[8]));
+        len = encode_sample_text(text, sizeof(text), &sample);
+        zassert_equal(len, strlen(expected), "%s", expected);
+        zassert_mem_equal(text, expected, len, "%s", expected);
+    }
+}
+
+ZTEST(encode, test_text_buffer_bounds) {
+
+    struct sensor_sample sample = {.seq = 4294967295u, .utc = 1792195200123LL,
+                                   .co2 = INT32_MIN, .temperature = INT32_MIN,
+                                   .humidity = INT32_MIN};
+    struct flux_record record = {.seq = 12, .slope = -1234567, .intercept = 41234,
+                                 .r2 = 987654, .n = 60, .meanTemperature = 21500,
+                                 .meanHumidity = 55000, .startUtc = 1792195200123LL};
+    uint8_t text[128];
+    int len;
+
+    len = encode_sample_text(text, sizeof(text), &sample);
+    zassert_true(len > 0);
+    for (int n = 0; n < len; n++) {
+        zassert_equal(encode_sample_text(text, n, &sample), -ENOMEM, "%d B", n);
+    }
+
+    len = encode_flux_text(text, sizeof(text), &record);
+    zassert_equal(len, strlen("12:-1.234567,412.34,0.987654,60,21.500,55.000,1792195200.123,"));
+    zassert_mem_equal(text, "12:-1.234567,412.34,0.987654,60,21.500,55.000,1792195200.123,", len);
+    for (int n = 0; n < len; n++) {
+        zassert_equal(encode_flux_text(text, n, &record), -ENOMEM, "%d B", n);
+    }
+}
+
+/*
+    Decode and encode of one reading, the float path as it was before the
+    fixed-point change and the path that replaced it
+*/
+ZTEST(encode, test_benchmark) {
+
+    static uint8_t raw[BENCH_READINGS][12];
+    struct sensor_sample sample = {0};
+    char text[64];
+    volatile uint32_t sink = 0;
+    uint32_t start, floatCycles, fixedCycles;
+    const uint8_t *r;
+
+    if (IS_ENABLED(CONFIG_ARCH_POSIX)) {
+        // no simulated time passes while code runs, nothing to measure
+        ztest_test_skip();
+    }
+
+    for (int i = 0; i < BENCH_READINGS; i++) {
+        float_bytes(400.0f + i * 1.37f, &raw[i][0]);
+        float_bytes(21.5f + i * 0.01f, &raw[i][4]);
+        float_bytes(55.25f - i * 0.1f, &raw[i][8]);
+    }
+
+    start = k_cycle_get_32();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        r = raw[i % BENCH_READINGS];
+        sink += snprintf(text, sizeof(text), "%f,%f,%f,",
+                         (double)sensirion_bytes_to_float(&r[0]),
+                         (double)sensirion_bytes_to_float(&r[4]),
+                         (double)sensirion_bytes_to_float(&r[8]));
+    }
+    floatCycles = k_cycle_get_32() - start;
+
+    start = k_cycle_get_32();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        r = raw[i % BENCH_READINGS];
+        sample.co2 = sensirion_bytes_to_scaled_int32_t(&r[0], 100);
+        sample.temperature = sensirion_bytes_to_scaled_int32_t(&r[4], 1000);
+        sample.humidity = sensirion_bytes_to_scaled_int32_t(&r[8], 1000);
+        sink += encode_sample_text((uint8_t *)text, sizeof(text), &sample);
+    }
+    fixedCycles = k_cycle_get_32() - start;
+
+    TC_PRINT("float decode + snprintf: %u ns/sample\n",
+             (uint32_t)(k_cyc_to_ns_floor64(floatCycles) / BENCH_SAMPLES));
+    TC_PRINT("fixed-point decode + encode_sample_text: %u ns/sample\n",
+             (uint32_t)(k_cyc_to_ns_floor64(fixedCycles) / BENCH_SAMPLES));
+    zassert_true(sink > 0);
+}
+
+ZTEST_SUITE(encode, NULL, NULL, NULL, NULL, NULL);
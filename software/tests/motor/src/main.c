@@ -0,0 +1,260 @@
+/**
+ ************************************************************************
+ * @file tests/motor/src/main.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains tests for the chamber state machine
+ *
+ * Runs inc/motor.c on native_sim, where hours of chamber cycles pass in
+ * simulated time. The module is included whole so each test starts it
+ * from INIT. Everything it calls outside is faked: the state changes it
+ * tells the radio scheduler are recorded with their uptime, and the
+ * network is up or down as the test says.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/ztest.h>
+#include "motor.c"
+
+// a step runs at its deadline rounded up to the next tick
+#define TOLERANCE_MS    (MSEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC + 1)
+// the three moves of INIT
+#define INIT_MS         (3 * MOTOR_DEAD_MS + 2 * SIX_SEC_TIMEOUT_MS + MOTOR_PAUSE_MS)
+// lowering and raising the chamber, settling included
+#define MOVE_MS         (SIX_SEC_TIMEOUT_MS + MOTOR_SETTLE_MS)
+
+struct transition {
+    States state;
+    int64_t durationMs;
+    int64_t at;
+};
+
+static struct transition transitions[16];
+static int transitionCount;
+static int fluxBegins;
+static int fluxFinishes;
+static int cycleEnds;
+static bool wifiReady;
+static struct wifi_listener *listener;
+
+bool wifi_is_ready(void) {
+
+    return wifiReady;
+}
+
+void wifi_add_listener(struct wifi_listener *added) {
+
+    listener = added;
+}
+
+void radio_motor_state(States next, int64_t durationMs) {
+
+    if (transitionCount < ARRAY_SIZE(transitions)) {
+        transitions[transitionCount++] = (struct transition){next, durationMs, k_uptime_get()};
+    }
+}
+
+void uplink_motor_state(States next, int64_t durationMs) {
+}
+
+void uplink_notify(void) {
+}
+
+void flux_begin(void) {
+
+    fluxBegins++;
+}
+
+void flux_finish(void) {
+
+    fluxFinishes++;
+}
+
+void batch_cycle_end(void) {
+
+    cycleEnds++;
+}
+
+// the network comes up, as the wifi module reports it
+static void wifi_up(void) {
+
+    wifiReady = true;
+    listener->handler(WIFI_EVT_READY);
+}
+
+static void sleep_until(int64_t uptimeMs) {
+
+    k_sleep(K_TIMEOUT_ABS_MS(uptimeMs));
+}
+
+static void check_pins(bool up, bool down) {
+
+    zassert_equal(gpio_emul_output_get(motorUp.port, motorUp.pin), up, "up pin");
+    zassert_equal(gpio_emul_output_get(motorDown.port, motorDown.pin), down, "down pin");
+}
+
+static void check_transition(int i, States next, int64_t durationMs, int64_t at) {
+
+    zassert_true(i < transitionCount, "only %d transitions", transitionCount);
+    zassert_equal(transitions[i].state, next, "transition %d", i);
+    zassert_equal(transitions[i].durationMs, durationMs, "transition %d", i);
+    zassert_within(transitions[i].at, at, TOLERANCE_MS, "transition %d at %lld, due %lld",
+                   i, transitions[i].at, at);
+}
+
+// stop the state machine and put it back as it was at boot
+static void motor_reset(void *fixture) {
+
+    struct k_work_sync sync;
+
+    k_work_cancel_delayable_sync(&motorWork, &sync);
+
+    state = INIT;
+    period = FIFTEEN_MIN_TIMEOUT_MS;
+    initStep = 0;
+    settling = false;
+    timed = false;
+    dueAt = 0;
+    cycleAt = 0;
+    cyclePeriod = 0;
+    atomic_clear(&networkWait);
+    memset(&stats, 0, sizeof(stats));
+
+    transitionCount = 0;
+    fluxBegins = 0;
+    fluxFinishes = 0;
+    cycleEnds = 0;
+    wifiReady = true;
+    listener = NULL;
+}
+
+ZTEST(motor, test_cycle_transitions) {
+
+    int64_t start, begin;
+    int64_t sensingEnd;
+
+    motor_start();
+    start = k_uptime_get();
+
+    // INIT: all the way up, stop, all the way down
+    sleep_until(start + MOTOR_DEAD_MS + SIX_SEC_TIMEOUT_MS / 2);
+    check_pins(true, false);
+    sleep_until(start + 2 * MOTOR_DEAD_MS + SIX_SEC_TIMEOUT_MS + MOTOR_PAUSE_MS / 2);
+    check_pins(false, false);
+    sleep_until(start + INIT_MS - SIX_SEC_TIMEOUT_MS / 2);
+    check_pins(false, true);
+    zassert_equal(transitionCount, 0);
+
+    begin = start + INIT_MS;
+    sensingEnd = begin + MOVE_MS + period;
+
+    // lowering, then settled and sensing
+    sleep_until(begin + SIX_SEC_TIMEOUT_MS / 2);
+    check_pins(false, true);
+    sleep_until(begin + MOVE_MS + 100);
+    check_pins(false, false);
+    zassert_equal(fluxBegins, 1);
+
+    // raising, then settled and asleep
+    sleep_until(sensingEnd + SIX_SEC_TIMEOUT_MS / 2);
+    check_pins(true, false);
+    zassert_equal(fluxFinishes, 1);
+    zassert_equal(cycleEnds, 1);
+    sleep_until(sensingEnd + MOVE_MS + 100);
+    check_pins(false, false);
+
+    sleep_until(begin + ONE_HOUR_TIMEOUT_MS + 100);
+    zassert_equal(transitionCount, 5);
+    check_transition(0, SENSING_BEGIN, SIX_SEC_TIMEOUT_MS, begin);
+    check_transition(1, SENSING, period, begin + MOVE_MS);
+    check_transition(2, SENSING_END, SIX_SEC_TIMEOUT_MS, sensingEnd);
+    check_transition(3, SLEEP, ONE_HOUR_TIMEOUT_MS - 2 * MOVE_MS - period, sensingEnd + MOVE_MS);
+    // the next cycle starts an hour after the last one began
+    check_transition(4, SENSING_BEGIN, SIX_SEC_TIMEOUT_MS, begin + ONE_HOUR_TIMEOUT_MS);
+    check_pins(false, true);
+}
+
+ZTEST(motor, test_period_change_next_cycle) {
+
+    int64_t begin;
+
+    motor_start();
+    begin = k_uptime_get() + INIT_MS;
+
+    // changed while lowering, the running cycle keeps its period
+    sleep_until(begin + 100);
+    period = 5 * 60 * MSEC_PER_SEC;
+    sleep_until(begin + ONE_HOUR_TIMEOUT_MS + MOVE_MS + 100);
+
+    zassert_equal(transitionCount, 6);
+    check_transition(1, SENSING, FIFTEEN_MIN_TIMEOUT_MS, begin + MOVE_MS);
+    check_transition(3, SLEEP, ONE_HOUR_TIMEOUT_MS - 2 * MOVE_MS - FIFTEEN_MIN_TIMEOUT_MS,
+                     begin + 2 * MOVE_MS + FIFTEEN_MIN_TIMEOUT_MS);
+    check_transition(5, SENSING, period, begin + ONE_HOUR_TIMEOUT_MS + MOVE_MS);
+}
+
+ZTEST(motor, test_wakeups_per_cycle) {
+
+    struct motor_stats before, after;
+    int64_t begin;
+
+    motor_start();
+    begin = k_uptime_get() + INIT_MS;
+
+    sleep_until(begin + 100);
+    motor_get_stats(&before);
+    zassert_equal(before.cycles, 1);
+    // the first step, one per move, and the cycle start
+    zassert_equal(before.wakeups, ARRAY_SIZE(initMoves) + 1);
+
+    sleep_until(begin + 3 * ONE_HOUR_TIMEOUT_MS + 100);
+    motor_get_stats(&after);
+    zassert_equal(after.cycles, 4);
+    // lower, settle, raise, settle, sleep, next cycle - nothing in between
+    zassert_equal(after.wakeups - before.wakeups, 3 * 6);
+    zassert_true(after.maxLateMs <= TOLERANCE_MS, "%u ms late", after.maxLateMs);
+    zassert_equal(after.networkWaits, 0);
+}
+
+ZTEST(motor, test_network_wait) {
+
+    struct motor_stats motorStats;
+    int64_t start, up, begin, resumed;
+
+    // no network at boot: INIT waits without moving or polling
+    wifiReady = false;
+    motor_start();
+    start = k_uptime_get();
+    sleep_until(start + 30 * MSEC_PER_SEC);
+    motor_get_stats(&motorStats);
+    zassert_equal(state, INIT);
+    zassert_equal(motorStats.wakeups, 1);
+    zassert_equal(motorStats.networkWaits, 1);
+    check_pins(false, false);
+
+    wifi_up();
+    up = k_uptime_get();
+    sleep_until(up + INIT_MS + 100);
+    check_transition(0, SENSING_BEGIN, SIX_SEC_TIMEOUT_MS, up + INIT_MS);
+    begin = transitions[0].at;
+
+    // gone again when the next cycle is due: SLEEP runs over
+    wifiReady = false;
+    sleep_until(begin + ONE_HOUR_TIMEOUT_MS + 10 * 60 * MSEC_PER_SEC);
+    zassert_equal(transitionCount, 4);
+    zassert_equal(state, SLEEP);
+    motor_get_stats(&motorStats);
+    zassert_equal(motorStats.networkWaits, 2);
+
+    // the cycle starts when the network is back, and the hour counts from then
+    wifi_up();
+    resumed = k_uptime_get();
+    sleep_until(resumed + 100);
+    check_transition(4, SENSING_BEGIN, SIX_SEC_TIMEOUT_MS, resumed);
+    sleep_until(resumed + ONE_HOUR_TIMEOUT_MS + 100);
+    check_transition(8, SENSING_BEGIN, SIX_SEC_TIMEOUT_MS, resumed + ONE_HOUR_TIMEOUT_MS);
+}
+
+ZTEST_SUITE(motor, NULL, NULL, motor_reset, NULL, NULL);
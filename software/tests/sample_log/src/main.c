@@ -0,0 +1,261 @@
+/**
+ ************************************************************************
+ * @file tests/sample_log/src/main.c
+ * @author Thomas Salpietro 45822490
+ * @date 17/10/2026
+ * @brief Contains tests for the flash store-and-forward sample log
+ *
+ * Runs the log on the flash simulator. The module is included whole so a
+ * reboot can be played by clearing its state and running the init again
+ * over what is left in flash.
+ **********************************************************************
+ * */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "sample_log.c"
+
+// far more appends than the 16 sector test partition holds
+#define FILL_LIMIT  8192
+
+// forget everything held in RAM, then recover from flash as at boot
+static void reboot(void) {
+
+    logReady = false;
+    memset(&logFcb, 0, sizeof(logFcb));
+    memset(&readLoc, 0, sizeof(readLoc));
+    nextSeq = 0;
+    bootSeq = 0;
+    reservedSeq = 0;
+    replayedSeq = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    sample_log_init();
+    zassert_true(logReady, "log not recovered");
+}
+
+static void erase_log(void *fixture) {
+
+    const struct flash_area *fa;
+
+    zassert_ok(flash_area_open(FIXED_PARTITION_ID(samplelog_partition), &fa));
+    zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+    flash_area_close(fa);
+
+    reboot();
+}
+
+static uint32_t append_sample(void) {
+
+    struct sensor_sample sample = {
+        .timestamp = k_uptime_get(),
+        .seq = sample_log_next_seq(),
+        .co2 = 41234,
+        .temperature = 21500,
+        .humidity = 55000,
+    };
+
+    zassert_ok(sample_log_append(&sample));
+
+    return sample.seq;
+}
+
+/*
+    Replay everything pending in batches of batch, checking the sequence
+    numbers run from first to last without a gap. Returns the count.
+*/
+static uint32_t drain(uint32_t first, uint32_t last, size_t batch) {
+
+    struct sensor_sample out[16];
+    uint32_t expected = first;
+    uint32_t total = 0;
+    size_t n;
+
+    while ((n = sample_log_peek(out, MIN(batch, ARRAY_SIZE(out)))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            zassert_equal(out[i].seq, expected, "gap before seq %u", out[i].seq);
+            expected++;
+        }
+        total += n;
+        sample_log_consume(n);
+    }
+
+    zassert_equal(expected, last + 1, "replay stopped at seq %u", expected);
+    zassert_true(sample_log_empty());
+
+    return total;
+}
+
+ZTEST(sample_log, test_append_until_full) {
+
+    struct sample_log_stats before, after;
+    uint32_t last = 0;
+    uint32_t appended;
+    int i;
+
+    for (i = 0; i < FILL_LIMIT && stats.dropped == 0; i++) {
+        last = append_sample();
+    }
+    zassert_true(stats.dropped > 0, "log never filled");
+    appended = stats.appended;
+
+    // round the whole log again, every sector is dropped at least once
+    for (i = 0; i < appended; i++) {
+        last = append_sample();
+    }
+
+    sample_log_get_stats(&before);
+    zassert_equal(before.appended, 2 * appended);
+    zassert_equal(before.errors, 0);
+    zassert_equal(before.pending, before.appended - before.dropped);
+
+    // the oldest samples went first, the rest replay intact
+    zassert_equal(drain(before.dropped, last, 16), before.pending);
+
+    sample_log_get_stats(&after);
+    zassert_equal(after.replayed, before.pending);
+    zassert_equal(after.pending, 0);
+}
+
+ZTEST(sample_log, test_reboot_seq_above_handed_out) {
+
+    uint32_t last = 0;
+    uint32_t boot;
+    int i;
+
+    // taken while the uplink was up, so never logged
+    for (i = 0; i < 3 * SAMPLE_LOG_SEQ_BLOCK + 17; i++) {
+        last = sample_log_next_seq();
+    }
+    reboot();
+    zassert_true(sample_log_boot_seq() > last, "boot seq %u", sample_log_boot_seq());
+    zassert_equal(sample_log_next_seq(), sample_log_boot_seq());
+
+    // back to back reboots with one number each
+    for (i = 0; i < 4; i++) {
+        last = sample_log_next_seq();
+        reboot();
+        zassert_true(sample_log_next_seq() > last, "reboot %d", i);
+    }
+
+    // a full log rotates out the sectors holding the early marks
+    for (i = 0; i < FILL_LIMIT && stats.dropped == 0; i++) {
+        last = append_sample();
+    }
+    zassert_true(stats.dropped > 0, "log never filled");
+    for (i = 0; i < SAMPLE_LOG_SEQ_BLOCK + 5; i++) {
+        last = sample_log_next_seq();
+    }
+    reboot();
+    boot = sample_log_boot_seq();
+    zassert_true(boot > last, "boot seq %u after %u", boot, last);
+    zassert_equal(sample_log_next_seq(), boot);
+}
+
+ZTEST(sample_log, test_replay_across_rotation) {
+
+    struct sensor_sample out[10];
+    uint32_t first, last = 0;
+    uint32_t marked = 0;
+    uint32_t expected;
+    struct flash_sector *oldest;
+    int rotations = 0;
+    size_t n;
+    int i;
+
+    // several sectors' worth
+    first = append_sample();
+    for (i = 1; i < 400; i++) {
+        last = append_sample();
+    }
+
+    // replay half, remembering the replay position the last rotation saved
+    oldest = logFcb.f_oldest;
+    expected = first;
+    while (expected < first + 200) {
+        n = sample_log_peek(out, ARRAY_SIZE(out));
+        zassert_equal(n, ARRAY_SIZE(out));
+        zassert_equal(out[0].seq, expected);
+        expected += n;
+        sample_log_consume(n);
+        if (logFcb.f_oldest != oldest) {
+            oldest = logFcb.f_oldest;
+            marked = replayedSeq;
+            rotations++;
+        }
+    }
+    zassert_true(rotations > 0, "no sector was freed");
+
+    // at most what was sent since the last mark comes again
+    reboot();
+    n = sample_log_peek(out, 1);
+    zassert_equal(n, 1);
+    zassert_true(out[0].seq >= marked && out[0].seq <= expected,
+                 "replay resumed at %u, saved %u, sent to %u", out[0].seq, marked, expected);
+    zassert_equal(stats.pending, last + 1 - out[0].seq);
+
+    drain(out[0].seq, last, 7);
+
+    // drained, so the next boot has nothing to send
+    reboot();
+    zassert_true(sample_log_empty());
+    zassert_equal(sample_log_peek(out, ARRAY_SIZE(out)), 0);
+    zassert_true(sample_log_next_seq() > last);
+}
+
+ZTEST(sample_log, test_flux_in_log_order) {
+
+    struct sensor_sample out[16];
+    struct flux_record record = {
+        .start = 1000,
+        .end = 61000,
+        .slope = -1234567,
+        .intercept = 41234,
+        .r2 = 987654,
+        .n = 60,
+        .meanTemperature = 21500,
+        .meanHumidity = 55000,
+    };
+    struct flux_record replayed;
+    uint32_t first, last;
+    int i;
+
+    first = append_sample();
+    for (i = 1; i < 5; i++) {
+        append_sample();
+    }
+    record.seq = sample_log_next_seq();
+    zassert_ok(sample_log_append_flux(&record));
+    append_sample();
+    last = append_sample();
+    zassert_equal(stats.fluxAppended, 1);
+    zassert_equal(stats.pending, 8);
+
+    // the samples before the record, and nothing past it
+    zassert_equal(sample_log_peek(out, ARRAY_SIZE(out)), 5);
+    zassert_equal(out[0].seq, first);
+    zassert_equal(sample_log_peek_flux(&replayed), -ENOENT);
+    sample_log_consume(5);
+
+    zassert_equal(sample_log_peek(out, ARRAY_SIZE(out)), 0);
+    zassert_ok(sample_log_peek_flux(&replayed));
+    zassert_mem_equal(&replayed, &record, sizeof(record));
+
+    /*
+        A reboot before the record is sent brings it back. Nothing was
+        marked since the samples went, so they come again first.
+    */
+    reboot();
+    zassert_true(sample_log_boot_seq() > last);
+    zassert_equal(sample_log_peek(out, ARRAY_SIZE(out)), 5);
+    zassert_equal(out[0].seq, first);
+    sample_log_consume(5);
+    zassert_ok(sample_log_peek_flux(&replayed));
+    zassert_equal(replayed.seq, record.seq);
+    sample_log_consume(1);
+
+    drain(record.seq + 1, last, 16);
+    zassert_equal(stats.replayed, 8);
+}
+
+ZTEST_SUITE(sample_log, NULL, NULL, erase_log, NULL, NULL);
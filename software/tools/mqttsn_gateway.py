@@ -0,0 +1,297 @@
+#!/usr/bin/env python3
+"""
+Minimal MQTT-SN gateway stand-in for the firmware's mqtt-sn uplink.
+
+Speaks the subset inc/mqtt_sn.c uses: CONNECT, predefined topic IDs,
+QoS 0 and 1 PUBLISH/PUBACK, SUBSCRIBE, PINGREQ and sleeping clients
+(DISCONNECT with a duration). Commands published while a client sleeps
+are held until it connects again.
+
+Received data is printed, or forwarded to an MQTT broker with --broker
+(needs paho-mqtt). Commands are read from stdin as "<topic> <payload>",
+e.g.  period/ {"unit":"min","value":"5"}
+
+Usage:
+  mqttsn_gateway.py                          # listen on udp/10000
+  mqttsn_gateway.py --broker mqtt.tago.io --username Token --password <token>
+  mqttsn_gateway.py --cbor                   # sensor topic is sensor/cbor/
+  mqttsn_gateway.py --selftest
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+CONNECT, CONNACK = 0x04, 0x05
+PUBLISH, PUBACK = 0x0C, 0x0D
+SUBSCRIBE, SUBACK = 0x12, 0x13
+PINGREQ, PINGRESP = 0x16, 0x17
+DISCONNECT = 0x18
+
+FLAG_DUP = 0x80
+FLAG_QOS1 = 0x20
+QOS_MASK = 0x60
+TOPIC_PREDEFINED = 0x01
+RC_ACCEPTED, RC_INVALID_TOPIC = 0x00, 0x02
+
+# must match MQTT_SN_TOPIC_* in inc/mqtt_sn.h
+TOPICS = {1: "sensor/", 2: "flux/", 3: "period/", 4: "fota/", 5: "uplink/", 6: "ota/status/"}
+
+
+def packet(msg_type, body=b""):
+    """Length, type and body, the three byte length form above 255."""
+    if len(body) + 2 <= 255:
+        return bytes([len(body) + 2, msg_type]) + body
+    return b"\x01" + struct.pack(">H", len(body) + 4) + bytes([msg_type]) + body
+
+
+def parse(data):
+    if len(data) >= 4 and data[0] == 0x01:
+        total, header = struct.unpack(">H", data[1:3])[0], 4
+    elif len(data) >= 2:
+        total, header = data[0], 2
+    else:
+        raise ValueError("short datagram")
+    if total < header or total > len(data):
+        raise ValueError("bad length %d for %d B" % (total, len(data)))
+    return data[header - 1], data[header:total]
+
+
+class Client:
+    def __init__(self, client_id):
+        self.client_id = client_id
+        self.asleep_until = None
+        self.subscriptions = set()
+        self.held = []          # (topic_id, payload) while asleep
+        self.last_id = 0
+        self.bytes_in = 0
+        self.payload_in = 0
+        self.seen = set()       # msg ids already delivered, DUP filter
+
+    def next_id(self):
+        self.last_id = self.last_id % 0xFFFF + 1
+        return self.last_id
+
+
+class Gateway:
+    """Protocol state only: handle() returns the datagrams to send back."""
+
+    def __init__(self, topics=None, deliver=print):
+        self.topics = dict(topics or TOPICS)
+        self.ids = {name: topic_id for topic_id, name in self.topics.items()}
+        self.clients = {}
+        self.deliver = deliver
+
+    def _publish_to(self, client, topic_id, payload):
+        body = bytes([FLAG_QOS1 | TOPIC_PREDEFINED]) + struct.pack(">HH", topic_id, client.next_id())
+        return packet(PUBLISH, body + payload)
+
+    def handle(self, addr, data):
+        msg_type, body = parse(data)
+        client = self.clients.get(addr)
+        if client:
+            client.bytes_in += len(data)
+
+        if msg_type == CONNECT:
+            client_id = body[4:].decode(errors="replace")
+            if not client or client.client_id != client_id:
+                client = self.clients[addr] = Client(client_id)
+                client.bytes_in = len(data)
+            client.asleep_until = None
+            replies = [packet(CONNACK, bytes([RC_ACCEPTED]))]
+            replies += [self._publish_to(client, t, p) for t, p in client.held]
+            client.held = []
+            return replies
+        if not client:
+            return []
+
+        if msg_type == PUBLISH:
+            flags, topic_id, msg_id = body[0], *struct.unpack(">HH", body[1:5])
+            name = self.topics.get(topic_id) if flags & 0x03 == TOPIC_PREDEFINED else None
+            if name and not (flags & FLAG_DUP and msg_id in client.seen):
+                client.payload_in += len(body) - 5
+                self.deliver(client.client_id, name, body[5:])
+            client.seen.add(msg_id)
+            if flags & QOS_MASK == FLAG_QOS1:
+                rc = RC_ACCEPTED if name else RC_INVALID_TOPIC
+                return [packet(PUBACK, struct.pack(">HHB", topic_id, msg_id, rc))]
+            return []
+        if msg_type == SUBSCRIBE:
+            msg_id, topic_id = struct.unpack(">HH", body[1:5])
+            known = topic_id in self.topics
+            if known:
+                client.subscriptions.add(topic_id)
+            rc = RC_ACCEPTED if known else RC_INVALID_TOPIC
+            return [packet(SUBACK, bytes([FLAG_QOS1]) + struct.pack(">HHB", topic_id, msg_id, rc))]
+        if msg_type == PINGREQ:
+            return [packet(PINGRESP)]
+        if msg_type == DISCONNECT:
+            if len(body) >= 2:
+                duration = struct.unpack(">H", body[:2])[0]
+                client.asleep_until = time.monotonic() + duration
+                print("%s asleep for %d s" % (client.client_id, duration), file=sys.stderr)
+            else:
+                del self.clients[addr]
+            return [packet(DISCONNECT)]
+        return []
+
+    def command(self, topic, payload):
+        """Publish a command to every subscribed client, held for sleepers."""
+        topic_id = self.ids.get(topic)
+        if topic_id is None:
+            raise ValueError("no topic ID for %s" % topic)
+        out = []
+        for addr, client in self.clients.items():
+            if topic_id not in client.subscriptions:
+                continue
+            if client.asleep_until is not None:
+                client.held.append((topic_id, payload))
+            else:
+                out.append((addr, self._publish_to(client, topic_id, payload)))
+        return out
+
+
+def serve(args):
+    topics = dict(TOPICS)
+    if args.cbor:
+        topics[1] = "sensor/cbor/"
+    broker = None
+
+    def deliver(client_id, topic, payload):
+        if broker:
+            broker.publish(topic, payload, qos=1)
+        print("%s %s %s" % (client_id, topic, payload.hex() if args.cbor and
+                                                 topic == topics[1] else payload.decode(errors="replace")))
+        sys.stdout.flush()
+
+    gateway = Gateway(topics, deliver)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    lock = threading.Lock()
+
+    if args.broker:
+        import paho.mqtt.client as mqtt
+        host, _, port = args.broker.partition(":")
+        broker = mqtt.Client()
+        if args.username:
+            broker.username_pw_set(args.username, args.password)
+
+        def on_message(_client, _userdata, msg):
+            with lock:
+                for addr, data in gateway.command(msg.topic, msg.payload):
+                    sock.sendto(data, addr)
+
+        broker.on_message = on_message
+        broker.connect(host, int(port or 1883))
+        for name in ("period/", "fota/", "uplink/"):
+            broker.subscribe(name, qos=1)
+        broker.loop_start()
+
+    def read_commands():
+        for line in sys.stdin:
+            topic, _, payload = line.strip().partition(" ")
+            if not topic:
+                continue
+            with lock:
+                try:
+                    for addr, data in gateway.command(topic, payload.encode()):
+                        sock.sendto(data, addr)
+                except ValueError as err:
+                    print(err, file=sys.stderr)
+
+    threading.Thread(target=read_commands, daemon=True).start()
+    print("MQTT-SN gateway on udp/%d" % args.port, file=sys.stderr)
+
+    while True:
+        data, addr = sock.recvfrom(2048)
+        with lock:
+            try:
+                replies = gateway.handle(addr, data)
+            except (ValueError, struct.error) as err:
+                print("%s: %s" % (addr, err), file=sys.stderr)
+                continue
+            for reply in replies:
+                sock.sendto(reply, addr)
+            client = gateway.clients.get(addr)
+            if client and client.payload_in:
+                print("%s: %d B in, %d B payload, %.1f%% overhead" % (
+                    client.client_id, client.bytes_in, client.payload_in,
+                    100.0 * (client.bytes_in - client.payload_in) / client.bytes_in),
+                    file=sys.stderr)
+
+
+def selftest():
+    got = []
+    gw = Gateway(deliver=lambda cid, topic, payload: got.append((cid, topic, payload)))
+    addr = ("10.0.0.2", 50000)
+
+    connect = packet(CONNECT, bytes([0, 1]) + struct.pack(">H", 300) + b"soil_resp")
+    assert len(connect) == 15
+    assert gw.handle(addr, connect) == [packet(CONNACK, b"\x00")]
+
+    suback = gw.handle(addr, packet(SUBSCRIBE, bytes([FLAG_QOS1 | TOPIC_PREDEFINED]) +
+                                    struct.pack(">HH", 1, 3)))
+    assert parse(suback[0]) == (SUBACK, bytes([FLAG_QOS1]) + struct.pack(">HHB", 3, 1, 0))
+
+    sample = b"7:412.34,21.500,55.250,"
+    publish = packet(PUBLISH, bytes([FLAG_QOS1 | TOPIC_PREDEFINED]) + struct.pack(">HH", 1, 2) + sample)
+    assert gw.handle(addr, publish) == [packet(PUBACK, struct.pack(">HHB", 1, 2, 0))]
+    # resent with DUP after a lost PUBACK: acknowledged, not delivered twice
+    dup = bytearray(publish)
+    dup[2] |= FLAG_DUP
+    assert gw.handle(addr, bytes(dup)) == [packet(PUBACK, struct.pack(">HHB", 1, 2, 0))]
+    assert got == [("soil_resp", "sensor/", sample)]
+
+    # over 255 B takes the long length form
+    big = b"x" * 300
+    long_publish = packet(PUBLISH, bytes([FLAG_QOS1 | TOPIC_PREDEFINED]) + struct.pack(">HH", 1, 4) + big)
+    assert long_publish[0] == 0x01 and len(long_publish) == 309
+    gw.handle(addr, long_publish)
+    assert got[-1][2] == big
+
+    # OTA progress at QoS 0: delivered, nothing comes back
+    progress = b"progress,65536,901120,20480,0,"
+    ota = packet(PUBLISH, bytes([TOPIC_PREDEFINED]) + struct.pack(">HH", 6, 0) + progress)
+    assert gw.handle(addr, ota) == []
+    assert got[-1] == ("soil_resp", "ota/status/", progress)
+
+    assert gw.handle(addr, packet(PINGREQ)) == [packet(PINGRESP)]
+
+    # sleeping: a command is held until the next CONNECT
+    assert gw.handle(addr, packet(DISCONNECT, struct.pack(">H", 960))) == [packet(DISCONNECT)]
+    assert gw.command("period/", b'{"value":"5"}') == []
+    replies = gw.handle(addr, connect)
+    assert replies[0] == packet(CONNACK, b"\x00")
+    msg_type, body = parse(replies[1])
+    assert msg_type == PUBLISH and struct.unpack(">H", body[1:3])[0] == 3
+    assert body[5:] == b'{"value":"5"}'
+    # awake: straight through
+    assert len(gw.command("period/", b'{"value":"10"}')) == 1
+
+    print("selftest ok")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=10000)
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--broker", help="host[:port] of an MQTT broker to forward to")
+    parser.add_argument("--username")
+    parser.add_argument("--password")
+    parser.add_argument("--cbor", action="store_true",
+                        help="the firmware is built with BATCH_ENCODING_CBOR")
+    parser.add_argument("--selftest", action="store_true", help="run the protocol check")
+    args = parser.parse_args()
+
+    if args.selftest:
+        selftest()
+        return 0
+    serve(args)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""
+Compress firmware images for compressed OTA downloads.
+
+Writes zephyr.signed.bin.hs: a small header (see inc/ota_lzss.h) and a
+heatshrink -w 10 -l 4 stream, which the device decompresses into slot 1 as it
+downloads. The device asks for it when there is no patch for its version and
+falls back to zephyr.signed.bin when the server has no such file.
+
+Usage (in ./build/zephyr):
+  ota_compress.py zephyr.signed.bin                  # writes zephyr.signed.bin.hs
+  ota_compress.py --check zephyr.signed.bin.hs zephyr.signed.bin
+  ota_compress.py --bench zephyr.signed.bin --rate 20000
+  ota_compress.py --selftest
+"""
+
+import argparse
+import hashlib
+import random
+import struct
+import sys
+
+MAGIC = b"SRHS"
+VERSION = 1
+WINDOW_BITS = 10
+LOOKAHEAD_BITS = 4
+HEADER = struct.Struct("<4sBBBxI32s")
+
+WINDOW = 1 << WINDOW_BITS
+MAX_MATCH = 1 << LOOKAHEAD_BITS
+# a back reference is 15 bits, two literals are 18
+MIN_MATCH = 2
+# candidates tried per position, more is slower and barely smaller
+CHAIN = 32
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.n = 0
+
+    def put(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.n += bits
+        while self.n >= 8:
+            self.n -= 8
+            self.out.append((self.acc >> self.n) & 0xFF)
+        self.acc &= (1 << self.n) - 1
+
+    def finish(self):
+        if self.n:
+            self.out.append((self.acc << (8 - self.n)) & 0xFF)
+        return bytes(self.out)
+
+
+def compress_stream(data):
+    bits = BitWriter()
+    chains = {}
+    i = 0
+    while i < len(data):
+        best_len, best_dist = 0, 0
+        key = data[i:i + 2]
+        if len(key) == 2:
+            for pos in reversed(chains.get(key, ())):
+                dist = i - pos
+                if dist > WINDOW:
+                    break
+                n = 2
+                limit = min(MAX_MATCH, len(data) - i)
+                while n < limit and data[pos + n] == data[i + n]:
+                    n += 1
+                if n > best_len:
+                    best_len, best_dist = n, dist
+                    if n == limit:
+                        break
+
+        step = best_len if best_len >= MIN_MATCH else 1
+        if step == 1:
+            bits.put(0x100 | data[i], 9)
+        else:
+            bits.put(0, 1)
+            bits.put(best_dist - 1, WINDOW_BITS)
+            bits.put(best_len - 1, LOOKAHEAD_BITS)
+
+        for pos in range(i, i + step):
+            k = data[pos:pos + 2]
+            chain = chains.setdefault(k, [])
+            chain.append(pos)
+            if len(chain) > CHAIN:
+                del chain[0]
+        i += step
+    return bits.finish()
+
+
+def decompress_stream(stream, size):
+    """Reference decoder, same checks as inc/ota_lzss.c."""
+    out = bytearray()
+    acc, n, pos = 0, 0, 0
+
+    def take(bits):
+        nonlocal acc, n, pos
+        while n < bits:
+            if pos >= len(stream):
+                return None
+            acc = (acc << 8) | stream[pos]
+            pos += 1
+            n += 8
+        n -= bits
+        return (acc >> n) & ((1 << bits) - 1)
+
+    while len(out) < size:
+        tag = take(1)
+        if tag is None:
+            break
+        if tag:
+            byte = take(8)
+            if byte is None:
+                break
+            out.append(byte)
+        else:
+            dist = take(WINDOW_BITS)
+            length = take(LOOKAHEAD_BITS)
+            if dist is None or length is None:
+                break
+            dist += 1
+            if dist > len(out):
+                raise ValueError("reference before the start of the image")
+            for _ in range(length + 1):
+                out.append(out[-dist])
+    if len(out) != size:
+        raise ValueError("image short or long: %d of %d bytes" % (len(out), size))
+    return bytes(out)
+
+
+def compress(image):
+    header = HEADER.pack(MAGIC, VERSION, WINDOW_BITS, LOOKAHEAD_BITS, len(image),
+                         hashlib.sha256(image).digest())
+    return header + compress_stream(image)
+
+
+def decompress(blob):
+    magic, version, window, lookahead, size, digest = HEADER.unpack_from(blob, 0)
+    if magic != MAGIC or version != VERSION or window != WINDOW_BITS or \
+            lookahead != LOOKAHEAD_BITS:
+        raise ValueError("not a version %d -w %d -l %d image" %
+                         (VERSION, WINDOW_BITS, LOOKAHEAD_BITS))
+    image = decompress_stream(blob[HEADER.size:], size)
+    if hashlib.sha256(image).digest() != digest:
+        raise ValueError("image digest mismatch")
+    return image
+
+
+def bench(image, rate):
+    """Transfer time of each artifact at a link rate, the part compression saves."""
+    blob = compress(image)
+    print("%-22s %9s %8s" % ("artifact", "bytes", "seconds"))
+    for name, size in (("zephyr.signed.bin", len(image)), ("zephyr.signed.bin.hs", len(blob))):
+        print("%-22s %9d %8.1f" % (name, size, size / rate))
+    print("saved %.1f%% of the download" % (100.0 - 100.0 * len(blob) / max(len(image), 1)))
+
+
+def selftest():
+    rng = random.Random(2)
+    text = b"".join(b"sensor %d ok;" % rng.randrange(100) for _ in range(3000))
+    cases = [b"", b"a", b"ab" * 40, bytes(5000), text,
+             bytes(rng.getrandbits(8) for _ in range(4000))]
+    for image in cases:
+        assert decompress(compress(image)) == image
+    assert len(compress(text)) < len(text) // 2
+    blob = bytearray(compress(text))
+    blob[-1] ^= 0x55
+    try:
+        decompress(bytes(blob))
+        raise AssertionError("corruption not caught")
+    except ValueError:
+        pass
+    print("selftest ok")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("image", nargs="?", help="image to compress")
+    parser.add_argument("-o", "--output", help="default: <image>.hs")
+    parser.add_argument("--check", nargs=2, metavar=("COMPRESSED", "IMAGE"),
+                        help="decompress and compare against the original")
+    parser.add_argument("--bench", metavar="IMAGE",
+                        help="compare download size and time against the plain image")
+    parser.add_argument("--rate", type=float, default=20000,
+                        help="link rate in bytes/s for --bench (default 20000)")
+    parser.add_argument("--selftest", action="store_true", help="run the round-trip check")
+    args = parser.parse_args()
+
+    if args.selftest:
+        selftest()
+        return 0
+    if args.check:
+        with open(args.check[0], "rb") as f:
+            blob = f.read()
+        with open(args.check[1], "rb") as f:
+            image = f.read()
+        if decompress(blob) != image:
+            print("MISMATCH")
+            return 1
+        print("ok")
+        return 0
+    if args.bench:
+        with open(args.bench, "rb") as f:
+            bench(f.read(), args.rate)
+        return 0
+    if not args.image:
+        parser.print_help()
+        return 1
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    blob = compress(image)
+    output = args.output or args.image + ".hs"
+    with open(output, "wb") as f:
+        f.write(blob)
+    print("%s: %d bytes, %.1f%% of the %d byte image" %
+          (output, len(blob), 100.0 * len(blob) / max(len(image), 1), len(image)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
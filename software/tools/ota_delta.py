@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""
+Make and apply OTA patches for delta firmware updates.
+
+A patch rebuilds a new zephyr.signed.bin from the one the device is running
+(see inc/ota_delta.h for the format). The device asks for
+/zephyr-<major>.<minor>.patch, named after its own SIMPLE_HTTP_OTA_*_VERSION,
+and falls back to the full image when the server has no such file.
+
+Usage (in ./build/zephyr, old image kept from the previous release):
+  ota_delta.py make old/zephyr.signed.bin zephyr.signed.bin --base-version 2.2
+  ota_delta.py apply old/zephyr.signed.bin zephyr-2.2.patch -o rebuilt.bin
+  ota_delta.py --selftest
+"""
+
+import argparse
+import hashlib
+import random
+import struct
+import sys
+
+MAGIC = b"SRDP"
+VERSION = 1
+HEADER = struct.Struct("<4sBBBxII32s")
+OP_COPY = 0x01
+OP_INSERT = 0x02
+COPY = struct.Struct("<BII")
+INSERT = struct.Struct("<BI")
+
+# base index granularity; any match of 2 * BLOCK - 1 bytes or more is found
+BLOCK = 8
+# shorter matches cost more as a COPY than as literal bytes
+MIN_COPY = 16
+
+
+def _match_len(base, src, target, dst):
+    """Length of the common run of base[src:] and target[dst:]."""
+    limit = min(len(base) - src, len(target) - dst)
+    n = 0
+    step = 256
+    while n < limit:
+        k = min(step, limit - n)
+        if base[src + n:src + n + k] == target[dst + n:dst + n + k]:
+            n += k
+            continue
+        if step == 1:
+            break
+        step = 1
+    return n
+
+
+def diff(base, target):
+    """Greedy COPY/INSERT operations turning base into target."""
+    index = {}
+    for pos in range(0, len(base) - BLOCK + 1, BLOCK):
+        index.setdefault(base[pos:pos + BLOCK], pos)
+
+    ops = []
+    literal = bytearray()
+    i = 0
+    next_src = 0  # where the last COPY ended, edits often keep the alignment
+    while i < len(target):
+        best_src, best_len = None, 0
+        candidates = [next_src] if next_src < len(base) else []
+        hit = index.get(target[i:i + BLOCK])
+        if hit is not None:
+            candidates.append(hit)
+        for src in candidates:
+            n = _match_len(base, src, target, i)
+            if n > best_len:
+                best_src, best_len = src, n
+
+        if best_len < MIN_COPY:
+            literal.append(target[i])
+            i += 1
+            continue
+
+        # take back literal bytes the match also covers
+        back = 0
+        while back < len(literal) and best_src - back > 0 and \
+                base[best_src - back - 1] == literal[-back - 1]:
+            back += 1
+        if back:
+            del literal[-back:]
+        if literal:
+            ops.append((OP_INSERT, bytes(literal)))
+            literal = bytearray()
+        ops.append((OP_COPY, best_src - back, best_len + back))
+        i += best_len
+        next_src = best_src + best_len
+
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+    return ops
+
+
+def make_patch(base, target, base_version):
+    major, minor = base_version
+    out = bytearray(HEADER.pack(MAGIC, VERSION, major, minor, len(base), len(target),
+                                hashlib.sha256(target).digest()))
+    for op in diff(base, target):
+        if op[0] == OP_COPY:
+            out += COPY.pack(OP_COPY, op[1], op[2])
+        else:
+            out += INSERT.pack(OP_INSERT, len(op[1])) + op[1]
+    return bytes(out)
+
+
+def apply_patch(base, patch):
+    """Reference decoder, same checks as inc/ota_delta.c."""
+    magic, version, _, _, base_size, target_size, digest = HEADER.unpack_from(patch, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d patch" % VERSION)
+    if base_size != len(base):
+        raise ValueError("patch is for a %d byte base, got %d" % (base_size, len(base)))
+
+    out = bytearray()
+    pos = HEADER.size
+    while len(out) < target_size:
+        op = patch[pos]
+        if op == OP_COPY:
+            _, src, n = COPY.unpack_from(patch, pos)
+            pos += COPY.size
+            if src + n > base_size:
+                raise ValueError("COPY outside the base image")
+            out += base[src:src + n]
+        elif op == OP_INSERT:
+            _, n = INSERT.unpack_from(patch, pos)
+            pos += INSERT.size
+            out += patch[pos:pos + n]
+            pos += n
+        else:
+            raise ValueError("bad opcode 0x%02x at %d" % (op, pos))
+        if len(out) > target_size:
+            raise ValueError("patch runs past the target image")
+    if pos != len(patch):
+        raise ValueError("%d bytes after the end of the patch" % (len(patch) - pos))
+    if hashlib.sha256(out).digest() != digest:
+        raise ValueError("target digest mismatch")
+    return bytes(out)
+
+
+def parse_version(text):
+    major, minor = text.split(".")
+    return int(major), int(minor)
+
+
+def selftest():
+    rng = random.Random(1)
+    base = bytes(rng.getrandbits(8) for _ in range(64 * 1024))
+    cases = {
+        "same": base,
+        "empty": b"",
+        "patched": base[:1000] + b"\x00" * 4 + base[1004:],
+        "inserted": base[:5000] + b"new code" + base[5000:],
+        "removed": base[:7000] + base[9000:],
+        "moved": base[32768:] + base[:32768],
+        "grown": base + bytes(rng.getrandbits(8) for _ in range(3000)),
+        "unrelated": bytes(rng.getrandbits(8) for _ in range(4096)),
+    }
+    for name, target in cases.items():
+        patch = make_patch(base, target, (2, 2))
+        assert apply_patch(base, patch) == target, name
+    small = make_patch(base, cases["inserted"], (2, 2))
+    assert len(small) < 200, len(small)
+    try:
+        apply_patch(base[:-1], small)
+        raise AssertionError("wrong base accepted")
+    except ValueError:
+        pass
+    print("selftest ok")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--selftest", action="store_true", help="run the round-trip check")
+    sub = parser.add_subparsers(dest="command")
+
+    make = sub.add_parser("make", help="write a patch from BASE to TARGET")
+    make.add_argument("base")
+    make.add_argument("target")
+    make.add_argument("--base-version", required=True, type=parse_version,
+                      help="major.minor the base image reports")
+    make.add_argument("-o", "--output", help="default: zephyr-<base version>.patch")
+
+    apply = sub.add_parser("apply", help="rebuild the target image, to check a patch")
+    apply.add_argument("base")
+    apply.add_argument("patch")
+    apply.add_argument("-o", "--output", required=True)
+
+    args = parser.parse_args()
+    if args.selftest:
+        selftest()
+        return 0
+
+    if args.command == "make":
+        with open(args.base, "rb") as f:
+            base = f.read()
+        with open(args.target, "rb") as f:
+            target = f.read()
+        patch = make_patch(base, target, args.base_version)
+        apply_patch(base, patch)
+        output = args.output or "zephyr-%d.%d.patch" % args.base_version
+        with open(output, "wb") as f:
+            f.write(patch)
+        print("%s: %d bytes, %.1f%% of the %d byte image" %
+              (output, len(patch), 100.0 * len(patch) / max(len(target), 1), len(target)))
+        return 0
+
+    if args.command == "apply":
+        with open(args.base, "rb") as f:
+            base = f.read()
+        with open(args.patch, "rb") as f:
+            patch = f.read()
+        with open(args.output, "wb") as f:
+            f.write(apply_patch(base, patch))
+        return 0
+
+    parser.print_help()
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
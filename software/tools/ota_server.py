@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+OTA image server for testing resumable downloads.
+
+Like `python3 -m http.server`, but answers `Range: bytes=N-` requests with
+206 Partial Content, which the stock server doesn't. It can also cut
+connections part way through a body to exercise the firmware's resume path,
+and throttle to a slow link to compare download times of the full, patch and
+compressed images (each response logs its size and time).
+
+Usage (in ./build/zephyr):
+  sudo python3 ota_server.py                         # port 80, no drops
+  sudo python3 ota_server.py --drop-after 65536      # cut every response after 64 KiB
+  sudo python3 ota_server.py --drop-after 65536 --drops 3
+  sudo python3 ota_server.py --no-range              # behave like http.server
+  sudo python3 ota_server.py --rate 20000            # 20 kB/s, like a site uplink
+"""
+
+import argparse
+import functools
+import http.server
+import os
+import re
+import shutil
+import sys
+import threading
+import time
+
+RANGE_RE = re.compile(r"bytes=(\d+)-(\d*)$")
+
+
+class RangeRequestHandler(http.server.SimpleHTTPRequestHandler):
+    # set from the command line
+    drop_after = 0
+    drops_left = -1
+    allow_range = True
+    rate = 0
+    lock = threading.Lock()
+
+    # keep-alive off, one request per connection like the firmware does
+    protocol_version = "HTTP/1.0"
+
+    def send_head(self):
+        path = self.translate_path(self.path)
+        if os.path.isdir(path) or not self.allow_range or "Range" not in self.headers:
+            self.range = None
+            return super().send_head()
+
+        match = RANGE_RE.match(self.headers["Range"].strip())
+        try:
+            f = open(path, "rb")
+        except OSError:
+            self.send_error(404, "File not found")
+            return None
+
+        size = os.fstat(f.fileno()).st_size
+        if not match:
+            f.close()
+            self.send_error(400, "Only bytes=N- and bytes=N-M ranges are supported")
+            return None
+
+        start = int(match.group(1))
+        end = int(match.group(2)) if match.group(2) else size - 1
+        if start >= size or end < start:
+            f.close()
+            self.send_response(416)
+            self.send_header("Content-Range", "bytes */%d" % size)
+            self.end_headers()
+            return None
+
+        end = min(end, size - 1)
+        self.range = (start, end)
+        f.seek(start)
+        self.send_response(206)
+        self.send_header("Content-Type", self.guess_type(path))
+        self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+        self.send_header("Content-Length", str(end - start + 1))
+        self.send_header("Accept-Ranges", "bytes")
+        self.end_headers()
+        return f
+
+    def copyfile(self, source, outputfile):
+        length = None
+        if self.range:
+            length = self.range[1] - self.range[0] + 1
+
+        limit = None
+        with self.lock:
+            if self.drop_after and self.drops_left != 0:
+                limit = self.drop_after
+                if self.drops_left > 0:
+                    type(self).drops_left -= 1
+
+        if limit is None and length is None and not self.rate:
+            shutil.copyfileobj(source, outputfile)
+            return
+
+        sent = 0
+        started = time.monotonic()
+        block = 16 * 1024 if not self.rate else max(512, int(self.rate) // 10)
+        while length is None or sent < length:
+            chunk = source.read(min(block, (length or 1 << 30) - sent))
+            if not chunk:
+                break
+            if self.rate:
+                # hold the average at --rate bytes/s
+                delay = started + (sent + len(chunk)) / self.rate - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+            if limit is not None and sent + len(chunk) > limit:
+                outputfile.write(chunk[:limit - sent])
+                outputfile.flush()
+                self.log_message("dropping connection after %d body bytes", limit)
+                # hard close, the client sees a truncated body
+                self.close_connection = True
+                self.connection.shutdown(2)
+                return
+            outputfile.write(chunk)
+            sent += len(chunk)
+        self.log_message("sent %d bytes of %s in %.1f s", sent, self.path,
+                         time.monotonic() - started)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--directory", default=os.getcwd())
+    parser.add_argument("--drop-after", type=int, default=0,
+                        help="close the connection after this many body bytes")
+    parser.add_argument("--drops", type=int, default=-1,
+                        help="only drop this many responses (default: all)")
+    parser.add_argument("--no-range", action="store_true",
+                        help="ignore Range headers, always send the whole file")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="limit each response to this many bytes/s")
+    args = parser.parse_args()
+
+    RangeRequestHandler.drop_after = args.drop_after
+    RangeRequestHandler.drops_left = args.drops
+    RangeRequestHandler.allow_range = not args.no_range
+    RangeRequestHandler.rate = args.rate
+
+    handler = functools.partial(RangeRequestHandler, directory=args.directory)
+    server = http.server.ThreadingHTTPServer((args.bind, args.port), handler)
+    print("Serving %s on %s:%d" % (args.directory, args.bind, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
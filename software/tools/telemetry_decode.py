@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+"""
+Decode sensor/ telemetry payloads from the soil respiration firmware.
+
+Handles both payload encodings (see inc/batch.h):
+  text - "seq@utc:co2,temperature,humidity," repeated, published on sensor/#,
+         "@utc" only once the device clock is synced
+  cbor - [version, base, t0, seq0, [[dt, dseq, co2, temperature, humidity], ...]]
+         on sensor/cbor/, base 0 = uptime, 1 = UTC
+
+Version 1 (no sequence numbers) and 2 (uptime only) payloads are still
+accepted.
+
+Prints one CSV row per sample:
+seq,uptime_ms,utc,co2_ppm,temperature_c,humidity_rh
+with utc as ISO 8601; columns a payload doesn't carry are left empty.
+Samples replayed from the flash log repeat sequence numbers; --dedup
+drops them.
+
+Usage:
+  telemetry_decode.py payload.bin            # raw payload bytes
+  telemetry_decode.py --hex 83011a...        # payload as hex
+  telemetry_decode.py --dedup payloads.txt   # one hex payload per line
+  telemetry_decode.py --selftest
+"""
+
+import argparse
+import datetime
+import sys
+
+CBOR_VERSION = 3
+TIME_UPTIME, TIME_UTC = 0, 1
+UTC_DECIMALS = 3
+CO2_DECIMALS = 2
+TEMPERATURE_DECIMALS = 3
+HUMIDITY_DECIMALS = 3
+
+
+class CborError(ValueError):
+    pass
+
+
+def _cbor_item(data, pos):
+    """Decode the subset of CBOR the firmware emits: ints and arrays."""
+    if pos >= len(data):
+        raise CborError("truncated payload")
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+
+    if major == 4 and info == 31:
+        items = []
+        while True:
+            if pos >= len(data):
+                raise CborError("unterminated array")
+            if data[pos] == 0xFF:
+                return items, pos + 1
+            item, pos = _cbor_item(data, pos)
+            items.append(item)
+
+    if info < 24:
+        value = info
+    elif info in (24, 25, 26, 27):
+        size = 1 << (info - 24)
+        if pos + size > len(data):
+            raise CborError("truncated integer")
+        value = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise CborError("unsupported additional info %d" % info)
+
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, pos = _cbor_item(data, pos)
+            items.append(item)
+        return items, pos
+    raise CborError("unsupported major type %d" % major)
+
+
+def decode_cbor(data):
+    """Return [(seq, uptime_ms, utc_ms, co2, temperature, humidity)] as scaled ints."""
+    root, end = _cbor_item(data, 0)
+    if end != len(data):
+        raise CborError("%d trailing bytes" % (len(data) - end))
+    if not isinstance(root, list) or not root:
+        raise CborError("expected [version, ...]")
+
+    version, base = root[0], TIME_UPTIME
+    if version == 1 and len(root) == 3:
+        _, timestamp, entries = root
+        seq, width = None, 4
+    elif version == 2 and len(root) == 4:
+        _, timestamp, seq, entries = root
+        width = 5
+    elif version == 3 and len(root) == 5:
+        _, base, timestamp, seq, entries = root
+        width = 5
+        if base not in (TIME_UPTIME, TIME_UTC):
+            raise CborError("unknown time base %r" % base)
+    else:
+        raise CborError("unknown payload version %r" % version)
+
+    samples = []
+    for entry in entries:
+        if not isinstance(entry, list) or len(entry) != width:
+            raise CborError("expected %d fields per sample" % width)
+        timestamp += entry[0]
+        if seq is not None:
+            seq = (seq + entry[1]) & 0xFFFFFFFF
+        times = (None, timestamp) if base == TIME_UTC else (timestamp, None)
+        samples.append((seq, *times, *entry[width - 3:]))
+    return samples
+
+
+def decode_text(data):
+    """Return [(seq, None, utc_ms, co2, temperature, humidity)] as scaled ints."""
+    fields = [f.strip() for f in data.decode("ascii").split(",") if f.strip()]
+    if len(fields) % 3:
+        raise ValueError("text payload has %d fields, not a multiple of 3" % len(fields))
+    scales = (CO2_DECIMALS, TEMPERATURE_DECIMALS, HUMIDITY_DECIMALS)
+    samples = []
+    for i in range(0, len(fields), 3):
+        seq = utc = None
+        group = fields[i:i + 3]
+        if ":" in group[0]:
+            seq, group[0] = group[0].split(":", 1)
+            if "@" in seq:
+                seq, utc = seq.split("@", 1)
+                utc = round(float(utc) * 10 ** UTC_DECIMALS)
+            seq = int(seq)
+        values = [round(float(group[k]) * 10 ** scales[k]) for k in range(3)]
+        samples.append((seq, None, utc, *values))
+    return samples
+
+
+def dedup(samples, seen):
+    """Drop samples whose sequence number was already decoded."""
+    fresh = []
+    for sample in samples:
+        if sample[0] is not None and sample[0] in seen:
+            continue
+        seen.add(sample[0])
+        fresh.append(sample)
+    return fresh
+
+
+def decode(data):
+    """Pick the encoding: text payloads are printable ASCII."""
+    if data and data[0] >> 5 == 4:
+        return decode_cbor(data)
+    return decode_text(data)
+
+
+def _fixed(value, decimals):
+    return "%.*f" % (decimals, value / 10 ** decimals)
+
+
+def _iso(utc_ms):
+    stamp = datetime.datetime.fromtimestamp(utc_ms / 1000, datetime.timezone.utc)
+    return stamp.strftime("%Y-%m-%dT%H:%M:%S.") + "%03dZ" % (utc_ms % 1000)
+
+
+def to_csv(samples):
+    rows = []
+    for seq, uptime, utc, co2, temperature, humidity in samples:
+        rows.append("%s,%s,%s,%s,%s,%s" % (
+            "" if seq is None else seq,
+            "" if uptime is None else uptime,
+            "" if utc is None else _iso(utc),
+            _fixed(co2, CO2_DECIMALS),
+            _fixed(temperature, TEMPERATURE_DECIMALS),
+            _fixed(humidity, HUMIDITY_DECIMALS)))
+    return rows
+
+
+def _cbor_uint(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, size in ((24, 1), (25, 2), (26, 4), (27, 8)):
+        if value < 1 << (8 * size):
+            return bytes([major << 5 | info]) + value.to_bytes(size, "big")
+    raise ValueError("integer too large")
+
+
+def _cbor_int(value):
+    return _cbor_uint(0, value) if value >= 0 else _cbor_uint(1, -1 - value)
+
+
+def encode_cbor(samples, indefinite=True):
+    """
+    Reference encoder matching encode_samples_cbor(), for round-trips.
+    Samples all on one time base, the first one's.
+    """
+    def array(items):
+        if indefinite:
+            return b"\x9f" + b"".join(items) + b"\xff"
+        return _cbor_uint(4, len(items)) + b"".join(items)
+
+    utc = bool(samples) and samples[0][2] is not None
+    times = [sample[2] if utc else sample[1] for sample in samples]
+    seq0, t0 = (samples[0][0], times[0]) if samples else (0, 0)
+    previous, previous_seq = t0, seq0
+    entries = []
+    for (seq, _, _, co2, temperature, humidity), timestamp in zip(samples, times):
+        entries.append(array([_cbor_int(timestamp - previous),
+                              _cbor_int((seq - previous_seq) & 0xFFFFFFFF), _cbor_int(co2),
+                              _cbor_int(temperature), _cbor_int(humidity)]))
+        previous, previous_seq = timestamp, seq
+    return array([_cbor_int(CBOR_VERSION), _cbor_int(TIME_UTC if utc else TIME_UPTIME),
+                  _cbor_int(t0), _cbor_int(seq0), array(entries)])
+
+
+def selftest():
+    samples = [(7, 123456789, None, 41234, 21500, 55250),
+               (8, 123461789, None, 41301, -1250, 55100),
+               (12, 123466790, None, 4000000, 0, 100000)]
+    # UTC, stepped back by a resync between the last two
+    synced = [(20, None, 1792195200123, 41234, 21500, 55250),
+              (21, None, 1792195205123, 41301, -1250, 55100),
+              (22, None, 1792195205100, 40000, 0, 100000)]
+    for indefinite in (True, False):
+        assert decode(encode_cbor(samples, indefinite)) == samples
+        assert decode(encode_cbor(synced, indefinite)) == synced
+    # version 1, no sequence numbers
+    v1 = bytes.fromhex("83011a075bcd15" "81" "84" "00" "19a112" "1953fc" "19d7d2")
+    assert decode(v1) == [(None, 123456789, None, 41234, 21500, 55250)]
+    # version 2, uptime only
+    v2 = bytes.fromhex("84021a075bcd1507" "81" "85" "00" "00" "19a112" "1953fc" "19d7d2")
+    assert decode(v2) == [(7, 123456789, None, 41234, 21500, 55250)]
+    assert decode(b"412.34,21.500,55.250,") == [(None, None, None, 41234, 21500, 55250)]
+    assert decode(b"7:412.34,21.500,55.250,8@1792195200.123:1.00,0.000,0.000,") == \
+        [(7, None, None, 41234, 21500, 55250), (8, None, 1792195200123, 100, 0, 0)]
+    assert to_csv(synced[:1]) == ["20,,2026-10-17T00:00:00.123Z,412.34,21.500,55.250"]
+    seen = set()
+    assert dedup(samples[:2], seen) == samples[:2]
+    assert dedup(samples, seen) == samples[2:]
+    print("selftest ok")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("payload", nargs="?", help="file with the raw payload, - for stdin")
+    parser.add_argument("--hex", help="payload given as a hex string")
+    parser.add_argument("--dedup", action="store_true",
+                        help="read one hex payload per line, drop repeated sequence numbers")
+    parser.add_argument("--selftest", action="store_true", help="run the round-trip check")
+    args = parser.parse_args()
+
+    if args.selftest:
+        selftest()
+        return 0
+    if args.dedup:
+        seen = set()
+        source = open(args.payload) if args.payload and args.payload != "-" else sys.stdin
+        print("seq,uptime_ms,utc,co2_ppm,temperature_c,humidity_rh")
+        for line in source:
+            if line.strip():
+                rows = to_csv(dedup(decode(bytes.fromhex(line.strip())), seen))
+                if rows:
+                    print("\n".join(rows))
+        return 0
+    if args.hex:
+        data = bytes.fromhex(args.hex)
+    elif args.payload and args.payload != "-":
+        with open(args.payload, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    print("seq,uptime_ms,utc,co2_ppm,temperature_c,humidity_rh")
+    print("\n".join(to_csv(decode(data))))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())